@@ -0,0 +1,245 @@
+#ifndef ASSEMBLER_SERVER_H
+#define ASSEMBLER_SERVER_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <set>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Protocol (all integers are 32-bit big-endian):
+//   request:  length, assembly source
+//   response: status, text length, text.mc image, data length, data.mc image, log length, log
+// status is the assembler's exit code (0 on success, an ErrorType otherwise).
+
+typedef int (*AssembleFunction)(istream&, ostream&, ostream&, const string&);
+
+// Largest accepted request, to keep a bad client from exhausting memory
+const uint32_t MAX_REQUEST_SIZE = 64u << 20;
+
+bool readFull(int fd, void* buffer, size_t length) {
+    char* p = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool writeFull(int fd, const void* buffer, size_t length) {
+    const char* p = static_cast<const char*>(buffer);
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+void appendU32(string& out, uint32_t value) {
+    uint32_t be = htonl(value);
+    out.append(reinterpret_cast<const char*>(&be), 4);
+}
+
+void appendFrame(string& out, const string& payload) {
+    appendU32(out, payload.size());
+    out += payload;
+}
+
+bool readFrame(int fd, string& payload) {
+    uint32_t be;
+    if (!readFull(fd, &be, 4)) return false;
+    uint32_t length = ntohl(be);
+    if (length > MAX_REQUEST_SIZE) return false;
+    payload.resize(length);
+    return length == 0 || readFull(fd, &payload[0], length);
+}
+
+// State of a forked request child, reachable from the atexit hook because
+// assembler errors leave through exit()
+int child_response_fd = -1;
+ostringstream* child_text = nullptr;
+ostringstream* child_data = nullptr;
+ostringstream* child_log = nullptr;
+
+void sendChildResponse() {
+    if (child_response_fd < 0) return;
+    cout.flush();
+    string body;
+    appendFrame(body, child_text->str());
+    appendFrame(body, child_data->str());
+    appendFrame(body, child_log->str());
+    writeFull(child_response_fd, body.data(), body.size());
+    close(child_response_fd);
+    child_response_fd = -1;
+    // Nothing else may reach the real stdout, which may be the protocol channel
+    cout.rdbuf(nullptr);
+    cerr.rdbuf(nullptr);
+}
+
+// Assemble one request in a forked child: the parent's tables are shared
+// copy-on-write and every request starts from pristine global state
+string handleRequest(const string& source, AssembleFunction assemble) {
+    string response;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        appendU32(response, 255);
+        appendFrame(response, "");
+        appendFrame(response, "");
+        appendFrame(response, "Error: pipe failed");
+        return response;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        ostringstream text, data, log;
+        child_text = &text;
+        child_data = &data;
+        child_log = &log;
+        child_response_fd = fds[1];
+        cout.rdbuf(log.rdbuf());
+        cerr.rdbuf(log.rdbuf());
+        atexit(sendChildResponse);
+
+        istringstream input(source);
+        int status = assemble(input, text, data, "");
+        exit(status);
+    }
+    close(fds[1]);
+
+    string body;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        body.append(buffer, n);
+    }
+    close(fds[0]);
+
+    int wstatus = 0;
+    uint32_t status = 255;
+    if (pid > 0 && waitpid(pid, &wstatus, 0) == pid && WIFEXITED(wstatus)) status = WEXITSTATUS(wstatus);
+    appendU32(response, status);
+    if (body.size() < 12) {
+        appendFrame(response, "");
+        appendFrame(response, "");
+        appendFrame(response, "Error: assembler terminated without a response");
+    } else {
+        response += body;
+    }
+    return response;
+}
+
+// Serve framed requests from stdin, answering on stdout in order
+int runStdioServer(AssembleFunction assemble) {
+    string request;
+    while (readFrame(STDIN_FILENO, request)) {
+        string response = handleRequest(request, assemble);
+        if (!writeFull(STDOUT_FILENO, response.data(), response.size())) return 1;
+    }
+    return 0;
+}
+
+// One pool worker: accept connections and serve their requests one by one
+void serveConnections(int listen_fd, AssembleFunction assemble) {
+    while (true) {
+        int conn = accept(listen_fd, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        string request;
+        while (readFrame(conn, request)) {
+            string response = handleRequest(request, assemble);
+            if (!writeFull(conn, response.data(), response.size())) break;
+        }
+        close(conn);
+    }
+}
+
+// Set by SIGINT/SIGTERM in the server master
+volatile sig_atomic_t server_stopping = 0;
+
+void stopServer(int) {
+    server_stopping = 1;
+}
+
+// Listen on a UNIX domain socket with a pre-forked pool of workers, so that
+// several clients are assembled concurrently; dead workers are replaced
+int runSocketServer(const string& path, int workers, AssembleFunction assemble) {
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        cerr << "Error: Cannot create socket" << endl;
+        return 1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Error: Socket path too long: " << path << endl;
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        cerr << "Error: Cannot listen on " << path << endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    // No SA_RESTART, so that wait() returns when the server is asked to stop
+    struct sigaction action = {};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    cout << "Assembler server listening on " << path << " with " << workers << " workers" << endl;
+
+    set<pid_t> pool;
+    auto spawn = [&]() {
+        pid_t pid = fork();
+        if (pid == 0) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            serveConnections(listen_fd, assemble);
+            _exit(0);
+        }
+        if (pid > 0) pool.insert(pid);
+    };
+    for (int i = 0; i < workers; i++) spawn();
+
+    while (!pool.empty() && !server_stopping) {
+        pid_t pid = wait(nullptr);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pool.erase(pid) && !server_stopping) spawn();
+    }
+
+    for (pid_t pid : pool) kill(pid, SIGTERM);
+    for (pid_t pid : pool) waitpid(pid, nullptr, 0);
+    close(listen_fd);
+    unlink(path.c_str());
+    cout << "Assembler server stopped" << endl;
+    return 0;
+}
+
+#endif
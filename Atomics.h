@@ -0,0 +1,93 @@
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include <cstdint>
+#include "Sparse_Memory.h"
+#include "Predecoder.h"
+
+using namespace std;
+
+// RV32A on host atomics. Every AMO is one host read-modify-write on the
+// guest word (sequentially consistent, which covers any aq/rl ordering), so
+// harts on different host threads see each other's atomics as indivisible.
+// SC.W succeeds when the word still holds the value LR.W read, checked with
+// a host compare-and-swap; like most emulators this cannot tell an
+// intervening store of the same value apart (ABA), which the spec allows
+// only for LR/SC sequences that do not depend on it.
+// Misaligned addresses have no trap to raise yet and fall back to a plain,
+// non-atomic read-modify-write.
+
+// Reservation held by one hart between LR.W and SC.W
+struct Reservation {
+    uint32_t addr = 0;
+    uint32_t value = 0;
+    bool valid = false;
+};
+
+// New memory value of an AMO
+inline uint32_t amo_result(Op op, uint32_t old, uint32_t value) {
+    switch (op) {
+        case OP_AMOSWAP_W: return value;
+        case OP_AMOADD_W: return old + value;
+        case OP_AMOXOR_W: return old ^ value;
+        case OP_AMOAND_W: return old & value;
+        case OP_AMOOR_W: return old | value;
+        case OP_AMOMIN_W: return static_cast<int32_t>(old) < static_cast<int32_t>(value) ? old : value;
+        case OP_AMOMAX_W: return static_cast<int32_t>(old) > static_cast<int32_t>(value) ? old : value;
+        case OP_AMOMINU_W: return old < value ? old : value;
+        case OP_AMOMAXU_W: return old > value ? old : value;
+        default: return old;
+    }
+}
+
+// Execute one CLASS_ATOMIC op on the word at addr (rs1) with value (rs2);
+// returns what the op writes to rd
+inline uint32_t atomic_execute(SparseMemory& memory, Reservation& reservation, Op op, uint32_t addr, uint32_t value) {
+    if (addr & 3) {
+        uint32_t old = memory.read32(addr);
+        if (op == OP_LR_W) {
+            reservation = {addr, old, true};
+            return old;
+        }
+        if (op == OP_SC_W) {
+            bool ok = reservation.valid && reservation.addr == addr && reservation.value == old;
+            reservation.valid = false;
+            if (ok) memory.write32(addr, value);
+            return ok ? 0 : 1;
+        }
+        memory.write32(addr, amo_result(op, old, value));
+        return old;
+    }
+
+    uint32_t* word = memory.word(addr);
+    switch (op) {
+        case OP_LR_W: {
+            uint32_t old = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+            reservation = {addr, old, true};
+            return old;
+        }
+        case OP_SC_W: {
+            if (!reservation.valid || reservation.addr != addr) {
+                reservation.valid = false;
+                return 1;
+            }
+            reservation.valid = false;
+            uint32_t expected = reservation.value;
+            return __atomic_compare_exchange_n(word, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? 0 : 1;
+        }
+        case OP_AMOSWAP_W: return __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST);
+        case OP_AMOADD_W: return __atomic_fetch_add(word, value, __ATOMIC_SEQ_CST);
+        case OP_AMOXOR_W: return __atomic_fetch_xor(word, value, __ATOMIC_SEQ_CST);
+        case OP_AMOAND_W: return __atomic_fetch_and(word, value, __ATOMIC_SEQ_CST);
+        case OP_AMOOR_W: return __atomic_fetch_or(word, value, __ATOMIC_SEQ_CST);
+        default: {
+            // MIN/MAX have no host instruction: compare-and-swap loop
+            uint32_t old = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+            while (!__atomic_compare_exchange_n(word, &old, amo_result(op, old, value), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            }
+            return old;
+        }
+    }
+}
+
+#endif
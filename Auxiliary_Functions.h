@@ -8,6 +8,10 @@
 #include <bitset>
 #include <unordered_map>
 #include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
 
 using namespace std;
 
@@ -130,4 +134,25 @@ string decToBinary_Len(long long n, int len) {
     }
 }
 
+// Parse a command-line option's number: the whole of text, in range for T
+// (no sign for unsigned T). False leaves value unchanged, so the caller can
+// print its usage line instead of throwing like stoi.
+template <typename T>
+bool parseNumber(const string& text, T& value, int base = 10) {
+    if (text.empty() || isspace(static_cast<unsigned char>(text[0]))) return false;
+    char* end = nullptr;
+    errno = 0;
+    if constexpr (is_signed<T>::value) {
+        long long number = strtoll(text.c_str(), &end, base);
+        if (errno || *end || number < numeric_limits<T>::min() || number > numeric_limits<T>::max()) return false;
+        value = static_cast<T>(number);
+    } else {
+        if (text[0] == '-') return false;
+        unsigned long long number = strtoull(text.c_str(), &end, base);
+        if (errno || *end || number > numeric_limits<T>::max()) return false;
+        value = static_cast<T>(number);
+    }
+    return true;
+}
+
 #endif
@@ -0,0 +1,222 @@
+#ifndef BLOCK_LAYOUT_H
+#define BLOCK_LAYOUT_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Riscv_Instructions.h"
+#include "Auxiliary_Functions.h"
+
+using namespace std;
+
+// Per-instruction profile written by the pipeline simulator (--branch-profile)
+struct ProfileEntry {
+    long long executed = 0;
+    long long taken = 0;
+};
+
+// A basic block of the .text source, kept as source lines
+struct SourceBlock {
+    vector<string> labels;       // Labels pointing at the first instruction
+    vector<string> instructions; // Instruction lines (comments kept)
+    long long start_pc = 0;      // PC of the first instruction in the original layout
+    long long count = 0;         // Times the block was entered
+    long long branch_count = 0;  // Times the terminating instruction executed
+    long long taken = 0;         // Times it was taken
+    string op;                   // Mnemonic of the last instruction
+    bool placed = false;
+};
+
+// Load "0xPC executed taken" lines
+bool loadBranchProfile(const string& filename, unordered_map<long long, ProfileEntry>& profile) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cout << "Warning: Cannot open profile " << filename << ", keeping source layout" << endl;
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        stringstream ss(line);
+        string pc_str;
+        ProfileEntry entry;
+        if (!(ss >> pc_str >> entry.executed >> entry.taken)) continue;
+        try {
+            profile[stoll(pc_str, nullptr, 16)] = entry;
+        } catch (const exception&) {
+            continue;
+        }
+    }
+    return !profile.empty();
+}
+
+// Strip comment and return the mnemonic of an instruction line
+string instructionMnemonic(const string& line) {
+    string code = line.substr(0, line.find('#'));
+    stringstream ss(code);
+    string op;
+    ss >> op;
+    return op;
+}
+
+// Split the operand list of an instruction line by commas
+vector<string> instructionOperands(const string& line) {
+    string code = trim(line.substr(0, line.find('#')));
+    stringstream ss(code);
+    string op, operand;
+    vector<string> operands;
+    ss >> op;
+    while (getline(ss, operand, ',')) {
+        operands.push_back(trim(operand));
+    }
+    return operands;
+}
+
+// Blocks ending in these never fall through to the next block
+bool isUnconditionalJump(const string& line) {
+    string op = instructionMnemonic(line);
+    if (op != "jal" && op != "jalr") return false;
+    vector<string> operands = instructionOperands(line);
+    return !operands.empty() && operands[0] == "x0";
+}
+
+// Reorder .text lines so that the hot successor of every block falls through.
+// Branches are inverted where needed, explicit jumps keep the original edges,
+// and never-executed blocks are moved behind the hot code.
+void reorderBasicBlocks(vector<string>& textLines, const unordered_map<long long, ProfileEntry>& profile) {
+    vector<SourceBlock> blocks(1);
+    long long pc = 0;
+    bool ends_block = false;
+
+    // Split the source into blocks at labels and after control transfers
+    for (const string& raw : textLines) {
+        string line = raw;
+        size_t colonPos = line.find(':');
+        if (colonPos != string::npos) {
+            size_t comment_pos = line.find('#');
+            if (comment_pos != string::npos) line = line.substr(0, comment_pos);
+            line = trim(line);
+            line = trim(line.substr(0, line.length() - 1));
+            if (!blocks.back().instructions.empty()) blocks.emplace_back();
+            blocks.back().labels.push_back(line);
+            ends_block = false;
+            continue;
+        }
+        if (ends_block) blocks.emplace_back();
+        SourceBlock& block = blocks.back();
+        if (block.instructions.empty()) block.start_pc = pc;
+        block.instructions.push_back(line);
+        string op = instructionMnemonic(line);
+        ends_block = SB_opcode_map.count(op) || UJ_opcode_map.count(op) || op == "jalr";
+        pc += 4;
+    }
+
+    // The program ends by running off the text segment: keep an empty block last
+    if (!blocks.back().instructions.empty()) blocks.emplace_back();
+    blocks.back().start_pc = pc;
+    blocks.back().labels.push_back("__text_end");
+    if (blocks.size() < 3) return;
+
+    unordered_map<string, size_t> block_of_label;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        SourceBlock& block = blocks[i];
+        for (const string& label : block.labels) block_of_label[label] = i;
+        if (block.labels.empty()) block.labels.push_back("__bb_" + to_string(i));
+        if (block.instructions.empty()) continue;
+        block.op = instructionMnemonic(block.instructions.back());
+        auto entry = profile.find(block.start_pc);
+        if (entry != profile.end()) block.count = entry->second.executed;
+        auto branch = profile.find(block.start_pc + 4 * (block.instructions.size() - 1));
+        if (branch != profile.end()) {
+            block.branch_count = branch->second.executed;
+            block.taken = branch->second.taken;
+        }
+    }
+
+    const size_t end_block = blocks.size() - 1;
+    auto branchTarget = [&](const SourceBlock& block) -> long long {
+        vector<string> operands = instructionOperands(block.instructions.back());
+        auto it = operands.size() == 3 ? block_of_label.find(operands[2]) : block_of_label.end();
+        return it == block_of_label.end() ? -1 : static_cast<long long>(it->second);
+    };
+
+    // Greedy chaining: follow the more frequent successor while it is unplaced
+    vector<size_t> order;
+    size_t current = 0;
+    while (true) {
+        blocks[current].placed = true;
+        order.push_back(current);
+
+        const SourceBlock& block = blocks[current];
+        long long next = -1;
+        if (!block.instructions.empty() && block.count > 0) {
+            long long fall = current + 1;
+            long long target = -1;
+            if (SB_opcode_map.count(block.op)) target = branchTarget(block);
+            bool prefer_taken = target >= 0 && block.taken * 2 > block.branch_count;
+            long long first = prefer_taken ? target : fall;
+            long long second = prefer_taken ? fall : target;
+            if (isUnconditionalJump(block.instructions.back())) first = second = -1;
+            if (first >= 0 && first < (long long)end_block && !blocks[first].placed && blocks[first].count > 0) next = first;
+            else if (second >= 0 && second < (long long)end_block && !blocks[second].placed && blocks[second].count > 0) next = second;
+        }
+
+        // Otherwise continue with the next hot block, then the cold ones
+        if (next < 0) {
+            for (size_t i = 0; i < end_block && next < 0; i++) {
+                if (!blocks[i].placed && blocks[i].count > 0) next = i;
+            }
+        }
+        if (next < 0) {
+            for (size_t i = 0; i < end_block && next < 0; i++) {
+                if (!blocks[i].placed) next = i;
+            }
+        }
+        if (next < 0) break;
+        current = next;
+    }
+    order.push_back(end_block);
+
+    // Emit blocks, fixing up fall-through edges that changed
+    vector<string> output;
+    int inverted = 0, jumps = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        const SourceBlock& block = blocks[order[k]];
+        size_t next = k + 1 < order.size() ? order[k + 1] : end_block;
+        size_t fall = order[k] + 1;
+        for (const string& label : block.labels) output.push_back(label + ":");
+        if (block.instructions.empty()) continue;
+
+        output.insert(output.end(), block.instructions.begin(), block.instructions.end() - 1);
+        string last = block.instructions.back();
+        bool falls_through = !isUnconditionalJump(last);
+
+        if (SB_opcode_map.count(block.op) && next != fall) {
+            long long target = branchTarget(block);
+            if (target == (long long)next) {
+                // Hot successor is the taken target: invert and branch to the old fall-through
+                static const unordered_map<string, string> inverse = {
+                    {"beq", "bne"}, {"bne", "beq"}, {"blt", "bge"}, {"bge", "blt"}};
+                vector<string> operands = instructionOperands(last);
+                last = inverse.at(block.op) + " " + operands[0] + ", " + operands[1] + ", " + blocks[fall].labels[0];
+                falls_through = false;
+                inverted++;
+            }
+        }
+        output.push_back(last);
+        if (falls_through && next != fall) {
+            output.push_back("jal x0, " + blocks[fall].labels[0]);
+            jumps++;
+        }
+    }
+
+    textLines = output;
+    cout << "Block layout: " << blocks.size() - 1 << " blocks, " << inverted << " branches inverted, "
+         << jumps << " jumps inserted" << endl;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef CHECKPOINT_LOG_H
+#define CHECKPOINT_LOG_H
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Sparse_Memory.h"
+
+using namespace std;
+
+// State of the run after some number of instructions: everything but data
+// memory as a snapshot image (Snapshot.h, no SNAP_MEMORY), plus the pages
+// written since the checkpoint before it. The oldest checkpoint holds every
+// page.
+struct Checkpoint {
+    uint64_t instructions = 0;
+    string state;
+    map<uint32_t, vector<uint8_t>> pages;
+};
+
+// What "run to the last write" looks for: a register or an address range
+struct WriteTarget {
+    uint32_t reg = 0;   // x1-x31, 0: none
+    uint32_t addr = 0;
+    uint32_t size = 0;  // Bytes from addr, 0: none
+
+    bool armed() const { return reg != 0 || size != 0; }
+
+    // An instruction wrote rd (0: none) and store_size bytes at store_addr
+    bool hit(uint32_t rd, uint32_t store_addr, uint32_t store_size) const {
+        if (reg != 0 && rd == reg) return true;
+        return size != 0 && store_size != 0 && store_addr < addr + size && addr < store_addr + store_size;
+    }
+};
+
+// Checkpoints for reverse execution (--reverse): the simulator adds one every
+// interval instructions, and going back restores the nearest one at or
+// before the target and replays forward from it. Memory is copied per page,
+// and only pages written since the last checkpoint (the DIRTY_CHECKPOINT
+// marks in Sparse_Memory.h), so a checkpoint costs what the program touched.
+// Past the byte budget the oldest checkpoint is folded into the next, which
+// moves the start of the history forward.
+class CheckpointLog {
+public:
+    uint64_t interval = 0;           // Instructions between checkpoints, 0: off
+    size_t budget = 64u << 20;       // Bytes of state and pages kept
+
+    bool enabled() const { return interval != 0; }
+    bool empty() const { return log.empty(); }
+    size_t size() const { return log.size(); }
+    const Checkpoint& operator[](size_t i) const { return log[i]; }
+    const Checkpoint& oldest() const { return log.front(); }
+    size_t bytes() const { return total; }
+    uint64_t folded() const { return folds; }
+
+    // A checkpoint is due after instructions
+    bool due(uint64_t instructions) const {
+        return enabled() && (log.empty() || instructions >= log.back().instructions + interval);
+    }
+
+    void add(uint64_t instructions, const string& state, SparseMemory& memory) {
+        if (!log.empty() && log.back().instructions >= instructions) return;
+        Checkpoint checkpoint;
+        checkpoint.instructions = instructions;
+        checkpoint.state = state;
+        auto keep = [&](uint32_t base, const SparseMemory::Page& page) {
+            checkpoint.pages[base].assign(page.bytes, page.bytes + SparseMemory::PAGE_SIZE);
+        };
+        if (log.empty()) {
+            memory.forEachPage(keep);
+            memory.takeDirty([](uint32_t, const SparseMemory::Page&) {}, SparseMemory::DIRTY_CHECKPOINT);
+        } else {
+            memory.takeDirty(keep, SparseMemory::DIRTY_CHECKPOINT);
+        }
+        total += cost(checkpoint);
+        log.push_back(move(checkpoint));
+        base = instructions;
+        while (total > budget && log.size() > 1) fold();
+    }
+
+    // Index of the latest checkpoint at or before instructions (the oldest
+    // if there is none)
+    size_t at_or_before(uint64_t instructions) const {
+        size_t i = log.size() - 1;
+        while (i > 0 && log[i].instructions > instructions) i--;
+        return i;
+    }
+
+    // Drop checkpoints of a future the run is about to leave
+    void truncate_after(uint64_t instructions) {
+        while (!log.empty() && log.back().instructions > instructions) {
+            total -= cost(log.back());
+            log.pop_back();
+        }
+    }
+
+    // Put memory back as it was at checkpoint i. Only pages that can differ
+    // are copied: those written since memory last matched a checkpoint, and
+    // those some checkpoint after i or after that one recorded.
+    void rewind(size_t i, SparseMemory& memory) {
+        set<uint32_t> changed;
+        memory.takeDirty([&](uint32_t page_base, const SparseMemory::Page&) { changed.insert(page_base); },
+                         SparseMemory::DIRTY_CHECKPOINT);
+        uint64_t low = min(log[i].instructions, base);
+        for (const Checkpoint& checkpoint : log) {
+            if (checkpoint.instructions <= low) continue;
+            for (const auto& page : checkpoint.pages) changed.insert(page.first);
+        }
+        static const uint8_t zeros[SparseMemory::PAGE_SIZE] = {};
+        for (uint32_t page_base : changed) {
+            const vector<uint8_t>* bytes = find(i, page_base);
+            memory.copyIn(page_base, bytes ? bytes->data() : zeros, SparseMemory::PAGE_SIZE);
+        }
+        memory.takeDirty([](uint32_t, const SparseMemory::Page&) {}, SparseMemory::DIRTY_CHECKPOINT);
+        base = log[i].instructions;
+    }
+
+private:
+    deque<Checkpoint> log;
+    size_t total = 0;
+    uint64_t folds = 0;
+    uint64_t base = 0;  // Checkpoint memory matched when the dirty marks were last taken
+
+    static size_t cost(const Checkpoint& checkpoint) {
+        return checkpoint.state.size() + checkpoint.pages.size() * SparseMemory::PAGE_SIZE;
+    }
+
+    // The page as of checkpoint i: its copy in the latest checkpoint at or
+    // before i. None means the page was not written yet.
+    const vector<uint8_t>* find(size_t i, uint32_t page_base) const {
+        for (size_t k = i + 1; k-- > 0;) {
+            auto it = log[k].pages.find(page_base);
+            if (it != log[k].pages.end()) return &it->second;
+        }
+        return nullptr;
+    }
+
+    // The second oldest checkpoint takes the pages of the oldest it lacks,
+    // so it holds every page and becomes the start of the history
+    void fold() {
+        Checkpoint& next = log[1];
+        total -= cost(log[0]) + cost(next);
+        for (auto& page : log[0].pages) {
+            if (!next.pages.count(page.first)) next.pages[page.first] = move(page.second);
+        }
+        total += cost(next);
+        log.pop_front();
+        folds++;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CLINT_H
+#define CLINT_H
+
+#include <cstdint>
+
+using namespace std;
+
+// Core-local interruptor: the machine timer, memory-mapped at the usual
+// SiFive/QEMU virt addresses. mtime is the simulator's clock (1 GHz: one
+// tick per instruction in code.cpp, per cycle in pipeline.cpp, the same as
+// the time CSR) and is read-only here. The timer interrupt is pending while
+// mtime >= mtimecmp; mtimecmp starts at the maximum, so it never fires
+// until the guest sets it. Loads and stores in the CLINT range are routed
+// here by the memory stage instead of data memory.
+const uint32_t CLINT_BASE = 0x02000000;
+const uint32_t CLINT_SIZE = 0x10000;
+const uint32_t CLINT_MTIMECMP = 0x02004000; // 64-bit, hart 0
+const uint32_t CLINT_MTIME = 0x0200BFF8;    // 64-bit
+
+struct Clint {
+    uint64_t mtimecmp = UINT64_MAX;
+
+    static bool contains(uint32_t addr) { return addr - CLINT_BASE < CLINT_SIZE; }
+
+    bool pending(uint64_t mtime) const { return mtime >= mtimecmp; }
+
+    // Load of size bytes at addr; other CLINT addresses read as zero
+    uint32_t read(uint32_t addr, int size, uint64_t mtime) const {
+        uint64_t value;
+        uint32_t offset;
+        if (addr - CLINT_MTIMECMP < 8) {
+            value = mtimecmp;
+            offset = addr - CLINT_MTIMECMP;
+        } else if (addr - CLINT_MTIME < 8) {
+            value = mtime;
+            offset = addr - CLINT_MTIME;
+        } else {
+            return 0;
+        }
+        value >>= 8 * offset;
+        return size >= 4 ? static_cast<uint32_t>(value) : value & ((1u << (8 * size)) - 1);
+    }
+
+    // Store of the low size bytes of value; only mtimecmp is writable
+    void write(uint32_t addr, uint32_t value, int size) {
+        for (int i = 0; i < size; i++) {
+            uint32_t offset = addr + i - CLINT_MTIMECMP;
+            if (offset >= 8) continue;
+            uint64_t byte = (value >> (8 * i)) & 0xFF;
+            mtimecmp = (mtimecmp & ~(0xFFull << (8 * offset))) | (byte << (8 * offset));
+        }
+    }
+};
+
+#endif
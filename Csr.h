@@ -0,0 +1,203 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include "Predecoder.h"
+
+using namespace std;
+
+// Zicsr with the Zicntr/Zihpm counters. Counter n (0 cycle, 1 time,
+// 2 instret, 3-31 hpmcounterN) reads through CSR 0xC00 + n (upper half
+// 0xC80 + n) and, except time, through the machine counters mcycle,
+// minstret and mhpmcounterN at 0xB00 + n (0xB80 + n). The simulator passes
+// its own raw 64-bit counts with each CSR instruction (HpmEvent says what
+// the pipeline counts in hpmcounter3 and up; others read 0). Writing a
+// machine counter stores an offset, so later reads go on from the value
+// written. Everything runs in machine mode: the trap CSRs (mstatus, mie,
+// mtvec, mepc, mcause, mtval, mip) hold the state trap() and mret() use,
+// and mscratch, misa and mhartid complete the set. Accessing a CSR that does
+// not exist, or writing a read-only one, is an illegal instruction.
+
+const uint32_t CSR_MSTATUS = 0x300;
+const uint32_t CSR_MISA = 0x301;
+const uint32_t CSR_MIE = 0x304;
+const uint32_t CSR_MTVEC = 0x305;
+const uint32_t CSR_MSCRATCH = 0x340;
+const uint32_t CSR_MEPC = 0x341;
+const uint32_t CSR_MCAUSE = 0x342;
+const uint32_t CSR_MTVAL = 0x343;
+const uint32_t CSR_MIP = 0x344;
+const uint32_t CSR_MCOUNTERS = 0xB00;   // mcycle, minstret, mhpmcounter3..31
+const uint32_t CSR_MCOUNTERS_H = 0xB80;
+const uint32_t CSR_COUNTERS = 0xC00;    // cycle, time, instret, hpmcounter3..31 (read-only)
+const uint32_t CSR_COUNTERS_H = 0xC80;
+const uint32_t CSR_MHARTID = 0xF14;
+
+const int COUNTER_CYCLE = 0;
+const int COUNTER_TIME = 1;             // 1 GHz, like clock_gettime: one tick per cycle
+const int COUNTER_INSTRET = 2;
+typedef array<uint64_t, 32> CounterValues;
+
+const uint32_t MSTATUS_MIE = 1u << 3;   // Interrupts enabled
+const uint32_t MSTATUS_MPIE = 1u << 7;  // MIE before the trap
+const uint32_t MSTATUS_MPP = 3u << 11;  // Previous privilege: always machine
+const uint32_t MIP_MTIP = 1u << 7;      // Machine timer interrupt (mie.MTIE, mip.MTIP)
+const uint32_t MIP_MEIP = 1u << 11;     // Machine external interrupt (devices on the MMIO bus)
+const uint32_t MISA_RV32IMA = (1u << 30) | (1u << 0) | (1u << 8) | (1u << 12);
+
+// mcause values; interrupts have the top bit set
+const uint32_t CAUSE_ILLEGAL_INSTRUCTION = 2;
+const uint32_t CAUSE_BREAKPOINT = 3;
+const uint32_t CAUSE_MACHINE_TIMER = 0x80000007;
+const uint32_t CAUSE_MACHINE_EXTERNAL = 0x8000000B;
+
+inline string trap_name(uint32_t cause) {
+    switch (cause) {
+        case CAUSE_ILLEGAL_INSTRUCTION: return "illegal instruction";
+        case CAUSE_BREAKPOINT: return "breakpoint";
+        case CAUSE_MACHINE_TIMER: return "machine timer interrupt";
+        case CAUSE_MACHINE_EXTERNAL: return "machine external interrupt";
+        default: return "trap " + to_string(cause);
+    }
+}
+
+// Pipeline events behind hpmcounter3 and up (PipelineSimulator Stats)
+enum HpmEvent {
+    HPM_STALLS = 3,
+    HPM_DATA_HAZARDS,
+    HPM_CONTROL_HAZARDS,
+    HPM_MISPREDICTIONS,
+    HPM_DATA_HAZARD_STALLS,
+    HPM_CONTROL_HAZARD_STALLS,
+    HPM_DATA_TRANSFERS,
+    HPM_ALU_INSTRUCTIONS,
+    HPM_CONTROL_INSTRUCTIONS
+};
+
+// The CSRs of one hart
+struct CsrFile {
+    uint32_t mhartid = 0;
+    uint32_t mscratch = 0;
+    CounterValues offsets = {};  // Added to the raw counts; set by writing mcycle etc.
+    uint32_t mstatus = 0;        // MIE and MPIE; MPP reads as machine mode
+    uint32_t mie = 0;            // MTIE and MEIE
+    uint32_t mip = 0;            // MTIP and MEIP, kept up to date by the simulator from the timer and devices
+    uint32_t mtvec = 0;          // Handler base, direct (mode 0) or vectored (mode 1); 0 = no handler
+    uint32_t mepc = 0;
+    uint32_t mcause = 0;
+    uint32_t mtval = 0;
+
+    // A trap handler is installed; without one a trap stops the run
+    bool has_handler() const { return (mtvec & ~3u) != 0; }
+
+    // Cause of the interrupt taken before the next instruction, or 0 if none
+    // is pending and enabled; external interrupts go before the timer
+    uint32_t pending_interrupt() const {
+        if (!(mstatus & MSTATUS_MIE)) return 0;
+        if (mip & mie & MIP_MEIP) return CAUSE_MACHINE_EXTERNAL;
+        if (mip & mie & MIP_MTIP) return CAUSE_MACHINE_TIMER;
+        return 0;
+    }
+
+    // Enter the handler for cause with the PC to return to and mtval;
+    // returns the handler address
+    uint32_t trap(uint32_t cause, uint32_t epc, uint32_t tval) {
+        mepc = epc;
+        mcause = cause;
+        mtval = tval;
+        mstatus = (mstatus & MSTATUS_MIE ? mstatus | MSTATUS_MPIE : mstatus & ~MSTATUS_MPIE) & ~MSTATUS_MIE;
+        uint32_t base = mtvec & ~3u;
+        if ((mtvec & 3) == 1 && (cause >> 31)) return base + 4 * (cause & 0x7FFFFFFF);
+        return base;
+    }
+
+    // Return from the handler: restore MIE and continue at mepc
+    uint32_t mret() {
+        mstatus = (mstatus & MSTATUS_MPIE ? mstatus | MSTATUS_MIE : mstatus & ~MSTATUS_MIE) | MSTATUS_MPIE;
+        return mepc;
+    }
+
+    // Execute a CLASS_CSR op: a is rs1's value (unused by the i forms), raw
+    // the simulator's counts before this instruction. Returns false for an
+    // illegal access, leaving every CSR as it was; otherwise result is the
+    // old value for rd.
+    bool execute(const MicroOp& uop, uint32_t a, const CounterValues& raw, uint32_t& result) {
+        uint32_t csr = uop.imm & 0xFFF, old;
+        if (!read(csr, raw, old)) return false;
+        uint32_t operand = uop.op >= OP_CSRRWI ? uop.rs1 : a;
+        bool write = uop.op == OP_CSRRW || uop.op == OP_CSRRWI || uop.rs1 != 0;
+        if (write) {
+            uint32_t value = old & ~operand;
+            if (uop.op == OP_CSRRW || uop.op == OP_CSRRWI) value = operand;
+            else if (uop.op == OP_CSRRS || uop.op == OP_CSRRSI) value = old | operand;
+            if (!this->write(csr, value, raw)) return false;
+        }
+        result = old;
+        return true;
+    }
+
+private:
+    // Counter behind a counter CSR, or -1
+    static int counter(uint32_t csr, bool& high) {
+        uint32_t base = csr & ~0x1Fu;
+        int n = csr & 0x1F;
+        high = base == CSR_COUNTERS_H || base == CSR_MCOUNTERS_H;
+        if (base == CSR_COUNTERS || base == CSR_COUNTERS_H) return n;
+        if ((base == CSR_MCOUNTERS || base == CSR_MCOUNTERS_H) && n != COUNTER_TIME) return n;
+        return -1;
+    }
+
+    bool read(uint32_t csr, const CounterValues& raw, uint32_t& value) const {
+        switch (csr) {
+            case CSR_MSTATUS: value = mstatus | MSTATUS_MPP; return true;
+            case CSR_MISA: value = MISA_RV32IMA; return true;
+            case CSR_MIE: value = mie; return true;
+            case CSR_MTVEC: value = mtvec; return true;
+            case CSR_MSCRATCH: value = mscratch; return true;
+            case CSR_MEPC: value = mepc; return true;
+            case CSR_MCAUSE: value = mcause; return true;
+            case CSR_MTVAL: value = mtval; return true;
+            case CSR_MIP: value = mip; return true;
+            case CSR_MHARTID: value = mhartid; return true;
+        }
+        bool high;
+        int n = counter(csr, high);
+        if (n < 0) return false;
+        uint64_t count = raw[n] + offsets[n];
+        value = high ? count >> 32 : count;
+        return true;
+    }
+
+    bool write(uint32_t csr, uint32_t value, const CounterValues& raw) {
+        if ((csr >> 10) == 3) return false; // 0xC00-0xFFF are read-only
+        switch (csr) {
+            case CSR_MSTATUS: mstatus = value & (MSTATUS_MIE | MSTATUS_MPIE); return true;
+            case CSR_MISA: case CSR_MIP: return true; // Fixed or set by hardware: writes are ignored
+            case CSR_MIE: mie = value & (MIP_MTIP | MIP_MEIP); return true;
+            case CSR_MTVEC: mtvec = value & ~2u; return true;
+            case CSR_MSCRATCH: mscratch = value; return true;
+            case CSR_MEPC: mepc = value & ~3u; return true;
+            case CSR_MCAUSE: mcause = value; return true;
+            case CSR_MTVAL: mtval = value; return true;
+        }
+        bool high;
+        int n = counter(csr, high);
+        if (n < 0) return false;
+        uint64_t count = raw[n] + offsets[n];
+        count = high ? (count & 0xFFFFFFFFull) | (static_cast<uint64_t>(value) << 32)
+                     : (count & ~0xFFFFFFFFull) | value;
+        offsets[n] = count - raw[n];
+        return true;
+    }
+};
+
+// mret and wfi only mean something where traps are modelled (code.cpp's step
+// mode and pipeline.cpp): the fast modes stop when they reach one, and also
+// once a CSR write installs a handler (CsrFile::has_handler())
+inline bool trap_only(const MicroOp& uop) {
+    return uop.op == OP_MRET || uop.op == OP_WFI;
+}
+
+#endif
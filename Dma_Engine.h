@@ -0,0 +1,112 @@
+#ifndef DMA_ENGINE_H
+#define DMA_ENGINE_H
+
+#include <vector>
+#include <cstdint>
+#include "Sparse_Memory.h"
+
+using namespace std;
+
+// DMA engine on the MMIO bus (Mmio_Bus.h): the guest programs source,
+// destination and length, then writes GO to the control register. The
+// simulator calls tick() once a cycle (pipeline.cpp) or per instruction
+// (code.cpp's step mode), and each tick copies up to bytes_per_cycle bytes,
+// front to back like memcpy, unless the CPU used the memory port that cycle.
+// When the copy finishes, STATUS.DONE is set and, with CTRL.IE, the machine
+// external interrupt is pending until the guest clears DONE.
+const uint32_t DMA_BASE = 0x02040000;
+const uint32_t DMA_SRC = 0x00;
+const uint32_t DMA_DST = 0x04;
+const uint32_t DMA_LEN = 0x08;
+const uint32_t DMA_CTRL = 0x0C;    // Write: GO starts a copy (ignored while busy), IE enables the interrupt
+const uint32_t DMA_STATUS = 0x10;  // Read: BUSY, DONE. Write DONE to clear it
+const uint32_t DMA_COPIED = 0x14;  // Read: bytes copied by the current or last copy
+
+const uint32_t DMA_CTRL_GO = 1u << 0;
+const uint32_t DMA_CTRL_IE = 1u << 1;
+const uint32_t DMA_STATUS_BUSY = 1u << 0;
+const uint32_t DMA_STATUS_DONE = 1u << 1;
+
+struct DmaEngine {
+    uint32_t src = 0;
+    uint32_t dst = 0;
+    uint32_t length = 0;
+    uint32_t copied = 0;
+    bool busy = false;
+    bool done = false;
+    bool interrupt_enable = false;
+    uint32_t bytes_per_cycle = 4;  // --dma-rate
+
+    // For the statistics
+    uint64_t bytes_total = 0;
+    uint64_t busy_cycles = 0;
+    uint64_t port_conflicts = 0;   // Cycles lost to the CPU's memory accesses
+
+    bool interrupt() const { return done && interrupt_enable; }
+
+    // Idle with no copy programmed; the rate is a setting and stays
+    void reset() {
+        uint32_t rate = bytes_per_cycle;
+        *this = DmaEngine();
+        bytes_per_cycle = rate;
+    }
+
+    uint32_t read(uint32_t offset) const {
+        switch (offset) {
+            case DMA_SRC: return src;
+            case DMA_DST: return dst;
+            case DMA_LEN: return length;
+            case DMA_CTRL: return interrupt_enable ? DMA_CTRL_IE : 0;
+            case DMA_STATUS: return (busy ? DMA_STATUS_BUSY : 0) | (done ? DMA_STATUS_DONE : 0);
+            case DMA_COPIED: return copied;
+            default: return 0;
+        }
+    }
+
+    void write(uint32_t offset, uint32_t value) {
+        switch (offset) {
+            case DMA_SRC: if (!busy) src = value; break;
+            case DMA_DST: if (!busy) dst = value; break;
+            case DMA_LEN: if (!busy) length = value; break;
+            case DMA_CTRL:
+                interrupt_enable = value & DMA_CTRL_IE;
+                if ((value & DMA_CTRL_GO) && !busy) {
+                    copied = 0;
+                    done = length == 0;
+                    busy = length != 0;
+                }
+                break;
+            case DMA_STATUS:
+                if (value & DMA_STATUS_DONE) done = false;
+                break;
+        }
+    }
+
+    // One cycle of the copy. port_free is false if the CPU accessed data
+    // memory this cycle. The bytes written go to chunk, starting at chunk_addr,
+    // so a lockstep reference can replay them.
+    void tick(SparseMemory& memory, bool port_free, uint32_t& chunk_addr, vector<uint8_t>& chunk) {
+        chunk.clear();
+        if (!busy) return;
+        busy_cycles++;
+        if (!port_free) {
+            port_conflicts++;
+            return;
+        }
+        uint32_t count = min(bytes_per_cycle, length - copied);
+        chunk_addr = dst + copied;
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t byte = memory.read8(src + copied + i);
+            memory.write8(dst + copied + i, byte);
+            chunk.push_back(byte);
+        }
+        copied += count;
+        bytes_total += count;
+        if (copied == length) {
+            busy = false;
+            done = true;
+        }
+    }
+};
+
+#endif
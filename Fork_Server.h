@@ -0,0 +1,154 @@
+#ifndef FORK_SERVER_H
+#define FORK_SERVER_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// One run of a sweep, from a line of the variants file:
+//   name [key=value ...] [patch=0xADDR:0xVALUE ...]
+// Settings are interpreted by the simulator; patches are written into data
+// memory, their width given by the hex digits of the value as in data.mc.
+struct RunVariant {
+    string name;
+    map<string, string> settings;
+    vector<pair<uint32_t, string>> patches;
+};
+
+bool loadVariants(const string& filename, vector<RunVariant>& variants) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error: Cannot open " << filename << endl;
+        return false;
+    }
+    string line;
+    int line_num = 0;
+    while (getline(file, line)) {
+        ++line_num;
+        size_t comment_pos = line.find('#');
+        if (comment_pos != string::npos) line = line.substr(0, comment_pos);
+        stringstream ss(line);
+        RunVariant variant;
+        if (!(ss >> variant.name)) continue;
+        string item;
+        while (ss >> item) {
+            size_t eq = item.find('=');
+            if (eq == string::npos) {
+                cerr << "Error: Expected key=value at line " << line_num << ": " << item << endl;
+                return false;
+            }
+            string key = item.substr(0, eq), value = item.substr(eq + 1);
+            if (key == "patch") {
+                size_t colon = value.find(':');
+                if (colon == string::npos || value.compare(colon + 1, 2, "0x") != 0) {
+                    cerr << "Error: Expected patch=0xADDR:0xVALUE at line " << line_num << endl;
+                    return false;
+                }
+                try {
+                    variant.patches.push_back({static_cast<uint32_t>(stoul(value.substr(0, colon), nullptr, 16)), value.substr(colon + 1)});
+                } catch (const exception&) {
+                    cerr << "Error: Invalid patch at line " << line_num << ": " << value << endl;
+                    return false;
+                }
+            } else {
+                variant.settings[key] = value;
+            }
+        }
+        variants.push_back(variant);
+    }
+    return !variants.empty();
+}
+
+// Pipe to the parent in a forked run, -1 elsewhere
+int fork_report_fd = -1;
+
+// Child: hand one line of results to the parent (at most one pipe buffer)
+void sendForkReport(const string& report) {
+    if (fork_report_fd < 0) return;
+    string line = report + "\n";
+    size_t done = 0;
+    while (done < line.size()) {
+        ssize_t n = write(fork_report_fd, line.data() + done, line.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    close(fork_report_fd);
+    fork_report_fd = -1;
+}
+
+// Fork one copy-on-write child per variant from the current process state,
+// at most jobs at a time. A child gets its stdout redirected to <name>.log
+// and returns its variant index; the parent returns -1 once every child has
+// exited, with reports[i] holding child i's report (empty if it sent none).
+int forkVariants(const vector<RunVariant>& variants, int jobs, vector<string>& reports) {
+    reports.assign(variants.size(), "");
+    map<pid_t, pair<size_t, int>> running; // pid -> variant, report pipe
+    if (jobs < 1) jobs = 1;
+    cout.flush();
+
+    auto reap = [&]() {
+        int status = 0;
+        pid_t pid = wait(&status);
+        if (pid < 0) return false;
+        auto it = running.find(pid);
+        if (it == running.end()) return true;
+        char buffer[4096];
+        ssize_t n;
+        string& report = reports[it->second.first];
+        while ((n = read(it->second.second, buffer, sizeof(buffer))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            report.append(buffer, n);
+        }
+        while (!report.empty() && report.back() == '\n') report.pop_back();
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) report = "";
+        close(it->second.second);
+        running.erase(it);
+        return true;
+    };
+
+    for (size_t i = 0; i < variants.size(); i++) {
+        while (static_cast<int>(running.size()) >= jobs && reap()) {}
+        int fds[2];
+        if (pipe(fds) != 0) {
+            cerr << "Error: pipe failed for run " << variants[i].name << endl;
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (auto& other : running) close(other.second.second);
+            fork_report_fd = fds[1];
+            int log = open((variants[i].name + ".log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (log >= 0) {
+                dup2(log, STDOUT_FILENO);
+                close(log);
+            }
+            return static_cast<int>(i);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            cerr << "Error: fork failed for run " << variants[i].name << endl;
+            close(fds[0]);
+            continue;
+        }
+        running[pid] = {i, fds[0]};
+    }
+    while (!running.empty() && reap()) {}
+    return -1;
+}
+
+#endif
@@ -0,0 +1,1621 @@
+#ifndef FUNCTIONAL_SIMULATOR_H
+#define FUNCTIONAL_SIMULATOR_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cctype>
+#include <set>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include "Riscv_Instructions.h"
+#include "Instructions_Func.h"
+#include "Auxiliary_Functions.h"
+#include "Sparse_Memory.h"
+#include "Memory_Writeback.h"
+#include "Snapshot.h"
+#include "Syscalls.h"
+#include "Predecoder.h"
+#include "Atomics.h"
+#include "Csr.h"
+#include "Clint.h"
+#include "Mmio_Bus.h"
+#include "Jit_X86_64.h"
+#include "Gdb_Stub.h"
+#include "Checkpoint_Log.h"
+#include "Watchpoints.h"
+
+using namespace std;
+
+// Fast functional mode: a direct-threaded interpreter over the predecoded
+// text. Every instruction carries the address of its handler (computed goto
+// on GCC/Clang, a switch elsewhere), branch targets are resolved to
+// instruction pointers up front and nothing is logged per instruction.
+// Runs until the program leaves the text segment, with no cycle limit, or
+// for a bounded slice when harts take turns (Multi_Hart.h).
+#if defined(__GNUC__)
+#define FAST_COMPUTED_GOTO 1
+#endif
+
+struct ThreadedInstr {
+    const void* handler = nullptr;         // Handler label (computed goto only)
+    Op op = OP_INVALID;
+    uint8_t rd = 32, rs1 = 0, rs2 = 0;     // rd 32 is a sink for writes to x0
+    int32_t imm = 0;                       // AUIPC and JAL hold their result
+    const ThreadedInstr* target = nullptr; // Branch and JAL destination
+};
+
+// Block mode: basic blocks are translated on first execution into arrays of
+// specialized handler records, cached by start PC and chained to their
+// successors, so hot loops go from block to block without a cache lookup.
+// A handler returns false when its instruction did not run (a load or store
+// in the MMIO window), which stops the block there.
+struct BlockInstr;
+typedef bool (*BlockHandler)(const BlockInstr&, uint32_t* regs, SparseMemory& memory);
+
+struct BlockInstr {
+    BlockHandler run;
+    uint8_t rd, rs1, rs2; // rd 32 is a sink for writes to x0
+    int32_t imm;
+};
+
+enum BlockExit { EXIT_FALL, EXIT_BRANCH, EXIT_JAL, EXIT_JALR, EXIT_ECALL, EXIT_ATOMIC, EXIT_CSR, EXIT_STOP };
+
+struct TranslatedBlock {
+    uint32_t start_pc = 0;
+    vector<BlockInstr> body;        // Straight-line instructions
+    BlockExit exit = EXIT_STOP;     // How the block ends
+    Op exit_op = OP_INVALID;        // Branch condition or atomic op
+    uint8_t exit_rd = 32, exit_rs1 = 0, exit_rs2 = 0;
+    int32_t exit_imm = 0;
+    uint32_t link = 0;              // Return address written by JAL/JALR
+    uint32_t taken_pc = 0;          // Branch/JAL target
+    uint32_t fall_pc = 0;           // Next PC when not taken
+    uint32_t length = 0;            // Instructions executed per pass
+    TranslatedBlock* taken = nullptr; // Chained successors
+    TranslatedBlock* fall = nullptr;
+    TranslatedBlock* jalr_last = nullptr; // Last JALR destination
+};
+
+const size_t MAX_BLOCK_LENGTH = 64;
+
+#define BLOCK_HANDLER(name, body) \
+    bool block_##name(const BlockInstr& in, uint32_t* regs, [[maybe_unused]] SparseMemory& memory) { body; return true; }
+#define BLOCK_ACCESS(name, body)                                                   \
+    bool block_##name(const BlockInstr& in, uint32_t* regs, SparseMemory& memory) { \
+        uint32_t addr = regs[in.rs1] + in.imm;                                     \
+        if (MmioBus::contains(addr)) return false;                                 \
+        body;                                                                      \
+        return true;                                                               \
+    }
+#define BR1 regs[in.rs1]
+#define BR2 regs[in.rs2]
+#define BS1 static_cast<int32_t>(regs[in.rs1])
+#define BS2 static_cast<int32_t>(regs[in.rs2])
+BLOCK_HANDLER(ADD, regs[in.rd] = BR1 + BR2)
+BLOCK_HANDLER(SUB, regs[in.rd] = BR1 - BR2)
+BLOCK_HANDLER(MUL, regs[in.rd] = BR1 * BR2)
+BLOCK_HANDLER(DIV, regs[in.rd] = alu_result(OP_DIV, BS1, BS2, 0))
+BLOCK_HANDLER(REM, regs[in.rd] = alu_result(OP_REM, BS1, BS2, 0))
+BLOCK_HANDLER(AND, regs[in.rd] = BR1 & BR2)
+BLOCK_HANDLER(OR, regs[in.rd] = BR1 | BR2)
+BLOCK_HANDLER(XOR, regs[in.rd] = BR1 ^ BR2)
+BLOCK_HANDLER(SLL, regs[in.rd] = BR1 << (BR2 & 0x1F))
+BLOCK_HANDLER(SRL, regs[in.rd] = BR1 >> (BR2 & 0x1F))
+BLOCK_HANDLER(SRA, regs[in.rd] = BS1 >> (BR2 & 0x1F))
+BLOCK_HANDLER(SLT, regs[in.rd] = BS1 < BS2)
+BLOCK_HANDLER(ADDI, regs[in.rd] = BR1 + in.imm)
+BLOCK_HANDLER(ANDI, regs[in.rd] = BR1 & in.imm)
+BLOCK_HANDLER(ORI, regs[in.rd] = BR1 | in.imm)
+BLOCK_HANDLER(XORI, regs[in.rd] = BR1 ^ in.imm)
+BLOCK_HANDLER(SLTI, regs[in.rd] = BS1 < in.imm)
+BLOCK_HANDLER(SLTIU, regs[in.rd] = BR1 < static_cast<uint32_t>(in.imm))
+BLOCK_HANDLER(SLLI, regs[in.rd] = BR1 << in.imm)
+BLOCK_HANDLER(SRLI, regs[in.rd] = BR1 >> in.imm)
+BLOCK_HANDLER(SRAI, regs[in.rd] = BS1 >> in.imm)
+BLOCK_ACCESS(LB, regs[in.rd] = static_cast<int8_t>(memory.read8(addr)))
+BLOCK_ACCESS(LH, regs[in.rd] = static_cast<int16_t>(memory.read16(addr)))
+BLOCK_ACCESS(LW, regs[in.rd] = memory.read32(addr))
+BLOCK_ACCESS(LBU, regs[in.rd] = memory.read8(addr))
+BLOCK_ACCESS(LHU, regs[in.rd] = memory.read16(addr))
+BLOCK_ACCESS(SB, memory.write8(addr, BR2 & 0xFF))
+BLOCK_ACCESS(SH, memory.write16(addr, BR2 & 0xFFFF))
+BLOCK_ACCESS(SW, memory.write32(addr, BR2))
+BLOCK_HANDLER(LUI, regs[in.rd] = in.imm) // Also AUIPC, with pc folded into imm
+#undef BR1
+#undef BR2
+#undef BS1
+#undef BS2
+#undef BLOCK_HANDLER
+#undef BLOCK_ACCESS
+
+BlockHandler block_handler(Op op) {
+    switch (op) {
+        case OP_ADD: return block_ADD;
+        case OP_SUB: return block_SUB;
+        case OP_MUL: return block_MUL;
+        case OP_DIV: return block_DIV;
+        case OP_REM: return block_REM;
+        case OP_AND: return block_AND;
+        case OP_OR: return block_OR;
+        case OP_XOR: return block_XOR;
+        case OP_SLL: return block_SLL;
+        case OP_SRL: return block_SRL;
+        case OP_SRA: return block_SRA;
+        case OP_SLT: return block_SLT;
+        case OP_ADDI: return block_ADDI;
+        case OP_ANDI: return block_ANDI;
+        case OP_ORI: return block_ORI;
+        case OP_XORI: return block_XORI;
+        case OP_SLTI: return block_SLTI;
+        case OP_SLTIU: return block_SLTIU;
+        case OP_SLLI: return block_SLLI;
+        case OP_SRLI: return block_SRLI;
+        case OP_SRAI: return block_SRAI;
+        case OP_LB: return block_LB;
+        case OP_LH: return block_LH;
+        case OP_LW: return block_LW;
+        case OP_LBU: return block_LBU;
+        case OP_LHU: return block_LHU;
+        case OP_SB: return block_SB;
+        case OP_SH: return block_SH;
+        case OP_SW: return block_SW;
+        case OP_LUI: case OP_AUIPC: return block_LUI;
+        default: return nullptr;
+    }
+}
+
+// Block cache statistics
+struct BlockStats {
+    long long translated = 0;        // Blocks translated
+    long long translated_instrs = 0; // Instructions in them
+    long long lookups = 0;           // Block entries through the cache
+    long long hits = 0;              // ... that found a translated block
+    long long chained = 0;           // Block entries through a chain pointer
+    long long executed = 0;          // Guest instructions executed
+};
+
+// Architectural effect of one retired instruction (Lockstep_Checker.h)
+struct Retirement {
+    uint32_t pc = 0;
+    uint32_t rd = 0;       // 0: no register write
+    int32_t value = 0;     // Value written to rd
+    bool store = false;    // Wrote data memory (stores and atomics)
+    uint32_t addr = 0;     // Address of the write
+    int size = 0;          // Bytes written
+};
+
+// The functional simulator: architectural state, data memory and every
+// execution mode (stage-by-stage, --fast, --blocks, --jit) of one run.
+// Instances share nothing unless built over a shared memory, so a process
+// can run several at once; each logs to its own stream.
+class FunctionalSimulator {
+    SparseMemory own_memory; // Data memory unless one is shared
+
+public:
+    explicit FunctionalSimulator(ostream& out = cout, const string& data_file = "data.mc")
+        : FunctionalSimulator(own_memory, out, data_file) {}
+
+    // One hart of a multi-hart run: data memory belongs to the caller
+    explicit FunctionalSimulator(SparseMemory& shared_memory, ostream& out = cout, const string& data_file = "data.mc")
+        : memory(shared_memory), data_writeback(memory, data_file), syscalls(memory), out(out) {
+        syscalls.setOutput(out, cerr);
+        map_standard_devices(bus, clint, dma, syscalls);
+    }
+
+    FunctionalSimulator(const FunctionalSimulator&) = delete;
+    FunctionalSimulator& operator=(const FunctionalSimulator&) = delete;
+
+    static constexpr int MAX_CYCLES = 10000; // Max cycles per run to prevent infinite loop
+
+    string save_state_file;                 // Snapshot written at save_at_cycle or at the end
+    int save_at_cycle = -1;                 // -1: save when the run ends
+
+    uint32_t pc = 0;                        // Program Counter
+    array<int32_t, 32> reg_file = {0};      // Register File (x0-x31)
+    PredecodedText code;                    // Instruction memory, predecoded at load
+    SparseMemory& memory;                   // Data memory (paged, byte-addressable)
+    MemoryWriteback data_writeback;         // Writes memory back to data.mc
+    SyscallEmulator syscalls;               // ecall handler
+    int clock_cycles = 0;                   // Clock counter
+    CsrFile csrs;                           // Zicsr state, mhartid included
+    Reservation reservation;                // LR.W reservation
+    bool halted = false;                    // Fast mode reached the end of the program or an illegal instruction
+    const char* step_reason = nullptr;      // ... or stopped where only step mode can go on (leave_for_step())
+    Retirement retired;                     // Last instruction run by step()
+    const CounterValues* pinned_counters = nullptr; // CSR reads see these counts instead (Lockstep_Checker.h)
+    Clint clint;                            // Machine timer, used by step mode
+    DmaEngine dma;                          // DMA engine, ticked once per instruction in step mode
+    MmioBus bus;                            // Devices in the MMIO window (CLINT included), used by step mode
+    bool memory_port_used = false;          // This instruction accessed data memory, so the DMA waits
+    bool external_interrupts = false;       // Take interrupts only when interrupt_cause is set (Lockstep_Checker.h)
+    uint32_t interrupt_cause = 0;
+    bool mmio_load_pinned = false;          // The next MMIO load returns pinned_mmio_load (Lockstep_Checker.h)
+    uint32_t pinned_mmio_load = 0;
+    CheckpointLog checkpoints;              // Reverse execution under --gdb (--reverse)
+    WriteTarget last_write;                 // Reverse-continue also stops after a write to this
+    WatchList watches;                      // Data watchpoints, checked by step mode's memory stage
+    bool watch_stop = false;                // The last instruction hit a watchpoint that stops the run
+
+    // Initialize simulation
+    void init_sim() {
+        // Clear register file
+        reg_file.fill(0);
+        reg_file[2] = 0x7FFFFFE4; // Stack pointer
+        reg_file[3] = 0x10000000; // Link register
+        reg_file[10] = 0x00000001;
+        reg_file[11] = 0x07FFFFE4;
+
+        // Clear memory structures
+        code.clear();
+        memory.clear();
+        visited_pcs.clear();
+        threaded.clear();
+        reservation = Reservation();
+        csrs = CsrFile();
+        clint = Clint();
+        bus.reset();
+        interrupt_cause = 0;
+        mmio_load_pinned = false;
+        halted = false;
+        step_reason = nullptr;
+
+        // Reset program counter and instruction register
+        pc = 0;
+        ir = 0;
+
+        // Reset clock cycles
+        clock_cycles = 0;
+
+        // Reset temporary registers
+        rm = 0;
+        ry = 0;
+        rz = 0;
+        mar = 0;
+
+        // Reset ALU operands
+        reg_a_val = 0;
+        reg_b_val = 0;
+        dst_reg = 0;
+        rs2 = 0;
+
+        // Reset control signals
+        ctrl = Control();
+        ctrl.mem_read = false;
+        ctrl.mem_write = false;
+        ctrl.reg_write = false;
+        ctrl.branch = false;
+        ctrl.use_imm = false;
+        ctrl.output_sel = 0;
+        uop = MicroOp();
+    }
+
+    // Load text.mc file
+    bool load_mc_file(const string& filename) {
+        ifstream file(filename);
+        if (!file.is_open()) {
+            out << "Error: Cannot open " << filename << endl;
+            return false;
+        }
+
+        string line;
+        int line_num = 0;
+        while (getline(file, line)) {
+            ++line_num;
+            size_t comment_pos = line.find('#');
+            if (comment_pos != string::npos) {
+                line = line.substr(0, comment_pos);
+            }
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t") + 1);
+            if (line.empty()) continue;
+
+            stringstream ss(line);
+            string addr_str, instr_str;
+            if (!(ss >> addr_str >> instr_str)) {
+                out << "Warning: Skipping malformed line " << line_num << ": " << line << endl;
+                continue;
+            }
+
+            if (!is_valid_hex(addr_str) || !is_valid_hex(instr_str)) {
+                out << "Warning: Skipping invalid hex at line " << line_num << ": " << addr_str << " " << instr_str << endl;
+                continue;
+            }
+
+            try {
+                uint32_t addr = stoul(addr_str, nullptr, 16);
+                uint32_t instr = stoul(instr_str, nullptr, 16);
+                code.add(addr, instr);
+                threaded.clear();
+                out << "Loaded instruction: " << to_hex(addr) << " -> " << to_hex(instr) << endl;
+            } catch (const std::invalid_argument& e) {
+                out << "Warning: Invalid number format at line " << line_num << ": " << addr_str << " " << instr_str << endl;
+                continue;
+            } catch (const std::out_of_range& e) {
+                out << "Warning: Number out of range at line " << line_num << ": " << addr_str << " " << instr_str << endl;
+                continue;
+            }
+        }
+        file.close();
+
+        if (code.empty()) {
+            out << "Error: No valid instructions loaded from " << filename << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Load data.mc file
+    bool load_data_mc(const string& filename) {
+        ifstream file(filename);
+        if (!file.is_open()) {
+            out << "Error: Cannot open " << filename << endl;
+            return false;
+        }
+
+        string line;
+        int line_num = 0;
+        while (getline(file, line)) {
+            ++line_num;
+            size_t comment_pos = line.find('#');
+            if (comment_pos != string::npos) {
+                line = line.substr(0, comment_pos);
+            }
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t") + 1);
+            if (line.empty()) continue;
+
+            stringstream ss(line);
+            string addr_str, value_str;
+            if (!(ss >> addr_str >> value_str)) {
+                out << "Warning: Skipping malformed line " << line_num << ": " << line << endl;
+                continue;
+            }
+
+            if (!is_valid_hex(addr_str) || !is_valid_hex(value_str)) {
+                out << "Warning: Skipping invalid hex at line " << line_num << ": " << addr_str << " " << value_str << endl;
+                continue;
+            }
+
+            try {
+                uint32_t addr = stoul(addr_str, nullptr, 16);
+                uint64_t value = stoull(value_str, nullptr, 16);
+                int size = (value_str.length() - 1) / 2; // Entry width follows its hex digits
+
+                memory.writeValue(addr, value, size);
+                out << "Loaded data: " << to_hex(addr) << " -> " << value_str << endl;
+            } catch (const std::invalid_argument& e) {
+                out << "Warning: Invalid number format at line " << line_num << ": " << addr_str << " " << value_str << endl;
+                continue;
+            } catch (const std::out_of_range& e) {
+                out << "Warning: Number out of range at line " << line_num << ": " << addr_str << " " << value_str << endl;
+                continue;
+            }
+        }
+        file.close();
+
+        if (memory.pages() == 0) {
+            out << "Warning: No valid data loaded from " << filename << endl;
+        }
+        return true;
+    }
+
+    // Write memory to data.mc (only pages changed since the last writeback)
+    void write_data_mc() {
+        data_writeback.finish();
+        out << "Updated data.mc with current memory state\n";
+    }
+
+    // Save registers, PC, cycle count and data memory to a snapshot
+    bool save_state(const string& filename) {
+        SnapshotWriter writer(filename);
+        save_sections(writer, true);
+        if (!writer.ok()) {
+            out << "Error: Cannot write snapshot " << filename << endl;
+            return false;
+        }
+        out << "Saved state at cycle " << clock_cycles << " to " << filename << "\n";
+        return true;
+    }
+
+    // The sections of save_state(); a checkpoint keeps memory itself
+    void save_sections(SnapshotWriter& writer, bool with_memory) {
+        CoreState core;
+        core.pc = pc;
+        for (int i = 0; i < 32; i++) core.regs[i] = reg_file[i];
+        core.cycles = core.instructions = clock_cycles;
+        core.text_fingerprint = text_fingerprint(code);
+        writer.begin(SNAP_CORE);
+        writer(core);
+        writer.end();
+        if (with_memory) {
+            writer.begin(SNAP_MEMORY);
+            writer.memory(memory);
+            writer.end();
+        }
+        uint32_t heap_end = syscalls.heapEnd();
+        uint64_t input_offset = syscalls.inputOffset();
+        writer.begin(SNAP_SYSCALL);
+        writer(heap_end);
+        writer(input_offset);
+        writer.end();
+        writer.begin(SNAP_CSR);
+        writer(csrs);
+        writer.end();
+        writer.begin(SNAP_TIMER);
+        writer(clint.mtimecmp);
+        writer.end();
+        writer.begin(SNAP_DEVICES);
+        bus.save(writer);
+        writer.end();
+        writer.begin(SNAP_RESERVATION);
+        writer(reservation);
+        writer.end();
+    }
+
+    // Continue from a snapshot taken by save_state() for the loaded text.mc
+    bool restore_state(const string& filename) {
+        SnapshotReader in(filename);
+        if (!in.ok()) {
+            out << "Error: " << in.message() << endl;
+            return false;
+        }
+        if (in.has(SNAP_PIPELINE)) {
+            out << "Error: " << filename << " holds in-flight pipeline state; restore it with the pipeline simulator\n";
+            return false;
+        }
+        CoreState core;
+        if (!restore_sections(in, core)) {
+            out << "Error: " << in.message() << endl;
+            return false;
+        }
+        if (core.text_fingerprint != text_fingerprint(code)) {
+            out << "Warning: " << filename << " was saved with a different text.mc\n";
+        }
+        out << "Restored state at cycle " << clock_cycles << " from " << filename << "\n";
+        return true;
+    }
+
+    // The sections of restore_state(); memory is left alone without SNAP_MEMORY
+    bool restore_sections(SnapshotReader& in, CoreState& core) {
+        if (in.open(SNAP_CORE)) in(core);
+        if (in.open(SNAP_MEMORY)) in.memory(memory);
+        uint32_t heap_end = HEAP_BASE;
+        uint64_t input_offset = 0;
+        if (in.open(SNAP_SYSCALL)) {
+            in(heap_end);
+            in(input_offset);
+        }
+        CsrFile restored_csrs;
+        restored_csrs.mhartid = csrs.mhartid;
+        if (in.open(SNAP_CSR)) in(restored_csrs);
+        Clint restored_clint;
+        if (in.open(SNAP_TIMER)) in(restored_clint.mtimecmp);
+        Reservation restored_reservation;
+        if (in.open(SNAP_RESERVATION)) in(restored_reservation);
+        if (!in.ok()) return false;
+        csrs = restored_csrs;
+        clint = restored_clint;
+        reservation = restored_reservation;
+        bus.reset();
+        if (in.open(SNAP_DEVICES)) bus.restore(in);
+        pc = core.pc;
+        for (int i = 1; i < 32; i++) reg_file[i] = core.regs[i];
+        clock_cycles = core.cycles;
+        syscalls.restore(heap_end, input_offset);
+        return true;
+    }
+
+    // Stage-by-stage simulation with full logging
+    void run_cycles() {
+        out << "Starting RISC-V Simulation\n";
+        int start_cycles = clock_cycles;
+        while (true) {
+            if (clock_cycles - start_cycles >= MAX_CYCLES) {
+                out << "Terminated: Maximum cycle limit (" << MAX_CYCLES << ") reached\n";
+                break;
+            }
+
+            if (!cycle()) break;
+            if (watch_stop) {
+                out << "Simulation stopped: Watchpoint hit\n";
+                break;
+            }
+        }
+    }
+
+    // One logged instruction of run_cycles(); false once the run is over
+    bool cycle() {
+        out << "\n===== Cycle " << clock_cycles << " =====\n";
+        bool pc_visited = !visited_pcs.insert(pc).second;
+
+        // Stop simulation if no instruction to decode
+        if (!step()) {
+            out << "Simulation terminated: No instruction to decode\n";
+            return false;
+        }
+        if (dma.busy) tick_dma();
+        data_writeback.tick(clock_cycles);
+        if (clock_cycles == save_at_cycle) save_state(save_state_file);
+
+        if (syscalls.exited()) {
+            out << "Simulation terminated: Program exited with code " << syscalls.exitCode() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Run for the debugger (Gdb_Stub.h): one instruction, or until the next
+    // one is at a breakpoint or the last one hit a watchpoint that stops.
+    // The instruction at pc always runs, so continuing leaves the breakpoint
+    // it stopped at. There is no MAX_CYCLES limit; the debugger stops a run
+    // that hangs, through stop_requested(), which is polled every 1024
+    // instructions. With checkpoints on, the end of the program is the end
+    // of the history and the run stays there, so the debugger can still go
+    // backwards.
+    DebugStop debug_resume(bool single_step, const BreakpointMap& breakpoints, const function<bool()>& stop_requested) {
+        DebugStop end = checkpoints.enabled() ? DEBUG_HISTORY_END : DEBUG_EXITED;
+        if (syscalls.exited()) return end;
+        checkpoints.truncate_after(clock_cycles);
+        if (checkpoints.due(clock_cycles)) take_checkpoint();
+        for (uint64_t n = 1;; n++) {
+            if (!cycle()) return syscalls.exited() || !code.at(pc) ? end : DEBUG_FAULT;
+            if (checkpoints.due(clock_cycles)) take_checkpoint();
+            if (watch_stop) return DEBUG_WATCH;
+            if (single_step || breakpoints.hit(pc)) return DEBUG_TRAP;
+            if (n % 1024 == 0 && stop_requested()) return DEBUG_INTERRUPT;
+        }
+    }
+
+    // Run backwards for the debugger: to the previous instruction, or to the
+    // latest earlier state at a breakpoint or just after a write to
+    // last_write. Each checkpoint's stretch is replayed with the log and
+    // guest output off, newest stretch first, until one holds such a state.
+    // Replay is deterministic because the checkpoint holds everything the
+    // program can observe; changes made from the debugger are not replayed.
+    DebugStop debug_reverse(bool single_step, const BreakpointMap& breakpoints) {
+        long long now = clock_cycles;
+        if (checkpoints.empty() || now <= static_cast<long long>(checkpoints.oldest().instructions)) {
+            return DEBUG_HISTORY_START;
+        }
+        streambuf* log = out.rdbuf(nullptr);
+        long long target = -1;
+        if (single_step) {
+            target = now - 1;
+        } else {
+            for (size_t k = checkpoints.at_or_before(now - 1) + 1; k-- > 0 && target < 0;) {
+                restore_checkpoint(k);
+                long long end = k + 1 < checkpoints.size() ? min<long long>(now, checkpoints[k + 1].instructions) : now;
+                while (clock_cycles < end) {
+                    if (breakpoints.hit(pc)) target = clock_cycles;
+                    if (!cycle()) break;
+                    if (clock_cycles < now && last_write.hit(retired.rd, retired.addr, retired.store ? retired.size : 0)) {
+                        target = clock_cycles;
+                    }
+                }
+            }
+        }
+        DebugStop stop = DEBUG_TRAP;
+        if (target < static_cast<long long>(checkpoints.oldest().instructions)) {
+            target = checkpoints.oldest().instructions;
+            stop = DEBUG_HISTORY_START;
+        }
+        restore_checkpoint(checkpoints.at_or_before(target));
+        while (clock_cycles < target && cycle()) {}
+        out.rdbuf(log);
+        out.clear();
+        out << "GDB: Reverse " << (single_step ? "step" : "continue") << " from instruction " << now << " to "
+            << clock_cycles << " (pc " << to_hex(pc) << ")\n";
+        return stop;
+    }
+
+    // "monitor" commands from the debugger: history, and last-write to arm
+    // reverse-continue with a register or address
+    string debug_monitor(const string& command) {
+        stringstream ss(command);
+        string verb, what;
+        ss >> verb >> what;
+        if (verb == "history") {
+            if (checkpoints.empty()) return "No checkpoints yet\n";
+            return to_string(checkpoints.size()) + " checkpoints every " + to_string(checkpoints.interval) +
+                   " instructions, " + to_string(checkpoints.bytes() / 1024) + " KiB of " +
+                   to_string(checkpoints.budget / 1024) + " KiB; history starts at instruction " +
+                   to_string(checkpoints.oldest().instructions) + " (" + to_string(checkpoints.folded()) + " folded)\n";
+        }
+        if (verb == "last-write") {
+            WriteTarget target;
+            try {
+                if (what == "off") {
+                    last_write = target;
+                    return "reverse-continue stops at breakpoints only\n";
+                } else if (what.size() > 1 && what[0] == 'x' && isdigit(static_cast<unsigned char>(what[1]))) {
+                    target.reg = stoul(what.substr(1));
+                    if (target.reg == 0 || target.reg > 31) return "Error: x1-x31 only\n";
+                } else {
+                    target.addr = stoul(what, nullptr, 0);
+                    target.size = 4;
+                    string size;
+                    if (ss >> size) target.size = stoul(size, nullptr, 0);
+                }
+            } catch (const exception&) {
+                return "Error: last-write xN | last-write ADDR [bytes] | last-write off\n";
+            }
+            last_write = target;
+            return "reverse-continue also stops after the last write to " +
+                   (target.reg ? "x" + to_string(target.reg) : to_hex(target.addr) + " (" + to_string(target.size) + " bytes)") + "\n";
+        }
+        return "Monitor commands: history, last-write xN | ADDR [bytes] | off\n";
+    }
+
+    // A checkpoint of the current state (Checkpoint_Log.h)
+    void take_checkpoint() {
+        SnapshotWriter writer;
+        save_sections(writer, false);
+        checkpoints.add(clock_cycles, writer.image(), memory);
+    }
+
+    void restore_checkpoint(size_t i) {
+        SnapshotReader in = SnapshotReader::fromImage(checkpoints[i].state);
+        CoreState core;
+        restore_sections(in, core);
+        checkpoints.rewind(i, memory);
+    }
+
+    // One instruction through every stage; false at the end of the program
+    // or at a trap with no handler. After a trap or interrupt the handler's
+    // first instruction is the one that runs. Fills retired with what the
+    // instruction wrote.
+    bool step() {
+        watch_stop = false;
+        for (int traps = 0;; traps++) {
+            if (traps > 2) {
+                out << "Error: Trap handler at " << to_hex(pc) << " traps again\n";
+                return false;
+            }
+            retired = Retirement();
+            memory_port_used = false;
+            csrs.mip = (clint.pending(mtime()) ? MIP_MTIP : 0) | (bus.interrupt() ? MIP_MEIP : 0);
+            uint32_t interrupt = external_interrupts ? interrupt_cause : csrs.pending_interrupt();
+            if (interrupt) {
+                interrupt_cause = 0;
+                if (!take_trap(interrupt, pc, 0)) return false;
+            }
+            trapped = false;
+            retired.pc = pc;
+
+            // Pipeline stages
+            fetch();
+            decode();
+            if (trapped) continue;
+            if (ir == 0) return false;
+
+            execute();
+            if (trapped) continue;
+            if (ir == 0) return false;
+
+            // Memory access stage
+            if (ctrl.mem_read || ctrl.mem_write || ctrl.output_sel == 2) {
+                memory_access();
+            } else {
+                ry = rz;
+                out << "\n--- Memory Access Stage (Skipped) ---\n";
+                out << "RY: " << to_hex(ry) << endl;
+            }
+
+            writeback();
+
+            if (ctrl.reg_write && dst_reg != 0) {
+                retired.rd = dst_reg;
+                retired.value = ry;
+            }
+            if (ctrl.mem_write || uop.klass == CLASS_ATOMIC) {
+                retired.store = true;
+                retired.addr = mar;
+                retired.size = store_size(ctrl.alu_op);
+            }
+            return true;
+        }
+    }
+
+    // One DMA cycle after each instruction; it loses the cycle if the
+    // instruction used the memory port
+    void tick_dma() {
+        uint32_t chunk_addr;
+        vector<uint8_t> chunk;
+        dma.tick(memory, !memory_port_used, chunk_addr, chunk);
+        if (dma.done && !dma.busy && !chunk.empty()) {
+            out << "DMA: Copied " << dma.length << " bytes from " << to_hex(dma.src) << " to " << to_hex(dma.dst) << "\n";
+        }
+    }
+
+    // mtime and the time CSR: one tick per instruction
+    uint64_t mtime() const { return counters(clock_cycles)[COUNTER_TIME]; }
+
+    // Enter the trap handler for the instruction at epc (or, for an
+    // interrupt, the next one); without a handler the run stops there
+    bool take_trap(uint32_t cause, uint32_t epc, uint32_t tval) {
+        if (!csrs.has_handler()) {
+            out << "Error: Unhandled " << trap_name(cause) << " at " << to_hex(epc) << " (mtvec is 0)\n";
+            pc = epc;
+            ir = 0;
+            return false;
+        }
+        pc = csrs.trap(cause, epc, tval);
+        trapped = true;
+        out << "Trap: " << trap_name(cause) << " at " << to_hex(epc) << ", mtval=" << to_hex(tval)
+             << ", handler at " << to_hex(pc) << endl;
+        return true;
+    }
+
+    // Counts a CSR instruction sees after retired instructions: the
+    // functional model takes one cycle per instruction and has no pipeline
+    // events, so the hpmcounters stay 0
+    CounterValues counters(uint64_t retired) const {
+        if (pinned_counters) return *pinned_counters;
+        CounterValues raw = {};
+        raw[COUNTER_CYCLE] = raw[COUNTER_TIME] = raw[COUNTER_INSTRET] = retired;
+        return raw;
+    }
+
+    // Run the CLASS_CSR op at pc; an illegal access is reported and changes nothing
+    bool csr_instruction(const MicroOp& uop, uint32_t at, uint32_t a, uint64_t retired, uint32_t& result) {
+        if (csrs.execute(uop, a, counters(retired), result)) return true;
+        out << "Error: Illegal instruction " << disassemble(uop) << " at " << to_hex(at) << "\n";
+        return false;
+    }
+
+    // The fast modes stop at what only step mode models (see trap_only() in
+    // Csr.h), with pc at the instruction to go on from
+    void leave_for_step(const char* reason) {
+        step_reason = reason;
+        halted = true;
+    }
+
+    // After a fast mode: run the rest of the program in step mode if the fast
+    // mode stopped for it
+    void continue_in_step_mode() {
+        if (!step_reason) return;
+        out << "Note: Stopped at " << to_hex(pc) << " (" << step_reason
+            << "); continuing in step mode, which models traps, the timer and the MMIO devices\n";
+        step_reason = nullptr;
+        halted = false;
+        run_cycles();
+    }
+
+    void run_fast() {
+        auto start = chrono::steady_clock::now();
+        long long executed = run_threaded(LLONG_MAX);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        out << "Fast mode: " << executed << " instructions in " << fixed << setprecision(3) << seconds << " s";
+        if (seconds > 0) out << " (" << setprecision(1) << executed / seconds / 1e6 << " MIPS)";
+        out << defaultfloat << "\n";
+    }
+
+    // The threaded interpreter behind run_fast(). Runs until the program
+    // stops (setting halted) or, checked at taken branches and jumps, until at
+    // least budget instructions have executed; returns the instruction count
+    long long run_threaded(long long budget) {
+        const vector<MicroOp>& ops = code.ops;
+        const size_t count = ops.size();
+        vector<ThreadedInstr>& program = threaded; // program[count] stops the run
+        bool build = program.size() != count + 1;
+        if (build) program.assign(count + 1, ThreadedInstr());
+        // Locals, so that guest stores (byte writes may alias anything) do not
+        // force the compiler to reload them from this
+        SparseMemory& mem = memory;
+        const ThreadedInstr* const first = program.data();
+        const uint32_t base = code.base;
+        uint32_t regs[33];
+        for (int i = 0; i < 32; i++) regs[i] = reg_file[i];
+        regs[0] = regs[32] = 0;
+        long long executed = 0;
+
+#ifdef FAST_COMPUTED_GOTO
+        static const void* const labels[OP_COUNT] = {
+            &&op_INVALID,
+            &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_REM, &&op_AND, &&op_OR, &&op_XOR,
+            &&op_SLL, &&op_SRL, &&op_SRA, &&op_SLT,
+            &&op_ADDI, &&op_ANDI, &&op_ORI, &&op_XORI, &&op_SLTI, &&op_SLTIU, &&op_SLLI, &&op_SRLI, &&op_SRAI,
+            &&op_LB, &&op_LH, &&op_LW, &&op_LBU, &&op_LHU,
+            &&op_SB, &&op_SH, &&op_SW,
+            &&op_BEQ, &&op_BNE, &&op_BLT, &&op_BGE,
+            &&op_JAL, &&op_JALR, &&op_LUI, &&op_AUIPC,
+            &&op_ECALL,
+            &&op_LR_W, &&op_SC_W, &&op_AMOSWAP_W, &&op_AMOADD_W, &&op_AMOXOR_W, &&op_AMOAND_W, &&op_AMOOR_W,
+            &&op_AMOMIN_W, &&op_AMOMAX_W, &&op_AMOMINU_W, &&op_AMOMAXU_W,
+            &&op_CSRRW, &&op_CSRRS, &&op_CSRRC, &&op_CSRRWI, &&op_CSRRSI, &&op_CSRRCI,
+            &&op_INVALID, &&op_MRET, &&op_WFI // EBREAK stops the run; traps are step mode only
+        };
+#endif
+
+        // Instruction at addr, or the stop entry outside the text segment
+        auto resolve = [&](uint32_t addr) -> const ThreadedInstr* {
+            if (addr < base || (addr & 3)) return first + count;
+            size_t index = (addr - base) / 4;
+            return first + (index < count ? index : count);
+        };
+
+        for (size_t i = 0; build && i < count; i++) {
+            const MicroOp& uop = ops[i];
+            ThreadedInstr& t = program[i];
+            uint32_t addr = code.base + 4 * i;
+            t.op = uop.raw && (uop.klass != CLASS_PRIV || trap_only(uop)) ? uop.op : OP_INVALID;
+            if (uop.write_mask) t.rd = uop.rd;
+            t.rs1 = uop.rs1;
+            t.rs2 = uop.rs2;
+            t.imm = uop.imm;
+            if (uop.klass == CLASS_BRANCH || uop.op == OP_JAL) t.target = resolve(addr + uop.imm);
+            if (uop.op == OP_JAL) t.imm = addr + 4;
+            if (uop.op == OP_AUIPC) t.imm = addr + uop.imm;
+        }
+#ifdef FAST_COMPUTED_GOTO
+        if (build) {
+            for (ThreadedInstr& t : program) t.handler = labels[t.op];
+        }
+#endif
+
+        const ThreadedInstr* ip = resolve(pc);
+
+#define R1 regs[ip->rs1]
+#define R2 regs[ip->rs2]
+#define S1 static_cast<int32_t>(regs[ip->rs1])
+#define S2 static_cast<int32_t>(regs[ip->rs2])
+#define RD regs[ip->rd]
+#ifdef FAST_COMPUTED_GOTO
+#define HANDLER(name) op_##name:
+#define DISPATCH() goto *ip->handler
+#else
+#define HANDLER(name) case OP_##name:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() do { ++executed; ++ip; DISPATCH(); } while (0)
+#define JUMP(dest) do { ++executed; ip = (dest); if (executed >= budget) goto fast_done; DISPATCH(); } while (0)
+#define LOAD(name, value) HANDLER(name) { uint32_t addr = R1 + ip->imm; if (MmioBus::contains(addr)) goto mmio; RD = value; NEXT(); }
+#define STORE(name, write) HANDLER(name) { uint32_t addr = R1 + ip->imm; if (MmioBus::contains(addr)) goto mmio; write; NEXT(); }
+#define ATOMIC(name) HANDLER(name) RD = atomic_execute(mem, reservation, OP_##name, R1, R2); NEXT();
+#define CSR(name) HANDLER(name) {                                                               \
+            uint32_t old;                                                                       \
+            if (!csr_instruction(ops[ip - first], base + 4 * (ip - first), R1, clock_cycles + executed, old)) { \
+                halted = true;                                                                  \
+                goto fast_done;                                                                 \
+            }                                                                                   \
+            RD = old;                                                                           \
+            if (csrs.has_handler()) {                                                           \
+                ++executed;                                                                     \
+                ++ip;                                                                           \
+                leave_for_step("mtvec installs a trap handler");                                \
+                goto fast_done;                                                                 \
+            }                                                                                   \
+            NEXT();                                                                             \
+        }
+
+        DISPATCH();
+#ifndef FAST_COMPUTED_GOTO
+    dispatch:
+        switch (ip->op) {
+#endif
+        HANDLER(ADD) RD = R1 + R2; NEXT();
+        HANDLER(SUB) RD = R1 - R2; NEXT();
+        HANDLER(MUL) RD = R1 * R2; NEXT();
+        HANDLER(DIV) RD = alu_result(OP_DIV, S1, S2, 0); NEXT();
+        HANDLER(REM) RD = alu_result(OP_REM, S1, S2, 0); NEXT();
+        HANDLER(AND) RD = R1 & R2; NEXT();
+        HANDLER(OR) RD = R1 | R2; NEXT();
+        HANDLER(XOR) RD = R1 ^ R2; NEXT();
+        HANDLER(SLL) RD = R1 << (R2 & 0x1F); NEXT();
+        HANDLER(SRL) RD = R1 >> (R2 & 0x1F); NEXT();
+        HANDLER(SRA) RD = S1 >> (R2 & 0x1F); NEXT();
+        HANDLER(SLT) RD = S1 < S2; NEXT();
+        HANDLER(ADDI) RD = R1 + ip->imm; NEXT();
+        HANDLER(ANDI) RD = R1 & ip->imm; NEXT();
+        HANDLER(ORI) RD = R1 | ip->imm; NEXT();
+        HANDLER(XORI) RD = R1 ^ ip->imm; NEXT();
+        HANDLER(SLTI) RD = S1 < ip->imm; NEXT();
+        HANDLER(SLTIU) RD = R1 < static_cast<uint32_t>(ip->imm); NEXT();
+        HANDLER(SLLI) RD = R1 << ip->imm; NEXT();
+        HANDLER(SRLI) RD = R1 >> ip->imm; NEXT();
+        HANDLER(SRAI) RD = S1 >> ip->imm; NEXT();
+        LOAD(LB, static_cast<int8_t>(mem.read8(addr)))
+        LOAD(LH, static_cast<int16_t>(mem.read16(addr)))
+        LOAD(LW, mem.read32(addr))
+        LOAD(LBU, mem.read8(addr))
+        LOAD(LHU, mem.read16(addr))
+        STORE(SB, mem.write8(addr, R2 & 0xFF))
+        STORE(SH, mem.write16(addr, R2 & 0xFFFF))
+        STORE(SW, mem.write32(addr, R2))
+        HANDLER(BEQ) if (R1 == R2) JUMP(ip->target); NEXT();
+        HANDLER(BNE) if (R1 != R2) JUMP(ip->target); NEXT();
+        HANDLER(BLT) if (S1 < S2) JUMP(ip->target); NEXT();
+        HANDLER(BGE) if (S1 >= S2) JUMP(ip->target); NEXT();
+        HANDLER(JAL) RD = ip->imm; JUMP(ip->target);
+        HANDLER(JALR) {
+            uint32_t dest = (R1 + ip->imm) & ~1u;
+            RD = base + 4 * (ip - first) + 4;
+            JUMP(resolve(dest));
+        }
+        HANDLER(LUI) RD = ip->imm; NEXT();
+        HANDLER(AUIPC) RD = ip->imm; NEXT();
+        HANDLER(ECALL) {
+            regs[10] = syscalls.call(regs[17], regs[10], regs[11], regs[12], clock_cycles + executed);
+            if (syscalls.exited()) {
+                ++executed;
+                ++ip;
+                halted = true;
+                goto fast_done;
+            }
+            NEXT();
+        }
+        ATOMIC(LR_W)
+        ATOMIC(SC_W)
+        ATOMIC(AMOSWAP_W)
+        ATOMIC(AMOADD_W)
+        ATOMIC(AMOXOR_W)
+        ATOMIC(AMOAND_W)
+        ATOMIC(AMOOR_W)
+        ATOMIC(AMOMIN_W)
+        ATOMIC(AMOMAX_W)
+        ATOMIC(AMOMINU_W)
+        ATOMIC(AMOMAXU_W)
+        CSR(CSRRW)
+        CSR(CSRRS)
+        CSR(CSRRC)
+        CSR(CSRRWI)
+        CSR(CSRRSI)
+        CSR(CSRRCI)
+        HANDLER(MRET)
+        HANDLER(WFI) leave_for_step("mret or wfi"); goto fast_done;
+        HANDLER(INVALID) halted = true; goto fast_done;
+#ifndef FAST_COMPUTED_GOTO
+        default: halted = true; goto fast_done;
+        }
+#endif
+    mmio:
+        leave_for_step("an MMIO access"); // At the load or store, which has not run
+        goto fast_done;
+
+#undef R1
+#undef R2
+#undef S1
+#undef S2
+#undef RD
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef LOAD
+#undef STORE
+#undef ATOMIC
+#undef CSR
+
+    fast_done:
+        for (int i = 1; i < 32; i++) reg_file[i] = regs[i];
+        pc = code.base + 4 * (ip - program.data());
+        clock_cycles += executed;
+        return executed;
+    }
+
+    void run_blocks() {
+        uint32_t regs[33];
+        for (int i = 0; i < 32; i++) regs[i] = reg_file[i];
+        regs[0] = regs[32] = 0;
+        block_cache.clear();
+        block_stats = BlockStats();
+        auto start = chrono::steady_clock::now();
+
+        TranslatedBlock* block = find_block(pc);
+        while (block) {
+            bool taken;
+            pc = execute_block(*block, regs, taken, clock_cycles + block_stats.executed);
+            if (halted) {
+                block_stats.executed += (pc - block->start_pc) / 4; // Those before pc ran
+                break;
+            }
+            block_stats.executed += block->length;
+
+            switch (block->exit) {
+                case EXIT_FALL:
+                    block = chain(block->fall, pc);
+                    break;
+                case EXIT_BRANCH:
+                    block = taken ? chain(block->taken, pc) : chain(block->fall, pc);
+                    break;
+                case EXIT_JAL:
+                    block = chain(block->taken, pc);
+                    break;
+                case EXIT_JALR:
+                    // Indirect: reuse the last destination when it matches
+                    if (block->jalr_last && block->jalr_last->start_pc == pc) {
+                        block_stats.chained++;
+                        block = block->jalr_last;
+                    } else {
+                        block = block->jalr_last = find_block(pc);
+                    }
+                    break;
+                case EXIT_ECALL:
+                    block = syscalls.exited() ? nullptr : chain(block->fall, pc);
+                    break;
+                case EXIT_ATOMIC:
+                case EXIT_CSR:
+                    block = chain(block->fall, pc);
+                    break;
+                case EXIT_STOP:
+                    block = nullptr;
+                    break;
+            }
+        }
+
+        stop_at_trap_only();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        for (int i = 1; i < 32; i++) reg_file[i] = regs[i];
+        clock_cycles += block_stats.executed;
+
+        long long entries = block_stats.lookups + block_stats.chained;
+        long long misses = block_stats.lookups - block_stats.hits;
+        out << "Block mode: " << block_stats.executed << " instructions in " << fixed << setprecision(3) << seconds << " s";
+        if (seconds > 0) out << " (" << setprecision(1) << block_stats.executed / seconds / 1e6 << " MIPS)";
+        out << "\n";
+        out << "Blocks translated: " << block_stats.translated << " (" << block_stats.translated_instrs << " instructions)\n";
+        out << "Block entries: " << entries << ", chained: " << block_stats.chained
+             << ", cache lookups: " << block_stats.lookups << ", misses: " << misses << "\n";
+        out << "Cache hit rate: " << setprecision(2)
+             << (entries > 0 ? 100.0 * (entries - misses) / entries : 0.0) << "%" << defaultfloat << "\n";
+    }
+
+    // JIT mode: blocks that run more than threshold times are translated to
+    // x86-64 code (Jit_X86_64.h); colder blocks and instructions the JIT does
+    // not handle (DIV, REM, ECALL, atomics, CSRs) go through the block
+    // interpreter above.
+    void run_jit(int threshold) {
+        JitCompiler jit(code, memory);
+        if (!jit.available()) {
+            out << "JIT not available on this host, using block mode\n";
+            run_blocks();
+            return;
+        }
+        JitContext ctx;
+        for (int i = 1; i < 32; i++) ctx.regs[i] = reg_file[i];
+        block_cache.clear();
+        block_stats = BlockStats();
+        unordered_map<uint32_t, int> heat; // Dispatcher entries per start PC
+        long long interpreted = 0;
+        auto start = chrono::steady_clock::now();
+
+        while (code.at(pc) && !syscalls.exited() && !halted) {
+            const JitBlock* native = jit.lookup(pc);
+            if (!native && ++heat[pc] > threshold) native = jit.compile(pc);
+            if (native) {
+                pc = native->entry(&ctx);
+                if (ctx.mmio) leave_for_step("an MMIO access");
+                continue;
+            }
+            TranslatedBlock* block = find_block(pc);
+            if (!block) break;
+            bool taken;
+            pc = execute_block(*block, ctx.regs, taken, clock_cycles + ctx.executed + interpreted);
+            interpreted += halted ? (pc - block->start_pc) / 4 : block->length;
+        }
+        stop_at_trap_only();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        long long executed = ctx.executed + interpreted;
+        for (int i = 1; i < 32; i++) reg_file[i] = ctx.regs[i];
+        clock_cycles += executed;
+        out << "JIT mode: " << executed << " instructions in " << fixed << setprecision(3) << seconds << " s";
+        if (seconds > 0) out << " (" << setprecision(1) << executed / seconds / 1e6 << " MIPS)";
+        out << defaultfloat << "\n";
+        out << "Native blocks: " << jit.block_count() << " (" << jit.instruction_count() << " instructions, "
+             << jit.code_bytes() << " bytes), chained exits: " << jit.chained_count() << "\n";
+        out << "Native instructions: " << ctx.executed << ", interpreted: " << interpreted << "\n";
+    }
+
+    // Differential check: run the program under the JIT with every block
+    // translated on first use, then again from the same state under the fast
+    // interpreter, and compare registers, data memory and instruction counts
+    bool jit_check() {
+        vector<pair<uint32_t, vector<uint8_t>>> pages;
+        memory.forEachPage([&](uint32_t base, const SparseMemory::Page& page) {
+            pages.emplace_back(base, vector<uint8_t>(page.bytes, page.bytes + SparseMemory::PAGE_SIZE));
+        });
+        array<int32_t, 32> start_regs = reg_file;
+        uint32_t start_pc = pc;
+        int start_cycles = clock_cycles;
+        uint32_t start_brk = syscalls.heapEnd();
+        uint64_t start_input = syscalls.inputOffset();
+        CsrFile start_csrs = csrs;
+
+        run_jit(0);
+        array<int32_t, 32> jit_regs = reg_file;
+        int jit_count = clock_cycles - start_cycles;
+        vector<pair<uint32_t, uint32_t>> jit_words;
+        memory.forEachWord([&](uint32_t addr, uint32_t word) { jit_words.emplace_back(addr, word); });
+
+        memory.clear();
+        for (auto& page : pages) memory.copyIn(page.first, page.second.data(), page.second.size());
+        reg_file = start_regs;
+        pc = start_pc;
+        clock_cycles = start_cycles;
+        syscalls.restore(start_brk, start_input);
+        csrs = start_csrs;
+        run_fast();
+        vector<pair<uint32_t, uint32_t>> fast_words;
+        memory.forEachWord([&](uint32_t addr, uint32_t word) { fast_words.emplace_back(addr, word); });
+
+        bool ok = true;
+        for (int i = 0; i < 32; i++) {
+            if (jit_regs[i] != reg_file[i]) {
+                out << "JIT check: x" << i << " is " << to_hex(jit_regs[i]) << ", expected " << to_hex(reg_file[i]) << "\n";
+                ok = false;
+            }
+        }
+        if (jit_words != fast_words) {
+            out << "JIT check: data memory differs\n";
+            ok = false;
+        }
+        if (jit_count != clock_cycles - start_cycles) {
+            out << "JIT check: " << jit_count << " instructions, expected " << clock_cycles - start_cycles << "\n";
+            ok = false;
+        }
+        out << "JIT check: " << (ok ? "PASS" : "FAIL") << "\n";
+        return ok;
+    }
+
+    // Final cycle count, registers and non-zero data memory
+    void print_final_state() {
+        out << "\nSimulation Ended\n";
+        out << "Total Clock Cycles: " << clock_cycles << "\n";
+        out << "Final Register State:\n";
+        for (int i = 0; i < 32; ++i) {
+            out << "x" << i << ": " << to_hex(reg_file[i]) << endl;
+        }
+        out << "Final Memory State:\n";
+        memory.forEachWord([this](uint32_t addr, uint32_t val) {
+            out << to_hex(addr) << ": " << to_hex(val) << endl;
+        });
+    }
+
+private:
+    // Control signals
+    struct Control {
+        bool mem_read = false;
+        bool mem_write = false;
+        bool reg_write = false;
+        bool branch = false;
+        bool use_imm = false;
+        int output_sel = 0; // 0: ALU, 1: Memory, 2: PC
+        Op alu_op = OP_INVALID;
+    };
+
+    ostream& out;                           // Log of this run
+    uint32_t ir = 0;                        // Instruction Register
+    int32_t rm = 0, ry = 0, rz = 0, mar = 0;// Temporary registers
+    int32_t reg_a_val = 0, reg_b_val = 0;   // ALU operands
+    bool trapped = false;                   // The current instruction trapped into the handler
+    uint32_t dst_reg = 0, rs2 = 0;          // Destination and RS2 indices
+    MicroOp uop;                            // Micro-op being executed
+    Control ctrl;
+    set<uint32_t> visited_pcs;              // Track visited PCs
+    vector<ThreadedInstr> threaded;         // Fast mode program, built on first use
+    unordered_map<uint32_t, unique_ptr<TranslatedBlock>> block_cache;
+    BlockStats block_stats;
+
+    // Convert uint32_t to hex string
+    static string to_hex(uint32_t val) {
+        stringstream ss;
+        ss << "0x" << setfill('0') << setw(8) << hex << uppercase << val;
+        return ss.str();
+    }
+
+    // Validate hex string
+    static bool is_valid_hex(const string& str) {
+        if (str.empty() || str.length() < 3 || str.substr(0, 2) != "0x") return false;
+        for (size_t i = 2; i < str.length(); ++i) {
+            if (!isxdigit(str[i])) return false;
+        }
+        return true;
+    }
+
+    // Fetch stage
+    void fetch() {
+        out << "\n--- Fetch Stage (Cycle " << clock_cycles << ") ---\n";
+        const MicroOp* fetched = code.at(pc);
+        uop = fetched ? *fetched : MicroOp();
+        ir = uop.raw;
+        out << "PC: " << to_hex(pc) << ", IR: " << to_hex(ir) << endl;
+        pc += 4; // Default increment
+    }
+
+    // Decode stage
+    void decode() {
+        out << "\n--- Decode Stage ---\n";
+        if (ir == 0) {
+            out << "No instruction to decode - terminating simulation" << endl;
+            ctrl = Control();
+            reg_a_val = 0;
+            reg_b_val = 0;
+            dst_reg = 0;
+            rm = 0;
+            return;
+        }
+
+        uint32_t rs1 = uop.rs1;
+        rs2 = uop.rs2;
+        out << "rs1 is " << rs1 << "rs2 is " << rs2 << endl;
+
+        // Reset control signals
+        ctrl = Control();
+        dst_reg = 0; // Initialize to 0, set only for instructions with rd
+
+        switch (uop.klass) {
+            case CLASS_ALU:
+                ctrl.reg_write = true;
+                break;
+            case CLASS_LOAD:
+                ctrl.reg_write = true;
+                ctrl.mem_read = true;
+                ctrl.output_sel = 1;
+                break;
+            case CLASS_STORE:
+                ctrl.mem_write = true;
+                break;
+            case CLASS_BRANCH:
+                ctrl.branch = true;
+                break;
+            case CLASS_JUMP:
+                ctrl.reg_write = true;
+                ctrl.branch = true;
+                ctrl.output_sel = 2;
+                break;
+            case CLASS_SYSTEM:
+                ctrl.reg_write = true; // Result in a0
+                break;
+            case CLASS_ATOMIC:
+                ctrl.reg_write = true;
+                ctrl.mem_read = true;
+                ctrl.output_sel = 1;
+                break;
+            case CLASS_CSR:
+                ctrl.reg_write = true;
+                break;
+            case CLASS_PRIV:
+                break;
+            default:
+                out << "Unknown instruction " << to_hex(ir) << " (opcode=0x" << hex << (ir & 0x7F)
+                     << " func3=0x" << ((ir >> 12) & 0x7) << " func7=0x" << ((ir >> 25) & 0x7F) << ")" << dec << endl;
+                take_trap(CAUSE_ILLEGAL_INSTRUCTION, pc - 4, ir);
+                return;
+        }
+        ctrl.use_imm = uop.use_imm;
+        ctrl.alu_op = uop.op;
+        rm = uop.imm;
+        if (ctrl.reg_write) dst_reg = uop.rd;
+
+        // Prepare operands
+        reg_file[0] = 0;
+        reg_a_val = reg_file[rs1];
+        reg_b_val = ctrl.use_imm ? rm : reg_file[rs2];
+
+        // Customized output for clarity
+        out << "Opcode: 0x" << hex << (ir & 0x7F) << dec << " ";
+        if (uop.klass == CLASS_BRANCH) {
+            out << op_name(ctrl.alu_op) << ", RS1: x" << rs1 << " = " << to_hex(reg_a_val)
+                 << ", RS2: x" << rs2 << " = " << to_hex(reg_file[rs2])
+                 << ", Imm: " << to_hex(rm) << endl;
+        } else if (ctrl.alu_op == OP_JAL) {
+            out << "JAL: rd = x" << dst_reg << ", offset = " << to_hex(rm) << endl;
+        } else if (uop.klass == CLASS_STORE) {
+            out << op_name(ctrl.alu_op) << " RS1 : x" << rs1 << " = " << to_hex(reg_file[rs1]) << "  RS2 : x" << rs2
+                 << " = " << to_hex(reg_file[rs2]) << "  imm : " << to_hex(rm) << endl;
+        } else {
+            out << op_name(ctrl.alu_op) << ", RD: x" << dst_reg
+                 << ", RS1: x" << rs1 << " = " << to_hex(reg_a_val)
+                 << ", RS2/Imm: " << (ctrl.use_imm ? to_hex(reg_b_val) : "x" + to_string(rs2) + " = " + to_hex(reg_b_val)) << endl;
+        }
+    }
+
+    // Execute stage
+    void execute() {
+        out << "\n--- Execute Stage ---\n";
+        if (ctrl.alu_op == OP_INVALID) {
+            out << "No operation to execute" << endl;
+            return;
+        }
+
+        int32_t a = reg_a_val, b = reg_b_val;
+        bool taken = false;
+        rz = 0;
+
+        switch (uop.klass) {
+            case CLASS_ALU:
+                rz = alu_result(ctrl.alu_op, a, b, pc - 4);
+                break;
+            case CLASS_LOAD:
+            case CLASS_STORE:
+                rz = a + b;
+                mar = rz;
+                rm = reg_file[rs2]; // For stores
+                break;
+            case CLASS_ATOMIC:
+                rz = a; // Address is rs1 itself
+                mar = rz;
+                rm = reg_file[rs2];
+                break;
+            case CLASS_BRANCH:
+                taken = branch_taken(ctrl.alu_op, a, reg_file[rs2]);
+                if (taken) pc = pc - 4 + rm;
+                break;
+            case CLASS_JUMP:
+                rz = pc; // Save return address (pc + 4)
+                taken = true;
+                pc = (ctrl.alu_op == OP_JALR) ? (a + b) & ~1 : (pc - 4 + rm);
+                out << op_name(ctrl.alu_op) << ": Return address = " << to_hex(rz) << ", New PC= " << to_hex(pc) << endl;
+                break;
+            case CLASS_SYSTEM:
+                out << "ECALL " << reg_file[17] << "(" << to_hex(reg_file[10]) << ", " << to_hex(reg_file[11])
+                     << ", " << to_hex(reg_file[12]) << ")" << endl;
+                rz = syscalls.call(reg_file[17], reg_file[10], reg_file[11], reg_file[12], clock_cycles);
+                break;
+            case CLASS_CSR: {
+                uint32_t old;
+                if (!csrs.execute(uop, a, counters(clock_cycles), old)) {
+                    take_trap(CAUSE_ILLEGAL_INSTRUCTION, pc - 4, ir);
+                    return;
+                }
+                rz = old;
+                out << disassemble(uop) << ": old value " << to_hex(old) << endl;
+                break;
+            }
+            case CLASS_PRIV:
+                if (ctrl.alu_op == OP_EBREAK) {
+                    take_trap(CAUSE_BREAKPOINT, pc - 4, pc - 4);
+                    return;
+                }
+                if (ctrl.alu_op == OP_MRET) {
+                    pc = csrs.mret();
+                    out << "MRET: Return to " << to_hex(pc) << endl;
+                }
+                break; // WFI: interrupts are checked before every instruction anyway
+            default:
+                break;
+        }
+
+        out << "ALU Op: " << op_name(ctrl.alu_op) << ", Result: " << to_hex(rz);
+        if (ctrl.branch) out << ", Branch Taken: " << taken;
+        out << endl;
+    }
+
+    // Memory access stage
+    void memory_access() {
+        out << "\n--- Memory Access Stage ---\n";
+
+        ry = rz; // Start by passing ALU result or return address
+
+        // Handle memory read; byte and halfword loads are sign-extended unless unsigned
+        if (ctrl.mem_read && MmioBus::contains(mar) && !is_atomic(ctrl.alu_op)) {
+            CounterValues raw = counters(clock_cycles);
+            ry = extend_load(ctrl.alu_op, bus.read(mar, load_size(ctrl.alu_op), MmioContext{raw, out}));
+            if (mmio_load_pinned) {
+                ry = pinned_mmio_load;
+                mmio_load_pinned = false;
+            }
+            out << "Read " << op_name(ctrl.alu_op) << " from " << bus.name(mar) << " " << to_hex(mar) << ": " << to_hex(ry) << endl;
+        } else if (ctrl.mem_read) {
+            int size = load_size(ctrl.alu_op);
+            bool watched = watches.flagged(mar, size);
+            uint32_t old_value = watched ? memory.readValue(mar, size) : 0;
+            switch (ctrl.alu_op) {
+                case OP_LB: ry = static_cast<int8_t>(memory.read8(mar)); break;
+                case OP_LH: ry = static_cast<int16_t>(memory.read16(mar)); break;
+                case OP_LBU: ry = memory.read8(mar); break;
+                case OP_LHU: ry = memory.read16(mar); break;
+                case OP_LW: ry = memory.read32(mar); break;
+                default: ry = atomic_execute(memory, reservation, ctrl.alu_op, mar, rm); break;
+            }
+            memory_port_used = true;
+            if (watched) {
+                // An AMO also writes; SC.W writes unless it failed, and does not read
+                bool atomic = is_atomic(ctrl.alu_op);
+                bool write = atomic && ctrl.alu_op != OP_LR_W && !(ctrl.alu_op == OP_SC_W && ry != 0);
+                watch_access(mar, size, ctrl.alu_op != OP_SC_W, write, old_value);
+            }
+            out << "Read " << op_name(ctrl.alu_op) << " from " << to_hex(mar) << ": " << to_hex(ry) << endl;
+        }
+        // Handle memory write
+        else if (ctrl.mem_write && MmioBus::contains(mar)) {
+            CounterValues raw = counters(clock_cycles);
+            out << "Wrote " << op_name(ctrl.alu_op) << " to " << bus.name(mar) << " " << to_hex(mar) << ": " << to_hex(rm) << endl;
+            bus.write(mar, rm, store_size(ctrl.alu_op), MmioContext{raw, out});
+        } else if (ctrl.mem_write) {
+            int size = store_size(ctrl.alu_op);
+            bool watched = watches.flagged(mar, size);
+            uint32_t old_value = watched ? memory.readValue(mar, size) : 0;
+            switch (ctrl.alu_op) {
+                case OP_SB: memory.write8(mar, rm & 0xFF); break;
+                case OP_SH: memory.write16(mar, rm & 0xFFFF); break;
+                default: memory.write32(mar, rm); break;
+            }
+            memory_port_used = true;
+            if (watched) watch_access(mar, size, false, true, old_value);
+            out << "Wrote " << op_name(ctrl.alu_op) << " to " << to_hex(mar) << ": " << to_hex(rm) << endl;
+        }
+
+        // No override needed for JAL/JALR — ry = rz already has return address
+
+        out << "RY: " << to_hex(ry) << endl;
+    }
+
+    // The slow path of an access to a watched page (Watchpoints.h); old_value
+    // is what memory held before it
+    void watch_access(uint32_t addr, int size, bool read, bool write, uint32_t old_value) {
+        uint32_t new_value = memory.readValue(addr, size);
+        if (watches.check(out, retired.pc, clock_cycles, addr, size, read, write, old_value, new_value)) watch_stop = true;
+    }
+
+    // Writeback stage
+    void writeback() {
+        out << "\n--- Writeback Stage ---\n";
+        clock_cycles++;
+
+        if (!ctrl.reg_write || dst_reg == 0) {
+            out << "No register write (RD=x0 or reg_write=0)" << endl;
+            return;
+        }
+
+        else if( dst_reg == 0){
+            out << "No register write (RD=x0)" << endl;
+        }
+    
+        reg_file[dst_reg] = ry;
+        out << "Wrote x" << dst_reg << " = " << to_hex(ry) << endl;
+    }
+
+    // Translate the block starting at start_pc, up to and including its first
+    // control transfer
+    TranslatedBlock* translate_block(uint32_t start_pc) {
+        unique_ptr<TranslatedBlock> block(new TranslatedBlock());
+        block->start_pc = start_pc;
+        uint32_t addr = start_pc;
+        while (true) {
+            const MicroOp* uop = code.at(addr);
+            if (!uop || uop->op == OP_INVALID || uop->klass == CLASS_PRIV) {
+                block->exit = EXIT_STOP;
+                break;
+            }
+            uint8_t rd = uop->write_mask ? uop->rd : 32;
+            if (uop->klass == CLASS_SYSTEM) {
+                block->exit = EXIT_ECALL;
+                block->fall_pc = addr + 4;
+                break;
+            }
+            if (uop->klass == CLASS_CSR) {
+                // Needs the hart's CSRs and the instruction count
+                block->exit = EXIT_CSR;
+                block->exit_rd = rd;
+                block->exit_rs1 = uop->rs1;
+                block->fall_pc = addr + 4;
+                break;
+            }
+            if (uop->klass == CLASS_ATOMIC) {
+                // Needs the hart's reservation, which block handlers do not see
+                block->exit = EXIT_ATOMIC;
+                block->exit_op = uop->op;
+                block->exit_rd = rd;
+                block->exit_rs1 = uop->rs1;
+                block->exit_rs2 = uop->rs2;
+                block->fall_pc = addr + 4;
+                break;
+            }
+            if (uop->klass == CLASS_BRANCH || uop->klass == CLASS_JUMP) {
+                block->exit = uop->klass == CLASS_BRANCH ? EXIT_BRANCH : (uop->op == OP_JAL ? EXIT_JAL : EXIT_JALR);
+                block->exit_op = uop->op;
+                block->exit_rd = rd;
+                block->exit_rs1 = uop->rs1;
+                block->exit_rs2 = uop->rs2;
+                block->exit_imm = uop->imm;
+                block->link = addr + 4;
+                block->taken_pc = addr + uop->imm;
+                block->fall_pc = addr + 4;
+                break;
+            }
+            int32_t imm = uop->op == OP_AUIPC ? static_cast<int32_t>(addr + uop->imm) : uop->imm;
+            block->body.push_back({block_handler(uop->op), rd, uop->rs1, uop->rs2, imm});
+            addr += 4;
+            if (block->body.size() >= MAX_BLOCK_LENGTH) {
+                block->exit = EXIT_FALL;
+                block->fall_pc = addr;
+                break;
+            }
+        }
+        if (block->body.empty() && block->exit == EXIT_STOP) return nullptr;
+
+        block->length = block->body.size() + (block->exit == EXIT_STOP || block->exit == EXIT_FALL ? 0 : 1);
+        block_stats.translated++;
+        block_stats.translated_instrs += block->length;
+        TranslatedBlock* result = block.get();
+        block_cache[start_pc] = move(block);
+        return result;
+    }
+
+    // Blocks end before mret and wfi, so block and JIT mode stop there
+    void stop_at_trap_only() {
+        const MicroOp* uop = code.at(pc);
+        if (!halted && uop && trap_only(*uop)) leave_for_step("mret or wfi");
+    }
+
+    // Cache lookup, translating on a miss
+    TranslatedBlock* find_block(uint32_t start_pc) {
+        block_stats.lookups++;
+        auto it = block_cache.find(start_pc);
+        if (it != block_cache.end()) {
+            block_stats.hits++;
+            return it->second.get();
+        }
+        return translate_block(start_pc);
+    }
+
+    // Follow a chain pointer, linking it on first use
+    TranslatedBlock* chain(TranslatedBlock*& link, uint32_t target_pc) {
+        if (link) {
+            block_stats.chained++;
+            return link;
+        }
+        link = find_block(target_pc);
+        return link;
+    }
+
+    // Run one translated block and return the next PC; taken tells which exit
+    // a branch used. When it sets halted, the instructions before the PC it
+    // returns have run and the rest have not.
+    uint32_t execute_block(TranslatedBlock& block, uint32_t* regs, bool& taken, uint64_t retired) {
+        for (size_t i = 0; i < block.body.size(); i++) {
+            const BlockInstr& in = block.body[i];
+            if (!in.run(in, regs, memory)) {
+                leave_for_step("an MMIO access");
+                return block.start_pc + 4 * i;
+            }
+        }
+        taken = false;
+        switch (block.exit) {
+            case EXIT_FALL:
+                return block.fall_pc;
+            case EXIT_BRANCH:
+                taken = branch_taken(block.exit_op, regs[block.exit_rs1], regs[block.exit_rs2]);
+                return taken ? block.taken_pc : block.fall_pc;
+            case EXIT_JAL:
+                regs[block.exit_rd] = block.link;
+                taken = true;
+                return block.taken_pc;
+            case EXIT_JALR: {
+                uint32_t dest = (regs[block.exit_rs1] + block.exit_imm) & ~1u;
+                regs[block.exit_rd] = block.link;
+                taken = true;
+                return dest;
+            }
+            case EXIT_ECALL:
+                regs[10] = syscalls.call(regs[17], regs[10], regs[11], regs[12], retired + block.body.size());
+                return block.fall_pc;
+            case EXIT_ATOMIC:
+                regs[block.exit_rd] = atomic_execute(memory, reservation, block.exit_op, regs[block.exit_rs1], regs[block.exit_rs2]);
+                return block.fall_pc;
+            case EXIT_CSR: {
+                uint32_t at = block.fall_pc - 4, old;
+                if (!csr_instruction(*code.at(at), at, regs[block.exit_rs1], retired + block.body.size(), old)) {
+                    halted = true;
+                    return at;
+                }
+                regs[block.exit_rd] = old;
+                if (csrs.has_handler()) leave_for_step("mtvec installs a trap handler");
+                return block.fall_pc;
+            }
+            default:
+                return block.start_pc + 4 * block.body.size();
+        }
+    }
+};
+
+#endif
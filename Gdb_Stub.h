@@ -0,0 +1,513 @@
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "Predecoder.h"
+#include "Sparse_Memory.h"
+#include "Watchpoints.h"
+
+using namespace std;
+
+// Breakpoint PCs as one bit per instruction slot of the text. A resumed
+// simulator tests the bit of each next PC and pays nothing else for
+// breakpoints, however many are set.
+class BreakpointMap {
+public:
+    void cover(const PredecodedText& code) {
+        base = code.base;
+        slots = code.ops.size();
+        bits.assign((slots + 63) / 64, 0);
+    }
+
+    bool hit(uint32_t pc) const {
+        uint32_t slot = (pc - base) >> 2;
+        return slot < slots && (bits[slot >> 6] >> (slot & 63) & 1);
+    }
+
+    // false for a PC outside the text, which no instruction can reach
+    bool set(uint32_t pc, bool on) {
+        uint32_t slot = (pc - base) >> 2;
+        if ((pc & 3) || slot >= slots) return false;
+        if (on) bits[slot >> 6] |= 1ull << (slot & 63);
+        else bits[slot >> 6] &= ~(1ull << (slot & 63));
+        return true;
+    }
+
+private:
+    uint32_t base = 0;
+    uint32_t slots = 0;
+    vector<uint64_t> bits;
+};
+
+// Why a simulator's debug_resume() returned
+enum DebugStop {
+    DEBUG_TRAP,       // Stepped, or the next instruction is at a breakpoint
+    DEBUG_INTERRUPT,  // The debugger asked to stop (Ctrl-C)
+    DEBUG_FAULT,      // Stopped at a trap without a handler
+    DEBUG_EXITED,     // The program ended
+    DEBUG_HISTORY_START, // Reverse execution reached the oldest checkpoint (Checkpoint_Log.h)
+    DEBUG_HISTORY_END,   // The program ended, but can still run backwards
+    DEBUG_WATCH,      // The last instruction hit a watchpoint that stops (Watchpoints.h)
+};
+
+// The memory a debugger sees: text where an instruction is loaded, data
+// memory elsewhere. Device registers are not read, so reading memory has no
+// side effects.
+inline uint8_t debug_read(const PredecodedText& code, const SparseMemory& memory, uint32_t addr) {
+    if (const MicroOp* op = code.at(addr & ~3u)) return op->raw >> (8 * (addr & 3));
+    return memory.read8(addr);
+}
+
+// Writing text predecodes the instruction again
+inline void debug_write(PredecodedText& code, SparseMemory& memory, uint32_t addr, uint8_t value) {
+    if (const MicroOp* op = code.at(addr & ~3u)) {
+        uint32_t shift = 8 * (addr & 3);
+        code.add(addr & ~3u, (op->raw & ~(0xFFu << shift)) | (uint32_t(value) << shift));
+        return;
+    }
+    memory.write8(addr, value);
+}
+
+// GDB remote serial protocol server for one debugger connection, over TCP
+// on 127.0.0.1 or a UNIX socket. The simulator provides pc, reg_file,
+// syscalls, watches and debug_resume(single_step, breakpoints,
+// stop_requested), and must be stopped between instructions whenever the
+// stub has control. Supports g/G/p/P (x0-x31, pc), m/M/X, s, c, Z0/Z1 and
+// z0/z1 (both kinds go in one BreakpointMap), Z2-Z4 and z2-z4 (write, read
+// and access watchpoints in the simulator's WatchList), Ctrl-C, detach and
+// kill. bs/bc (reverse-step, reverse-continue) and monitor commands go to
+// the reverse and monitor hooks, when the simulator sets them.
+template <typename Simulator>
+class GdbStub {
+public:
+    GdbStub(Simulator& sim, PredecodedText& code, SparseMemory& memory, ostream& log)
+        : sim(sim), code(code), memory(memory), log(log) {
+        breakpoints.cover(code);
+    }
+
+    ~GdbStub() {
+        if (client >= 0) close(client);
+        if (server >= 0) close(server);
+        if (!unix_path.empty()) unlink(unix_path.c_str());
+    }
+
+    GdbStub(const GdbStub&) = delete;
+    GdbStub& operator=(const GdbStub&) = delete;
+
+    // endpoint is a port number or unix:PATH
+    bool listen(const string& endpoint) {
+        if (endpoint.compare(0, 5, "unix:") == 0) {
+            unix_path = endpoint.substr(5);
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (unix_path.empty() || unix_path.size() >= sizeof(addr.sun_path)) {
+                log << "Error: Bad UNIX socket path " << unix_path << "\n";
+                unix_path.clear();
+                return false;
+            }
+            strcpy(addr.sun_path, unix_path.c_str());
+            unlink(unix_path.c_str());
+            server = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                log << "Error: Cannot bind " << unix_path << ": " << strerror(errno) << "\n";
+                unix_path.clear();
+                return false;
+            }
+        } else {
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            try {
+                addr.sin_port = htons(stoi(endpoint));
+            } catch (const exception&) {
+                log << "Error: Bad GDB port " << endpoint << "\n";
+                return false;
+            }
+            server = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            if (server >= 0) setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                log << "Error: Cannot bind 127.0.0.1:" << endpoint << ": " << strerror(errno) << "\n";
+                return false;
+            }
+        }
+        if (::listen(server, 1) < 0) {
+            log << "Error: Cannot listen on " << endpoint << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        log << "GDB: Waiting for a connection on " << (unix_path.empty() ? "127.0.0.1:" : "") << endpoint
+            << " (target remote " << (unix_path.empty() ? ":" + endpoint : unix_path) << ")\n";
+        return true;
+    }
+
+    // Accept the debugger and serve it until the program exits, the
+    // debugger kills or detaches from it, or the connection drops
+    void serve() {
+        client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            log << "Error: GDB accept failed: " << strerror(errno) << "\n";
+            return;
+        }
+        int one = 1;
+        if (unix_path.empty()) setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        log << "GDB: Connected\n";
+
+        string packet;
+        while (read_packet(packet)) {
+            char command = packet.empty() ? 0 : packet[0];
+            if (command == 'c' || command == 's') {
+                if (packet.size() > 1) sim.pc = strtoul(packet.c_str() + 1, nullptr, 16);
+                if (!resume(command == 's')) return;
+            } else if ((packet == "bs" || packet == "bc") && reverse) {
+                report(reverse(packet == "bs", breakpoints));
+            } else if (command == 'D') {
+                send_packet("OK");
+                log << "GDB: Detached, running on\n";
+                detach = true;
+                return;
+            } else if (command == 'k') {
+                log << "GDB: Killed\n";
+                return;
+            } else {
+                string answer;
+                try {
+                    answer = reply(packet);
+                } catch (const exception&) {
+                    answer = "E01"; // Malformed numbers
+                }
+                send_packet(answer);
+                if (packet == "QStartNoAckMode") no_ack = true;
+            }
+        }
+        log << "GDB: Connection closed, running on\n";
+        detach = true;
+    }
+
+    // The debugger left the program running rather than killing it
+    bool detached() const { return detach; }
+
+    function<DebugStop(bool single_step, const BreakpointMap&)> reverse;
+    function<string(const string& command)> monitor;  // Text for the debugger's console
+
+private:
+    Simulator& sim;
+    PredecodedText& code;
+    SparseMemory& memory;
+    ostream& log;
+    BreakpointMap breakpoints;
+    set<uint32_t> software, hardware;  // Z0 and Z1 addresses; a PC's bit is set while either has it
+    int server = -1;
+    int client = -1;
+    string unix_path;                  // Removed again on exit
+    bool no_ack = false;               // QStartNoAckMode
+    bool detach = false;
+    string input;                      // Received, not yet parsed
+    size_t input_pos = 0;
+
+    static constexpr size_t PACKET_SIZE = 4096;
+
+    // Run the simulator and report why it stopped; false once it exited
+    bool resume(bool single_step) {
+        return report(sim.debug_resume(single_step, breakpoints, [this]() { return interrupt_requested(); }));
+    }
+
+    bool report(DebugStop stop) {
+        switch (stop) {
+            case DEBUG_TRAP: send_packet("S05"); return true;
+            case DEBUG_INTERRUPT: send_packet("S02"); return true;
+            case DEBUG_FAULT: send_packet("S04"); return true;
+            case DEBUG_HISTORY_START: send_packet("T05replaylog:begin;"); return true;
+            case DEBUG_HISTORY_END: send_packet("T05replaylog:end;"); return true;
+            case DEBUG_WATCH: {
+                const WatchHit& hit = sim.watches.lastHit();
+                const char* kind = hit.kinds == WATCH_READ ? "rwatch" : hit.kinds & WATCH_READ ? "awatch" : "watch";
+                send_packet("T05" + string(kind) + ":" + hex_string(hit.addr) + ";");
+                return true;
+            }
+            default: break;
+        }
+        int exit_code = sim.syscalls.exited() ? sim.syscalls.exitCode() : 0;
+        send_packet("W" + hex_byte(exit_code & 0xFF));
+        log << "GDB: Program exited with code " << exit_code << "\n";
+        return false;
+    }
+
+    // Ctrl-C (0x03) arrived while running; polled by debug_resume()
+    bool interrupt_requested() {
+        while (input_pos < input.size()) {
+            if (input[input_pos++] == 0x03) return true;
+        }
+        pollfd p = {client, POLLIN, 0};
+        if (poll(&p, 1, 0) <= 0) return false;
+        int c = get_char();
+        return c == 0x03 || c < 0;
+    }
+
+    // Reply to a packet that does not resume the program
+    string reply(const string& packet) {
+        char command = packet.empty() ? 0 : packet[0];
+        string args = packet.substr(packet.empty() ? 0 : 1);
+        switch (command) {
+            case '?':
+                return "S05";
+            case 'g': {
+                string regs;
+                for (int n = 0; n < 33; n++) regs += hex_word(read_register(n));
+                return regs;
+            }
+            case 'G':
+                if (args.size() < 33 * 8) return "E01";
+                for (int n = 0; n < 33; n++) write_register(n, parse_word(args.substr(n * 8, 8)));
+                return "OK";
+            case 'p': {
+                int n = stoi(args, nullptr, 16);
+                return n >= 0 && n <= 32 ? hex_word(read_register(n)) : "E01";
+            }
+            case 'P': {
+                size_t eq = args.find('=');
+                if (eq == string::npos) return "E01";
+                int n = stoi(args.substr(0, eq), nullptr, 16);
+                if (n < 0 || n > 32) return "E01";
+                write_register(n, parse_word(args.substr(eq + 1)));
+                return "OK";
+            }
+            case 'm': {
+                uint32_t addr, length;
+                if (!parse_range(args, addr, length)) return "E01";
+                string bytes;
+                for (uint32_t i = 0; i < min<uint32_t>(length, PACKET_SIZE / 2); i++) {
+                    bytes += hex_byte(debug_read(code, memory, addr + i));
+                }
+                return bytes;
+            }
+            case 'M': case 'X': {
+                size_t colon = args.find(':');
+                uint32_t addr, length;
+                if (colon == string::npos || !parse_range(args.substr(0, colon), addr, length)) return "E01";
+                string data = args.substr(colon + 1);
+                if (command == 'X') {
+                    string bytes;
+                    for (size_t i = 0; i < data.size(); i++) {
+                        bytes += data[i] == '}' && i + 1 < data.size() ? data[++i] ^ 0x20 : data[i];
+                    }
+                    data = bytes;
+                } else {
+                    string bytes;
+                    for (size_t i = 0; i + 1 < data.size(); i += 2) bytes += static_cast<char>(stoul(data.substr(i, 2), nullptr, 16));
+                    data = bytes;
+                }
+                if (data.size() < length) return "E01";
+                for (uint32_t i = 0; i < length; i++) debug_write(code, memory, addr + i, data[i]);
+                return "OK";
+            }
+            case 'Z': case 'z':
+                return breakpoint(packet);
+            case 'H': case 'T':
+                return "OK";
+            case 'q':
+                return query(packet);
+            case 'Q':
+                return packet == "QStartNoAckMode" ? "OK" : "";
+            default:
+                return "";
+        }
+    }
+
+    string breakpoint(const string& packet) {
+        bool insert = packet[0] == 'Z';
+        char type = packet.size() > 1 ? packet[1] : 0;
+        if (type < '0' || type > '4') return "";
+        uint32_t addr, kind;
+        if (packet.size() < 3 || !parse_range(packet.substr(3), addr, kind)) return "E01";
+        if (type >= '2') {
+            // kind is the length of the watched range
+            static const uint8_t kinds[3] = {WATCH_WRITE, WATCH_READ, WATCH_READ | WATCH_WRITE};
+            Watchpoint watch;
+            watch.addr = addr;
+            watch.size = kind;
+            watch.kinds = kinds[type - '2'];
+            watch.stop = watch.debugger = true;
+            if (kind == 0) return "E01";
+            if (!insert) return sim.watches.remove(addr, kind, watch.kinds) ? "OK" : "E01";
+            sim.watches.add(watch);
+            return "OK";
+        }
+        set<uint32_t>& kinds = type == '0' ? software : hardware;
+        if (insert) kinds.insert(addr);
+        else kinds.erase(addr);
+        bool on = software.count(addr) || hardware.count(addr);
+        if (!breakpoints.set(addr, on)) {
+            kinds.erase(addr);
+            return "E01";
+        }
+        return "OK";
+    }
+
+    string query(const string& packet) {
+        if (packet.compare(0, 10, "qSupported") == 0) {
+            return "PacketSize=" + hex_string(PACKET_SIZE) + ";qXfer:features:read+;QStartNoAckMode+" +
+                   (reverse ? ";ReverseStep+;ReverseContinue+" : "");
+        }
+        if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0) {
+            uint32_t offset, length;
+            if (!parse_range(packet.substr(31), offset, length)) return "E01";
+            string xml = target_xml();
+            if (offset >= xml.size()) return "l";
+            string part = xml.substr(offset, length);
+            return (offset + part.size() < xml.size() ? "m" : "l") + part;
+        }
+        if (packet == "qC") return "QC1";
+        if (packet == "qfThreadInfo") return "m1";
+        if (packet == "qsThreadInfo") return "l";
+        if (packet == "qAttached") return "1";
+        if (packet.compare(0, 7, "qSymbol") == 0) return "OK";
+        if (packet.compare(0, 6, "qRcmd,") == 0 && monitor) {
+            string command;
+            for (size_t i = 6; i + 1 < packet.size(); i += 2) command += static_cast<char>(stoul(packet.substr(i, 2), nullptr, 16));
+            string text = monitor(command);
+            if (!text.empty()) {
+                string hex;
+                for (char ch : text) hex += hex_byte(static_cast<uint8_t>(ch));
+                send_packet("O" + hex);
+            }
+            return "OK";
+        }
+        return "";
+    }
+
+    // 33 registers in GDB's RV32 numbering: x0-x31, then pc
+    uint32_t read_register(int n) const { return n == 32 ? sim.pc : sim.reg_file[n]; }
+
+    void write_register(int n, uint32_t value) {
+        if (n == 32) sim.pc = value;
+        else if (n != 0) sim.reg_file[n] = value;
+    }
+
+    static string target_xml() {
+        static const char* names[32] = {"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "fp", "s1", "a0",
+                                        "a1", "a2", "a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5",
+                                        "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+        string xml = "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\"><target version=\"1.0\">"
+                     "<architecture>riscv:rv32</architecture><feature name=\"org.gnu.gdb.riscv.cpu\">";
+        for (int n = 0; n < 32; n++) {
+            string type = n == 1 ? "code_ptr" : n == 2 || n == 8 ? "data_ptr" : "int";
+            xml += "<reg name=\"" + string(names[n]) + "\" bitsize=\"32\" type=\"" + type + "\" regnum=\"" + to_string(n) + "\"/>";
+        }
+        xml += "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"32\"/></feature></target>";
+        return xml;
+    }
+
+    // Packets: $data#checksum, acknowledged with + unless no_ack
+    bool read_packet(string& packet) {
+        while (true) {
+            int c = get_char();
+            if (c < 0) return false;
+            if (c != '$') continue; // Acks, and Ctrl-C while stopped
+            packet.clear();
+            while ((c = get_char()) >= 0 && c != '#') packet += static_cast<char>(c);
+            int high = get_char(), low = get_char();
+            if (c < 0 || high < 0 || low < 0) return false;
+            uint8_t sum = 0;
+            for (char ch : packet) sum += static_cast<uint8_t>(ch);
+            bool ok = hex_digit(high) * 16 + hex_digit(low) == sum;
+            if (!no_ack) send_raw(ok ? "+" : "-");
+            if (ok) return true;
+        }
+    }
+
+    void send_packet(const string& data) {
+        uint8_t sum = 0;
+        for (char ch : data) sum += static_cast<uint8_t>(ch);
+        string frame = "$" + data + "#" + hex_byte(sum);
+        for (int tries = 0; tries < 3; tries++) {
+            send_raw(frame);
+            if (no_ack) return;
+            int c = get_char();
+            if (c != '-') return;
+        }
+    }
+
+    void send_raw(const string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += n;
+        }
+    }
+
+    int get_char() {
+        if (input_pos == input.size()) {
+            char buffer[PACKET_SIZE];
+            ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0) return -1;
+            input.assign(buffer, n);
+            input_pos = 0;
+        }
+        return static_cast<uint8_t>(input[input_pos++]);
+    }
+
+    static int hex_digit(int c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static string hex_byte(uint32_t value) {
+        char text[3];
+        snprintf(text, sizeof(text), "%02x", value & 0xFF);
+        return text;
+    }
+
+    static string hex_string(uint32_t value) {
+        char text[9];
+        snprintf(text, sizeof(text), "%x", value);
+        return text;
+    }
+
+    // Registers go over the wire in target (little-endian) byte order
+    static string hex_word(uint32_t value) {
+        string text;
+        for (int i = 0; i < 4; i++) text += hex_byte(value >> (8 * i));
+        return text;
+    }
+
+    static uint32_t parse_word(const string& text) {
+        uint32_t value = 0;
+        for (size_t i = 0; i + 1 < text.size() && i < 8; i += 2) {
+            value |= static_cast<uint32_t>(stoul(text.substr(i, 2), nullptr, 16)) << (4 * i);
+        }
+        return value;
+    }
+
+    // "addr,length" in hex
+    static bool parse_range(const string& text, uint32_t& addr, uint32_t& length) {
+        size_t comma = text.find(',');
+        if (comma == string::npos) return false;
+        try {
+            addr = stoul(text.substr(0, comma), nullptr, 16);
+            length = stoul(text.substr(comma + 1), nullptr, 16);
+        } catch (const exception&) {
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -259,6 +259,57 @@ int Label_Offset_Parameter(unordered_map<string, long long> labels_PC, const str
 }
 
 
+// Atomic mnemonic without its .aq/.rl/.aqrl ordering suffix
+string Atomic_Base_Name(const string &mnemonic)
+{
+    for (const string suffix : {".aqrl", ".aq", ".rl"})
+    {
+        if (mnemonic.length() > suffix.length() &&
+            mnemonic.compare(mnemonic.length() - suffix.length(), suffix.length(), suffix) == 0)
+            return mnemonic.substr(0, mnemonic.length() - suffix.length());
+    }
+    return mnemonic;
+}
+
+// CSR operand: a name from csr_map or a 12-bit CSR number
+int Csr_Parameter(const string &name, Error *output_error)
+{
+    auto csr = csr_map.find(name);
+    if (csr != csr_map.end())
+        return csr->second;
+    if (name.empty() || !isdigit(name[0]))
+    {
+        (*output_error).AlterError(ERROR_SYNTAX, "Unknown CSR '" + name + "'");
+        (*output_error).PrintError();
+        exit(ERROR_SYNTAX);
+    }
+    return Calculate_Immediate(name, 12, false, output_error);
+}
+
+// Zicsr pseudo-instructions as the csrr* instruction they stand for
+string Expand_Csr_Pseudo(const string &inst)
+{
+    static const unordered_map<string, string> counters = {
+        {"rdcycle", "cycle"}, {"rdcycleh", "cycleh"},
+        {"rdtime", "time"}, {"rdtimeh", "timeh"},
+        {"rdinstret", "instret"}, {"rdinstreth", "instreth"}};
+    static const unordered_map<string, string> writes = {
+        {"csrw", "csrrw"}, {"csrs", "csrrs"}, {"csrc", "csrrc"},
+        {"csrwi", "csrrwi"}, {"csrsi", "csrrsi"}, {"csrci", "csrrci"}};
+    stringstream ss(inst);
+    string name, operands;
+    ss >> name;
+    getline(ss, operands);
+    operands = trim(operands);
+    if (counters.count(name))
+        return "csrrs " + operands + ", " + counters.at(name) + ", x0"; // rdcycle rd
+    if (name == "csrr")
+        return "csrrs " + operands + ", x0"; // csrr rd, csr
+    if (writes.count(name))
+        return writes.at(name) + " x0, " + operands; // csrw csr, rs1 and csrwi csr, uimm
+    return inst;
+}
+
 // Function to check if it a valid instruction
 const RISC_V_Instructions InitializeInstruction(const unordered_map<string, long long> labels_PC,  string &inst, Error *output_error, int program_counter )
 {
@@ -270,6 +321,7 @@ const RISC_V_Instructions InitializeInstruction(const unordered_map<string, long
         inst = inst.substr(0, comment_pos); // Keep only the part before '#'
     }
     inst = trim(inst); 
+    inst = Expand_Csr_Pseudo(inst);
 
    
    
@@ -522,6 +574,23 @@ const RISC_V_Instructions InitializeInstruction(const unordered_map<string, long
             }
         }
     }
+    else if (SYS_opcode_map.find(temp_word) != SYS_opcode_map.end())
+    {
+        // ecall, ebreak, mret, wfi: I-Type encoding with funct12 in the immediate and every other field zero
+        string name = temp_word;
+        Current_Instruction.OpCode = SYS_opcode_map[name];
+        Current_Instruction.func3 = func3_map[name];
+        Current_Instruction.type = 2;
+        Current_Instruction.rd = 0;
+        Current_Instruction.rs1 = 0;
+        Current_Instruction.imm = SYS_funct12_map[name];
+        if (ss >> temp_word)
+        {
+            (*output_error).AlterError(ERROR_SYNTAX, name + " takes no operands");
+            (*output_error).PrintError();
+            exit(ERROR_SYNTAX);
+        }
+    }
     else if (I_new_opcode.find(temp_word) != I_new_opcode.end()) { // Assuming I_new_opcode is for shift-immediate
         Current_Instruction.func3 = func3_map[temp_word];
         Current_Instruction.type = 7; // New type for shift-immediate
@@ -553,6 +622,89 @@ const RISC_V_Instructions InitializeInstruction(const unordered_map<string, long
             }
             }
     }
+    // Zicsr: csrrw/csrrs/csrrc rd, csr, rs1 and csrrwi/csrrsi/csrrci rd, csr, uimm
+    else if (CSR_opcode_map.find(temp_word) != CSR_opcode_map.end())
+    {
+        string name = temp_word;
+        bool immediate = name.back() == 'i';
+        Current_Instruction.func3 = func3_map[name];
+        Current_Instruction.type = 2;
+        Current_Instruction.OpCode = CSR_opcode_map[name];
+        while (!ss.eof())
+        {
+            values++;
+            getline(ss, temp_word, ',');
+            temp_word = trim(temp_word);
+            if (values == 1)
+                Current_Instruction.rd = Normal_XNum_Parameter(temp_word, output_error);
+            else if (values == 2)
+                Current_Instruction.imm = Csr_Parameter(temp_word, output_error);
+            else if (values == 3 && immediate)
+                Current_Instruction.rs1 = Calculate_Immediate(temp_word, 5, false, output_error);
+            else if (values == 3)
+                Current_Instruction.rs1 = Normal_XNum_Parameter(temp_word, output_error);
+            else
+            {
+                (*output_error).AlterError(ERROR_SYNTAX, "Typed Syntax is invalid");
+                (*output_error).PrintError();
+                exit(ERROR_SYNTAX);
+            }
+        }
+        if (values != 3)
+        {
+            (*output_error).AlterError(ERROR_SYNTAX, name + " expects 3 operands");
+            (*output_error).PrintError();
+            exit(ERROR_SYNTAX);
+        }
+    }
+    // Atomics: lr.w rd, (rs1) and sc.w/amo*.w rd, rs2, (rs1), with an optional .aq, .rl or .aqrl suffix
+    else if (A_opcode_map.find(Atomic_Base_Name(temp_word)) != A_opcode_map.end())
+    {
+        string name = Atomic_Base_Name(temp_word);
+        string ordering = temp_word.substr(name.length());
+        Current_Instruction.func3 = func3_map[name];
+        Current_Instruction.func7 = func7_map[name].substr(0, 5) + (ordering.find("aq") != string::npos ? "1" : "0") +
+                                    (ordering.find("rl") != string::npos ? "1" : "0");
+        Current_Instruction.type = 1;
+        Current_Instruction.OpCode = A_opcode_map[name];
+        Current_Instruction.rs2 = 0;
+        int operands = name == "lr.w" ? 2 : 3;
+        while (!ss.eof())
+        {
+            values++;
+            getline(ss, temp_word, ',');
+            temp_word = trim(temp_word);
+            if (values == 1)
+                Current_Instruction.rd = Normal_XNum_Parameter(temp_word, output_error);
+            else if (values == 2 && operands == 3)
+                Current_Instruction.rs2 = Normal_XNum_Parameter(temp_word, output_error);
+            else if (values == operands)
+            {
+                // Address register in brackets; only a zero offset is encodable
+                if (temp_word.substr(0, 2) == "0(")
+                    temp_word = temp_word.substr(1);
+                if (temp_word.size() < 3 || temp_word[0] != '(' || temp_word.back() != ')')
+                {
+                    (*output_error).AlterError(ERROR_SYNTAX, "Atomic address must be (xN)");
+                    (*output_error).PrintError();
+                    exit(ERROR_SYNTAX);
+                }
+                Current_Instruction.rs1 = Normal_XNum_Parameter(trim(temp_word.substr(1, temp_word.length() - 2)), output_error);
+            }
+            else
+            {
+                (*output_error).AlterError(ERROR_SYNTAX, "Typed Syntax is invalid");
+                (*output_error).PrintError();
+                exit(ERROR_SYNTAX);
+            }
+        }
+        if (values != operands)
+        {
+            (*output_error).AlterError(ERROR_SYNTAX, name + " expects " + to_string(operands) + " operands");
+            (*output_error).PrintError();
+            exit(ERROR_SYNTAX);
+        }
+    }
     // Not an instruction
     else
     {
@@ -0,0 +1,409 @@
+#ifndef JIT_X86_64_H
+#define JIT_X86_64_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "Predecoder.h"
+#include "Sparse_Memory.h"
+#include "Mmio_Bus.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// Guest state shared with translated code
+struct JitContext {
+    uint32_t regs[33] = {0}; // x0-x31; regs[32] is a sink for writes to x0
+    uint32_t mmio = 0;       // Set when translated code stopped at a load or store in the MMIO window
+    uint64_t executed = 0;   // Guest instructions run by translated code
+};
+
+// Translated block: called with the context, returns the next guest PC
+typedef uint32_t (*JitBlockFn)(JitContext*);
+
+struct JitBlock {
+    JitBlockFn entry = nullptr;
+    uint8_t* body = nullptr; // Past the prologue; chained exits jump here
+    uint32_t start_pc = 0;
+    uint32_t length = 0;     // Guest instructions translated
+    size_t size = 0;         // Host bytes
+};
+
+// Memory layer used by translated loads and stores; the compiler passes
+// its memory as the first argument
+uint32_t jit_lb(SparseMemory* m, uint32_t addr) { return static_cast<int8_t>(m->read8(addr)); }
+uint32_t jit_lh(SparseMemory* m, uint32_t addr) { return static_cast<int16_t>(m->read16(addr)); }
+uint32_t jit_lw(SparseMemory* m, uint32_t addr) { return m->read32(addr); }
+uint32_t jit_lbu(SparseMemory* m, uint32_t addr) { return m->read8(addr); }
+uint32_t jit_lhu(SparseMemory* m, uint32_t addr) { return m->read16(addr); }
+void jit_sb(SparseMemory* m, uint32_t addr, uint32_t value) { m->write8(addr, value & 0xFF); }
+void jit_sh(SparseMemory* m, uint32_t addr, uint32_t value) { m->write16(addr, value & 0xFFFF); }
+void jit_sw(SparseMemory* m, uint32_t addr, uint32_t value) { m->write32(addr, value); }
+
+// Translates RV32 basic blocks of a predecoded text image into x86-64 code.
+// rbx holds the JitContext for the whole block, guest registers live in
+// ctx->regs, and loads/stores call the jit_* helpers above. Exits to blocks
+// that are already translated become direct jumps (earlier exits are patched
+// when their target is translated); other exits return the next PC to the
+// dispatcher. Blocks stop before the first unsupported instruction.
+// A load or store whose address is in the MMIO window does not run: the
+// block returns its PC with ctx->mmio set, for the caller to stop there.
+// The code buffer is never writable and executable at once: translated code
+// is read/execute, and compile() makes it read/write only while it emits a
+// block and patches earlier exits, then back to read/execute.
+class JitCompiler {
+public:
+    JitCompiler(const PredecodedText& text, SparseMemory& memory, size_t capacity = 16u << 20)
+        : text(text), memory(memory), capacity(capacity) {
+#ifdef JIT_X86_64_SUPPORTED
+        void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) buffer = static_cast<uint8_t*>(p);
+#endif
+    }
+
+    ~JitCompiler() { release(); }
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    // False when the host is not x86-64 Linux or the code buffer is unavailable
+    bool available() const { return buffer != nullptr; }
+
+    const JitBlock* lookup(uint32_t pc) const {
+        auto it = blocks.find(pc);
+        return it == blocks.end() ? nullptr : it->second.get();
+    }
+
+    // Translate the block at pc; nullptr when its first instruction is not supported
+    const JitBlock* compile(uint32_t pc) {
+        if (!buffer) return nullptr;
+        if (const JitBlock* existing = lookup(pc)) return existing;
+        const MicroOp* first = text.at(pc);
+        if (!first || !supported(first->op)) return nullptr;
+        if (capacity - used < MAX_BLOCK_BYTES) return nullptr; // Buffer full
+        if (!protect(false)) return nullptr;
+
+        unique_ptr<JitBlock> block(new JitBlock());
+        block->start_pc = pc;
+        start = buffer + used;
+        out = start;
+
+        emit8(0x53);               // push rbx
+        emit8(0x48); emit8(0x89); emit8(0xFB); // mov rbx, rdi
+        block->body = out;
+        uint8_t* count_site = out;
+        emit_add_executed(0);      // Patched once the length is known
+
+        uint32_t addr = pc;
+        uint32_t length = 0;
+        mmio_stops.clear();
+        while (true) {
+            const MicroOp* uop = text.at(addr);
+            if (!uop || !supported(uop->op) || length >= MAX_BLOCK_LENGTH) {
+                emit_exit(addr); // Leave to the dispatcher or the next block
+                break;
+            }
+            length++;
+            if (uop->klass == CLASS_BRANCH || uop->klass == CLASS_JUMP) {
+                emit_control(*uop, addr);
+                break;
+            }
+            emit_instruction(*uop, addr, length - 1);
+            addr += 4;
+        }
+
+        uint8_t* end = out;
+        out = count_site;
+        emit_add_executed(length);
+        out = end;
+        for (const auto& stop : mmio_stops) put32(stop.first, length - stop.second);
+
+        block->entry = reinterpret_cast<JitBlockFn>(start);
+        block->length = length;
+        block->size = out - start;
+        used += block->size;
+        translated_instrs += length;
+
+        // Earlier exits waiting for this PC now jump straight here
+        auto waiting = pending.find(pc);
+        if (waiting != pending.end()) {
+            for (uint8_t* site : waiting->second) patch_jump(site, block->body);
+            chained_exits += waiting->second.size();
+            pending.erase(waiting);
+        }
+
+        const JitBlock* result = block.get();
+        blocks[pc] = move(block);
+        if (!protect(true)) {
+            release(); // The blocks cannot run; the caller stays on the interpreter
+            return nullptr;
+        }
+        return result;
+    }
+
+    size_t block_count() const { return blocks.size(); }
+    size_t code_bytes() const { return used; }
+    size_t instruction_count() const { return translated_instrs; }
+    size_t chained_count() const { return chained_exits; }
+
+    // ECALL and every op after it (atomics, CSRs) stay on the block interpreter
+    static bool supported(Op op) {
+        return op != OP_INVALID && op != OP_DIV && op != OP_REM && op < OP_ECALL;
+    }
+
+private:
+    static const size_t MAX_BLOCK_LENGTH = 64;
+    static const size_t MAX_BLOCK_BYTES = 128 * MAX_BLOCK_LENGTH + 256;
+
+    // Host register numbers
+    static const int EAX = 0, ECX = 1, EDX = 2, ESI = 6, EDI = 7;
+
+    const PredecodedText& text;
+    SparseMemory& memory;
+    uint8_t* buffer = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint8_t* start = nullptr;
+    uint8_t* out = nullptr;
+    unordered_map<uint32_t, unique_ptr<JitBlock>> blocks;
+    unordered_map<uint32_t, vector<uint8_t*>> pending; // Exit sites by target PC
+    size_t translated_instrs = 0;
+    size_t chained_exits = 0;
+    vector<pair<uint8_t*, uint32_t>> mmio_stops; // This block's uncount immediates, with the instructions before each
+
+    void emit8(uint8_t b) { *out++ = b; }
+
+    void emit32(uint32_t v) {
+        for (int i = 0; i < 4; i++) emit8((v >> (8 * i)) & 0xFF);
+    }
+
+    void emit64(uint64_t v) {
+        for (int i = 0; i < 8; i++) emit8((v >> (8 * i)) & 0xFF);
+    }
+
+    static void put32(uint8_t* at, uint32_t v) {
+        for (int i = 0; i < 4; i++) at[i] = (v >> (8 * i)) & 0xFF;
+    }
+
+    // Make the pages holding translated code read/execute or read/write;
+    // the untouched rest of the buffer stays read/write
+    bool protect(bool executable) {
+#ifdef JIT_X86_64_SUPPORTED
+        return used == 0 || mprotect(buffer, used, PROT_READ | (executable ? PROT_EXEC : PROT_WRITE)) == 0;
+#else
+        return !executable;
+#endif
+    }
+
+    void release() {
+#ifdef JIT_X86_64_SUPPORTED
+        if (buffer) munmap(buffer, capacity);
+#endif
+        buffer = nullptr;
+        blocks.clear();
+        pending.clear();
+    }
+
+    static void patch_jump(uint8_t* site, uint8_t* target) {
+        put32(site + 1, static_cast<uint32_t>(target - (site + 5)));
+    }
+
+    static uint8_t slot(uint32_t rd) { return rd; }
+
+    // add qword [rbx + executed], n
+    void emit_add_executed(uint32_t n) {
+        emit8(0x48); emit8(0x81); emit8(0x83);
+        emit32(offsetof(JitContext, executed));
+        emit32(n);
+    }
+
+    // mov host, [rbx + 4*guest]
+    void load_reg(int host, uint32_t guest) {
+        if (guest == 0) {
+            emit8(0x31); emit8(0xC0 | (host << 3) | host); // xor host, host
+            return;
+        }
+        emit8(0x8B); emit8(0x80 | (host << 3) | 3); emit32(4 * guest);
+    }
+
+    // mov [rbx + 4*guest], host
+    void store_reg(uint32_t guest, int host) {
+        emit8(0x89); emit8(0x80 | (host << 3) | 3); emit32(4 * guest);
+    }
+
+    // mov dword [rbx + 4*guest], imm32
+    void store_imm(uint32_t guest, uint32_t imm) {
+        emit8(0xC7); emit8(0x83); emit32(4 * guest); emit32(imm);
+    }
+
+    // op eax, imm32 with the group-1 opcode extension
+    void alu_imm(int ext, int32_t imm) {
+        emit8(0x81); emit8(0xC0 | (ext << 3) | EAX); emit32(imm);
+    }
+
+    // setcc al; movzx eax, al
+    void set_flag(uint8_t cc) {
+        emit8(0x0F); emit8(cc); emit8(0xC0);
+        emit8(0x0F); emit8(0xB6); emit8(0xC0);
+    }
+
+    // mov rdi, &memory
+    void load_memory_arg() {
+        emit8(0x48); emit8(0xBF); emit64(reinterpret_cast<uint64_t>(&memory));
+    }
+
+    // mov rax, fn; call rax
+    void call(const void* fn) {
+        emit8(0x48); emit8(0xB8); emit64(reinterpret_cast<uint64_t>(fn));
+        emit8(0xFF); emit8(0xD0);
+    }
+
+    // Exit to guest pc: a jump that is patched to the translated target,
+    // falling through to "return pc" until then
+    void emit_exit(uint32_t pc) {
+        uint8_t* site = out;
+        emit8(0xE9); emit32(0);
+        emit8(0xB8); emit32(pc); // mov eax, pc
+        emit8(0x5B);             // pop rbx
+        emit8(0xC3);             // ret
+        if (const JitBlock* target = lookup(pc)) {
+            patch_jump(site, target->body);
+            chained_exits++;
+        } else {
+            pending[pc].push_back(site);
+        }
+    }
+
+    // Leave at the load or store at pc, the block's instruction index, when
+    // its address (esi) is in the MMIO window: take back the count of it and
+    // the rest of the block, set ctx->mmio and return pc
+    void emit_mmio_check(uint32_t pc, uint32_t index) {
+        emit8(0x89); emit8(0xF0);  // mov eax, esi
+        alu_imm(5, MMIO_BASE);     // sub eax, MMIO_BASE
+        alu_imm(7, MMIO_SIZE);     // cmp eax, MMIO_SIZE
+        emit8(0x73);               // jae past the exit
+        uint8_t* skip = out;
+        emit8(0);
+        emit8(0x48); emit8(0x81); emit8(0xAB); emit32(offsetof(JitContext, executed)); // sub qword [rbx + executed], n
+        mmio_stops.push_back({out, index});
+        emit32(0);
+        emit8(0xC7); emit8(0x83); emit32(offsetof(JitContext, mmio)); emit32(1); // mov dword [rbx + mmio], 1
+        emit8(0xB8); emit32(pc);   // mov eax, pc
+        emit8(0x5B);               // pop rbx
+        emit8(0xC3);               // ret
+        *skip = static_cast<uint8_t>(out - (skip + 1));
+    }
+
+    void emit_instruction(const MicroOp& uop, uint32_t pc, uint32_t index) {
+        uint32_t rd = uop.write_mask ? uop.rd : 32;
+        switch (uop.op) {
+            case OP_ADD: case OP_SUB: case OP_AND: case OP_OR: case OP_XOR: case OP_MUL:
+            case OP_SLL: case OP_SRL: case OP_SRA: case OP_SLT:
+                load_reg(EAX, uop.rs1);
+                load_reg(ECX, uop.rs2);
+                switch (uop.op) {
+                    case OP_ADD: emit8(0x01); emit8(0xC8); break;             // add eax, ecx
+                    case OP_SUB: emit8(0x29); emit8(0xC8); break;             // sub eax, ecx
+                    case OP_AND: emit8(0x21); emit8(0xC8); break;             // and eax, ecx
+                    case OP_OR: emit8(0x09); emit8(0xC8); break;              // or eax, ecx
+                    case OP_XOR: emit8(0x31); emit8(0xC8); break;             // xor eax, ecx
+                    case OP_MUL: emit8(0x0F); emit8(0xAF); emit8(0xC1); break; // imul eax, ecx
+                    case OP_SLL: emit8(0xD3); emit8(0xE0); break;             // shl eax, cl
+                    case OP_SRL: emit8(0xD3); emit8(0xE8); break;             // shr eax, cl
+                    case OP_SRA: emit8(0xD3); emit8(0xF8); break;             // sar eax, cl
+                    default: emit8(0x39); emit8(0xC8); set_flag(0x9C); break; // cmp eax, ecx; setl
+                }
+                store_reg(rd, EAX);
+                break;
+            case OP_ADDI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_SLTI: case OP_SLTIU:
+                load_reg(EAX, uop.rs1);
+                switch (uop.op) {
+                    case OP_ADDI: alu_imm(0, uop.imm); break;
+                    case OP_ORI: alu_imm(1, uop.imm); break;
+                    case OP_ANDI: alu_imm(4, uop.imm); break;
+                    case OP_XORI: alu_imm(6, uop.imm); break;
+                    case OP_SLTI: alu_imm(7, uop.imm); set_flag(0x9C); break; // setl
+                    default: alu_imm(7, uop.imm); set_flag(0x92); break;      // setb
+                }
+                store_reg(rd, EAX);
+                break;
+            case OP_SLLI: case OP_SRLI: case OP_SRAI:
+                load_reg(EAX, uop.rs1);
+                emit8(0xC1);
+                emit8(uop.op == OP_SLLI ? 0xE0 : uop.op == OP_SRLI ? 0xE8 : 0xF8);
+                emit8(uop.imm & 0x1F);
+                store_reg(rd, EAX);
+                break;
+            case OP_LUI:
+                store_imm(rd, uop.imm);
+                break;
+            case OP_AUIPC:
+                store_imm(rd, pc + uop.imm);
+                break;
+            case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: {
+                const void* fn = uop.op == OP_LB ? (const void*)jit_lb : uop.op == OP_LH ? (const void*)jit_lh :
+                                 uop.op == OP_LW ? (const void*)jit_lw : uop.op == OP_LBU ? (const void*)jit_lbu :
+                                 (const void*)jit_lhu;
+                load_memory_arg();
+                load_reg(ESI, uop.rs1);
+                emit8(0x81); emit8(0xC6); emit32(uop.imm); // add esi, imm
+                emit_mmio_check(pc, index);
+                call(fn);
+                store_reg(rd, EAX);
+                break;
+            }
+            case OP_SB: case OP_SH: case OP_SW: {
+                const void* fn = uop.op == OP_SB ? (const void*)jit_sb : uop.op == OP_SH ? (const void*)jit_sh :
+                                 (const void*)jit_sw;
+                load_memory_arg();
+                load_reg(ESI, uop.rs1);
+                emit8(0x81); emit8(0xC6); emit32(uop.imm); // add esi, imm
+                emit_mmio_check(pc, index);
+                load_reg(EDX, uop.rs2);
+                call(fn);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void emit_control(const MicroOp& uop, uint32_t pc) {
+        uint32_t rd = uop.write_mask ? uop.rd : 32;
+        switch (uop.op) {
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: {
+                load_reg(EAX, uop.rs1);
+                load_reg(ECX, uop.rs2);
+                emit8(0x39); emit8(0xC8); // cmp eax, ecx
+                uint8_t cc = uop.op == OP_BEQ ? 0x84 : uop.op == OP_BNE ? 0x85 : uop.op == OP_BLT ? 0x8C : 0x8D;
+                emit8(0x0F); emit8(cc);
+                uint8_t* jcc = out;
+                emit32(0);
+                emit_exit(pc + 4);
+                put32(jcc, static_cast<uint32_t>(out - (jcc + 4)));
+                emit_exit(pc + uop.imm);
+                break;
+            }
+            case OP_JAL:
+                store_imm(rd, pc + 4);
+                emit_exit(pc + uop.imm);
+                break;
+            default: // JALR: indirect, always back to the dispatcher
+                load_reg(EAX, uop.rs1);
+                alu_imm(0, uop.imm);
+                emit8(0x83); emit8(0xE0); emit8(0xFE); // and eax, ~1
+                store_imm(rd, pc + 4);
+                emit8(0x5B); // pop rbx
+                emit8(0xC3); // ret
+                break;
+        }
+    }
+};
+
+#endif
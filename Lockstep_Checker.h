@@ -0,0 +1,169 @@
+#ifndef LOCKSTEP_CHECKER_H
+#define LOCKSTEP_CHECKER_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include "Functional_Simulator.h"
+
+using namespace std;
+
+// Lockstep co-simulation: the functional simulator runs the same program as
+// a golden reference next to the pipeline. Every instruction the pipeline
+// retires steps the reference by one instruction, and the two must agree on
+// the PC, the register write and the data memory written (address, size and
+// the bytes now in memory). The first disagreement is reported and stops the
+// run. The reference keeps its own memory and syscall state and logs nowhere;
+// ecalls are passed the cycle the pipeline used, so clock_gettime agrees,
+// and CSR instructions and MMIO accesses the pipeline's counters, so
+// rdcycle, mtime, the hpmcounters and the benchmark device agree too. MMIO
+// loads return what the pipeline loaded. The reference takes interrupts
+// where the pipeline did, not where its own clock would, and runs no DMA:
+// the bytes the pipeline's DMA engine wrote reach its memory at the same
+// point in the instruction stream.
+class LockstepChecker {
+public:
+    explicit LockstepChecker(ostream& out = cout) : out(out), null_out(nullptr), reference(null_out, "") {}
+
+    // Load the program the pipeline runs; input is the --input file or empty
+    bool load(const string& text_file, const string& data_file, const string& input) {
+        reference.init_sim();
+        if (!reference.load_mc_file(text_file) || !reference.load_data_mc(data_file)) {
+            out << "Error: Lockstep reference cannot load " << text_file << " and " << data_file << "\n";
+            return false;
+        }
+        reference.syscalls.setOutput(null_out, null_out);
+        reference.external_interrupts = true;
+        return input.empty() || reference.syscalls.setInput(input);
+    }
+
+    // The pipeline executed an ecall at this cycle
+    void syscall_at(uint64_t cycle) {
+        syscall_cycle = cycle;
+        syscall_pending = true;
+    }
+
+    // The pipeline took an interrupt; older instructions still in flight retire first
+    void interrupt_at(int older, uint32_t cause) {
+        interrupt_after = older;
+        interrupt_cause = cause;
+    }
+
+    // The pipeline's DMA engine wrote bytes at addr after older more instructions retire
+    void dma_write_at(int older, uint32_t addr, const vector<uint8_t>& bytes) {
+        dma_writes.push_back({older, addr, bytes});
+    }
+
+    // The pipeline's MMIO load returned value
+    void mmio_load_at(uint32_t value) {
+        reference.pinned_mmio_load = value;
+        reference.mmio_load_pinned = true;
+    }
+
+    // The pipeline executed a CSR instruction or MMIO access with these counter values
+    void counters_at(const CounterValues& raw) {
+        csr_counters = raw;
+        counters_pending = true;
+    }
+
+    // Step the reference over the instruction the pipeline retired and compare
+    // what both wrote; false on a divergence
+    bool retire(const Retirement& actual, const SparseMemory& memory, int cycle) {
+        const MicroOp* next = reference.code.at(reference.pc);
+        bool ecall = next && next->klass == CLASS_SYSTEM && syscall_pending;
+        int reference_cycles = reference.clock_cycles;
+        if (ecall) {
+            reference.clock_cycles = static_cast<int>(syscall_cycle);
+            syscall_pending = false;
+        }
+        if (interrupt_cause && interrupt_after-- == 0) {
+            reference.interrupt_cause = interrupt_cause;
+            interrupt_cause = 0;
+        }
+        while (!dma_writes.empty() && dma_writes.front().after == 0) {
+            const DmaWrite& write = dma_writes.front();
+            for (size_t i = 0; i < write.bytes.size(); i++) reference.memory.write8(write.addr + i, write.bytes[i]);
+            dma_writes.pop_front();
+        }
+        for (DmaWrite& write : dma_writes) write.after--;
+        if (counters_pending) {
+            reference.pinned_counters = &csr_counters;
+            counters_pending = false;
+        }
+        bool stepped = reference.step();
+        if (ecall) reference.clock_cycles = reference_cycles + 1;
+        reference.pinned_counters = nullptr;
+        const Retirement& expected = reference.retired;
+        checked++;
+
+        string what;
+        if (!stepped) what = "the reference reached the end of the program";
+        else if (actual.pc != expected.pc) what = "PC differs";
+        else if (actual.rd != expected.rd || actual.value != expected.value) what = "register write differs";
+        else if (actual.store != expected.store || actual.addr != expected.addr || actual.size != expected.size) {
+            what = "memory write differs";
+        } else if (actual.store && memory.readValue(actual.addr, actual.size) !=
+                                   reference.memory.readValue(actual.addr, actual.size)) {
+            what = "memory contents differ";
+        }
+        if (what.empty()) return true;
+
+        diverged_ = true;
+        out << "\nLockstep divergence at instruction #" << checked << " (cycle " << cycle << "): " << what << "\n";
+        const MicroOp* uop = reference.code.at(expected.pc);
+        out << "  Reference instruction: " << (uop ? disassemble(*uop) : string("none")) << "\n";
+        out << "  Pipeline:  " << describe(actual, memory) << "\n";
+        if (stepped) out << "  Reference: " << describe(expected, reference.memory) << "\n";
+        return false;
+    }
+
+    // Final verdict, after the pipeline stops
+    void report() const {
+        if (diverged_) out << "Lockstep check: FAIL after " << checked << " instructions\n";
+        else out << "Lockstep check: PASS, " << checked << " instructions matched the functional simulator\n";
+    }
+
+    bool diverged() const { return diverged_; }
+
+private:
+    ostream& out;
+    ostream null_out;                 // Reference log and guest output go nowhere
+    FunctionalSimulator reference;
+    long long checked = 0;            // Retired instructions compared
+    bool diverged_ = false;
+    uint64_t syscall_cycle = 0;
+    bool syscall_pending = false;
+    CounterValues csr_counters = {};
+    bool counters_pending = false;
+    int interrupt_after = 0;          // Retirements before the reference takes the interrupt
+    uint32_t interrupt_cause = 0;     // 0: none pending
+
+    struct DmaWrite {
+        int after;                    // Retirements before the bytes land
+        uint32_t addr;
+        vector<uint8_t> bytes;
+    };
+    deque<DmaWrite> dma_writes;
+
+    static string hex32(uint64_t value) {
+        stringstream ss;
+        ss << "0x" << setfill('0') << setw(8) << hex << uppercase << value;
+        return ss.str();
+    }
+
+    static string describe(const Retirement& r, const SparseMemory& memory) {
+        string text = "PC=" + hex32(r.pc);
+        if (r.rd) text += ", x" + to_string(r.rd) + " = " + hex32(static_cast<uint32_t>(r.value));
+        if (r.store) {
+            text += ", " + to_string(r.size) + " byte(s) at " + hex32(r.addr) + " = " +
+                    hex32(memory.readValue(r.addr, r.size));
+        }
+        return text;
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef MEMORY_WRITEBACK_H
+#define MEMORY_WRITEBACK_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "Sparse_Memory.h"
+
+using namespace std;
+
+// Set by SIGUSR1: write memory back at the next tick()
+volatile sig_atomic_t writeback_requested = 0;
+
+void requestWriteback(int) {
+    writeback_requested = 1;
+}
+
+// Writes a simulator's data memory back to data.mc ("0xADDR 0xWORD" for
+// every non-zero word) at the end of the run, on checkpoint() and, when
+// an interval is set, every that many cycles. The text of each page is
+// cached and only pages stored to since the last writeback are rendered
+// again; the file is replaced atomically and skipped when nothing changed.
+// mapImage() also mirrors memory into a MAP_SHARED file laid out by address
+// (sparse, 4 GiB), so checkpoints become a memcpy of the dirty pages and
+// the kernel does the writing.
+class MemoryWriteback {
+public:
+    MemoryWriteback(SparseMemory& memory, const string& filename) : memory(memory), filename(filename) {}
+
+    ~MemoryWriteback() {
+        if (image) munmap(image, IMAGE_SIZE);
+    }
+
+    MemoryWriteback(const MemoryWriteback&) = delete;
+    MemoryWriteback& operator=(const MemoryWriteback&) = delete;
+
+    // Write back every cycles cycles (0: only at the end and on checkpoints)
+    void setInterval(uint64_t cycles) { interval = cycles; }
+
+    // Let SIGUSR1 request a checkpoint from outside the simulator
+    void enableSignal() { signal(SIGUSR1, requestWriteback); }
+
+    bool mapImage(const string& path) {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, IMAGE_SIZE) != 0) {
+            cout << "Error: Cannot create memory image " << path << endl;
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            cout << "Error: Cannot map memory image " << path << endl;
+            return false;
+        }
+        image = static_cast<uint8_t*>(p);
+        // Everything already in memory goes into the fresh image
+        memory.forEachPage([&](uint32_t base, const SparseMemory::Page& page) {
+            memcpy(image + base, page.bytes, SparseMemory::PAGE_SIZE);
+        });
+        return true;
+    }
+
+    // Call once per simulated cycle
+    void tick(uint64_t cycle) {
+        if (writeback_requested || (interval && cycle % interval == 0)) {
+            writeback_requested = 0;
+            checkpoint();
+        }
+    }
+
+    // Mid-run writeback: only the image when one is mapped, else data.mc
+    void checkpoint() {
+        collect();
+        if (image) syncImage();
+        else writeText();
+    }
+
+    // End of run: everything, flushed to disk
+    void finish() {
+        collect();
+        if (image) {
+            syncImage();
+            msync(image, IMAGE_SIZE, MS_ASYNC);
+        }
+        writeText();
+    }
+
+    // Write to another file from now on (the next writeback rewrites it fully)
+    void setFilename(const string& name) {
+        filename = name;
+        written = false;
+    }
+
+    size_t textWrites() const { return text_writes; }
+
+private:
+    static const uint64_t IMAGE_SIZE = 1ull << 32;
+
+    SparseMemory& memory;
+    string filename;
+    uint64_t interval = 0;
+    uint8_t* image = nullptr;
+    map<uint32_t, string> page_text; // Rendered data.mc lines by page base
+    set<uint32_t> text_dirty, image_dirty;
+    bool written = false;
+    size_t text_writes = 0;
+
+    static string to_hex(uint32_t val) {
+        stringstream ss;
+        ss << "0x" << setfill('0') << setw(8) << hex << uppercase << val;
+        return ss.str();
+    }
+
+    // Move the memory's dirty marks into both writers' pending sets
+    void collect() {
+        memory.takeDirty([&](uint32_t base, const SparseMemory::Page&) {
+            text_dirty.insert(base);
+            image_dirty.insert(base);
+        });
+    }
+
+    void syncImage() {
+        for (uint32_t base : image_dirty) memory.copyOut(base, image + base, SparseMemory::PAGE_SIZE);
+        image_dirty.clear();
+    }
+
+    void writeText() {
+        // Pages dropped by SparseMemory::clear() have no text any more
+        for (auto it = page_text.begin(); it != page_text.end();) {
+            if (memory.isMapped(it->first)) ++it;
+            else { it = page_text.erase(it); written = false; }
+        }
+        if (written && text_dirty.empty()) return;
+
+        for (uint32_t base : text_dirty) {
+            uint8_t bytes[SparseMemory::PAGE_SIZE];
+            memory.copyOut(base, bytes, sizeof(bytes));
+            string text;
+            for (uint32_t offset = 0; offset < SparseMemory::PAGE_SIZE; offset += 4) {
+                const uint8_t* p = bytes + offset;
+                uint32_t word = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+                if (word) text += to_hex(base + offset) + " " + to_hex(word) + "\n";
+            }
+            page_text[base] = text;
+        }
+        text_dirty.clear();
+
+        string temp = filename + ".tmp";
+        ofstream file(temp);
+        if (!file.is_open()) {
+            cout << "Error: Cannot write to " << filename << endl;
+            return;
+        }
+        for (const auto& page : page_text) file << page.second;
+        file.close();
+        if (rename(temp.c_str(), filename.c_str()) != 0) {
+            cout << "Error: Cannot write to " << filename << endl;
+            return;
+        }
+        written = true;
+        text_writes++;
+    }
+};
+
+#endif
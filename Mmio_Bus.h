@@ -0,0 +1,266 @@
+#ifndef MMIO_BUS_H
+#define MMIO_BUS_H
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "Csr.h"
+#include "Clint.h"
+#include "Dma_Engine.h"
+#include "Syscalls.h"
+#include "Snapshot.h"
+
+using namespace std;
+
+// Memory-mapped I/O: loads and stores in one 16 MiB window below the data
+// segment go to devices instead of data memory. The memory stage tests the
+// window with a single unsigned compare (MmioBus::contains) before touching
+// data memory, so RAM accesses pay nothing more than they did for the CLINT.
+// Inside the window the bus finds the device by address; an address no
+// device claims reads as zero and ignores stores.
+const uint32_t MMIO_BASE = 0x02000000;
+const uint32_t MMIO_SIZE = 0x01000000;
+const uint32_t CONSOLE_BASE = 0x02010000;  // +0 TX (store a byte), +4 RX (load: next input byte, -1 at the end)
+const uint32_t BENCH_BASE = 0x02020000;    // +0 command (1 start, 2 stop, 3 dump), see BenchControl
+const uint32_t FINISHER_BASE = 0x02030000; // +0 store 0x5555 (pass) or code << 16 | 0x3333 (fail)
+// DMA_BASE 0x02040000, see Dma_Engine.h
+const uint32_t DEVICE_SIZE = 0x1000;
+
+const uint32_t BENCH_START = 1;
+const uint32_t BENCH_STOP = 2;
+const uint32_t BENCH_DUMP = 3;
+const uint32_t FINISHER_PASS = 0x5555;
+const uint32_t FINISHER_FAIL = 0x3333;
+
+// What a device sees of the simulator at an access: the counters the CSRs
+// read (time is mtime) and the simulator's log
+struct MmioContext {
+    const CounterValues& counters;
+    ostream& log;
+};
+
+// A device on the bus; offsets are relative to its base. Loads return size
+// bytes in the low bits (the memory stage extends them like a RAM load).
+class MmioDevice {
+public:
+    virtual ~MmioDevice() {}
+    virtual const char* name() const = 0;
+    virtual uint32_t read(uint32_t offset, int size, const MmioContext& context) = 0;
+    virtual void write(uint32_t offset, uint32_t value, int size, const MmioContext& context) = 0;
+    virtual void reset() {}
+    virtual bool interrupt() const { return false; } // Raises the machine external interrupt
+    virtual void save(SnapshotWriter&) {}             // State for SNAP_DEVICES
+    virtual void restore(SnapshotReader&) {}
+};
+
+class MmioBus {
+public:
+    static bool contains(uint32_t addr) { return addr - MMIO_BASE < MMIO_SIZE; }
+
+    void map(uint32_t base, uint32_t size, unique_ptr<MmioDevice> device) {
+        devices.push_back({base, size, move(device)});
+    }
+
+    // Device at addr and the offset into it, or nullptr
+    MmioDevice* find(uint32_t addr, uint32_t& offset) const {
+        for (const Mapping& mapping : devices) {
+            if (addr - mapping.base < mapping.size) {
+                offset = addr - mapping.base;
+                return mapping.device.get();
+            }
+        }
+        return nullptr;
+    }
+
+    // Name of the device at addr, for log lines
+    const char* name(uint32_t addr) const {
+        uint32_t offset;
+        MmioDevice* device = find(addr, offset);
+        return device ? device->name() : "unmapped MMIO";
+    }
+
+    uint32_t read(uint32_t addr, int size, const MmioContext& context) const {
+        uint32_t offset;
+        MmioDevice* device = find(addr, offset);
+        return device ? device->read(offset, size, context) : 0;
+    }
+
+    void write(uint32_t addr, uint32_t value, int size, const MmioContext& context) const {
+        uint32_t offset;
+        if (MmioDevice* device = find(addr, offset)) device->write(offset, value, size, context);
+    }
+
+    void reset() {
+        for (Mapping& mapping : devices) mapping.device->reset();
+    }
+
+    void save(SnapshotWriter& writer) const {
+        for (const Mapping& mapping : devices) mapping.device->save(writer);
+    }
+
+    void restore(SnapshotReader& in) const {
+        for (const Mapping& mapping : devices) mapping.device->restore(in);
+    }
+
+    // Some device raises the machine external interrupt (mip.MEIP)
+    bool interrupt() const {
+        for (const Mapping& mapping : devices) {
+            if (mapping.device->interrupt()) return true;
+        }
+        return false;
+    }
+
+private:
+    struct Mapping {
+        uint32_t base;
+        uint32_t size;
+        unique_ptr<MmioDevice> device;
+    };
+    vector<Mapping> devices; // A handful, so a linear search
+};
+
+// The CLINT (Clint.h) on the bus; the simulator keeps the Clint for its trap logic
+class ClintDevice : public MmioDevice {
+public:
+    explicit ClintDevice(Clint& clint) : clint(clint) {}
+    const char* name() const override { return "CLINT"; }
+    uint32_t read(uint32_t offset, int size, const MmioContext& context) override {
+        return clint.read(CLINT_BASE + offset, size, context.counters[COUNTER_TIME]);
+    }
+    void write(uint32_t offset, uint32_t value, int size, const MmioContext&) override {
+        clint.write(CLINT_BASE + offset, value, size);
+    }
+
+private:
+    Clint& clint;
+};
+
+// The DMA engine (Dma_Engine.h) on the bus; the simulator ticks it
+class DmaDevice : public MmioDevice {
+public:
+    explicit DmaDevice(DmaEngine& dma) : dma(dma) {}
+    const char* name() const override { return "DMA"; }
+    uint32_t read(uint32_t offset, int, const MmioContext&) override { return dma.read(offset); }
+    void write(uint32_t offset, uint32_t value, int, const MmioContext&) override { dma.write(offset, value); }
+    bool interrupt() const override { return dma.interrupt(); }
+    void reset() override { dma.reset(); }
+    void save(SnapshotWriter& writer) override { writer(dma); }
+    void restore(SnapshotReader& in) override { in(dma); }
+
+private:
+    DmaEngine& dma;
+};
+
+// UART-like console: bytes stored to TX go to the guest's stdout, loads from
+// RX take the next byte of the --input file, like the write and read ecalls
+class ConsoleDevice : public MmioDevice {
+public:
+    explicit ConsoleDevice(SyscallEmulator& io) : io(io) {}
+    const char* name() const override { return "console"; }
+    uint32_t read(uint32_t offset, int size, const MmioContext&) override {
+        if (offset != 4) return 0;
+        uint32_t value = io.getByte();
+        return size >= 4 ? value : value & ((1u << (8 * size)) - 1);
+    }
+    void write(uint32_t offset, uint32_t value, int, const MmioContext&) override {
+        if (offset == 0) io.putByte(static_cast<char>(value));
+    }
+
+private:
+    SyscallEmulator& io;
+};
+
+// Benchmark control: the guest brackets a region with start and stop, and
+// stop logs what the counters (Csr.h) moved by in between; dump logs them as
+// they are. Loads read the number of regions (+0), and the cycles (+4) and
+// instructions (+8) of the last region, low 32 bits.
+class BenchControl : public MmioDevice {
+public:
+    const char* name() const override { return "bench control"; }
+    uint32_t read(uint32_t offset, int, const MmioContext&) override {
+        switch (offset) {
+            case 0: return regions;
+            case 4: return static_cast<uint32_t>(last[COUNTER_CYCLE]);
+            case 8: return static_cast<uint32_t>(last[COUNTER_INSTRET]);
+            default: return 0;
+        }
+    }
+    void write(uint32_t offset, uint32_t value, int, const MmioContext& context) override {
+        if (offset != 0) return;
+        if (value == BENCH_START) {
+            start = context.counters;
+            running = true;
+        } else if (value == BENCH_STOP && running) {
+            for (int n = 0; n < 32; n++) last[n] = context.counters[n] - start[n];
+            running = false;
+            regions++;
+            print(context.log, "Benchmark region " + to_string(regions), last);
+        } else if (value == BENCH_DUMP) {
+            print(context.log, "Benchmark counters", context.counters);
+        }
+    }
+    void reset() override {
+        regions = 0;
+        running = false;
+        last = {};
+    }
+    void save(SnapshotWriter& writer) override { state(writer); }
+    void restore(SnapshotReader& in) override { state(in); }
+
+private:
+    CounterValues start = {};
+    CounterValues last = {};  // Counts of the last finished region
+    uint32_t regions = 0;
+    bool running = false;
+
+    template <typename Archive>
+    void state(Archive& ar) {
+        for (uint64_t& count : start) ar(count);
+        for (uint64_t& count : last) ar(count);
+        ar(regions);
+        ar(running);
+    }
+
+    static void print(ostream& log, const string& title, const CounterValues& counts) {
+        log << title << ": cycles=" << counts[COUNTER_CYCLE] << ", instret=" << counts[COUNTER_INSTRET];
+        for (int n = HPM_STALLS; n < 32; n++) {
+            if (counts[n]) log << ", hpm" << n << "=" << counts[n];
+        }
+        log << "\n";
+    }
+};
+
+// Test finisher, after QEMU's sifive_test: a store ends the run with an exit
+// code, 0 for FINISHER_PASS and code for code << 16 | FINISHER_FAIL
+class TestFinisher : public MmioDevice {
+public:
+    explicit TestFinisher(SyscallEmulator& io) : io(io) {}
+    const char* name() const override { return "test finisher"; }
+    uint32_t read(uint32_t, int, const MmioContext&) override { return 0; }
+    void write(uint32_t offset, uint32_t value, int, const MmioContext& context) override {
+        if (offset != 0) return;
+        if ((value & 0xFFFF) == FINISHER_PASS) {
+            context.log << "Test finisher: PASS\n";
+            io.exit(0);
+        } else if ((value & 0xFFFF) == FINISHER_FAIL) {
+            context.log << "Test finisher: FAIL with code " << (value >> 16) << "\n";
+            io.exit(value >> 16);
+        }
+    }
+
+private:
+    SyscallEmulator& io;
+};
+
+// The devices both simulators put on their bus
+inline void map_standard_devices(MmioBus& bus, Clint& clint, DmaEngine& dma, SyscallEmulator& io) {
+    bus.map(CLINT_BASE, CLINT_SIZE, unique_ptr<MmioDevice>(new ClintDevice(clint)));
+    bus.map(DMA_BASE, DEVICE_SIZE, unique_ptr<MmioDevice>(new DmaDevice(dma)));
+    bus.map(CONSOLE_BASE, DEVICE_SIZE, unique_ptr<MmioDevice>(new ConsoleDevice(io)));
+    bus.map(BENCH_BASE, DEVICE_SIZE, unique_ptr<MmioDevice>(new BenchControl()));
+    bus.map(FINISHER_BASE, DEVICE_SIZE, unique_ptr<MmioDevice>(new TestFinisher(io)));
+}
+
+#endif
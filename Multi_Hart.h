@@ -0,0 +1,130 @@
+#ifndef MULTI_HART_H
+#define MULTI_HART_H
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <climits>
+#include <atomic>
+#include "Functional_Simulator.h"
+
+using namespace std;
+
+const uint32_t HART_STACK_SIZE = 0x10000; // Each hart's stack starts this far below the previous one
+const long long HART_SLICE = 1 << 20;     // Instructions a parallel hart runs between checks of the others
+
+// Several harts running one program over one data memory. Hart 0 is the
+// simulator the program was loaded into; the others copy its text and
+// registers. Every hart starts at the same PC with its mhartid in a0, the
+// hart count in a1 and its own stack, and runs on the fast interpreter:
+// run_parallel() gives each hart a host thread, run_round_robin() runs them
+// in turn on one thread for a fixed quantum each, so a run is repeatable.
+// Each hart has its own syscall state (program break included) and stops
+// on exit or at the end of the program; the run ends when all have stopped.
+// A hart that reaches what only step mode models (mret, wfi, a trap handler
+// being installed, an MMIO access) stops there, and so do the others, at the
+// end of their slice.
+class MultiHartSimulator {
+public:
+    MultiHartSimulator(FunctionalSimulator& primary, unsigned count, ostream& out = cout) : out(out) {
+        harts.push_back(&primary);
+        for (unsigned id = 1; id < count; id++) {
+            others.emplace_back(new FunctionalSimulator(primary.memory, out));
+            FunctionalSimulator& hart = *others.back();
+            hart.code = primary.code;
+            hart.reg_file = primary.reg_file;
+            hart.pc = primary.pc;
+            hart.clock_cycles = primary.clock_cycles;
+            harts.push_back(&hart);
+        }
+        for (unsigned id = 0; id < count; id++) {
+            FunctionalSimulator& hart = *harts[id];
+            hart.csrs.mhartid = id;
+            hart.reg_file[2] = primary.reg_file[2] - id * HART_STACK_SIZE;
+            hart.reg_file[10] = id;
+            hart.reg_file[11] = count;
+            executed.push_back(0);
+        }
+    }
+
+    size_t size() const { return harts.size(); }
+
+    // One host thread per hart; harts 1.. run on new threads, hart 0 on this one
+    void run_parallel() {
+        auto start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (size_t id = 1; id < harts.size(); id++) {
+            threads.emplace_back([this, id]() { run_slices(id); });
+        }
+        run_slices(0);
+        for (thread& t : threads) t.join();
+        report("parallel", chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    // Deterministic: harts take turns on this thread, each running until at
+    // least quantum instructions have executed (the slice ends at a taken
+    // branch or jump)
+    void run_round_robin(long long quantum) {
+        auto start = chrono::steady_clock::now();
+        bool running = true;
+        while (running) {
+            running = false;
+            for (size_t id = 0; id < harts.size() && !stopped_for_step(); id++) {
+                if (harts[id]->halted) continue;
+                executed[id] += harts[id]->run_threaded(quantum);
+                running = running || !harts[id]->halted;
+            }
+        }
+        report("round-robin, quantum " + to_string(quantum), chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    // Some hart stopped where only step mode can go on (FunctionalSimulator::leave_for_step())
+    bool stopped_for_step() const {
+        for (const FunctionalSimulator* hart : harts) {
+            if (hart->step_reason) return true;
+        }
+        return false;
+    }
+
+private:
+    ostream& out;
+    atomic<bool> stopping{false};                     // A parallel hart stopped for step mode
+    vector<FunctionalSimulator*> harts;               // harts[i] has mhartid i
+    vector<unique_ptr<FunctionalSimulator>> others;   // Harts 1..
+    vector<long long> executed;                       // Instructions per hart
+
+    // Run hart id in parallel with the others until it stops or one of them
+    // stops for step mode
+    void run_slices(size_t id) {
+        FunctionalSimulator& hart = *harts[id];
+        while (!hart.halted && !stopping.load(memory_order_relaxed)) {
+            executed[id] += hart.run_threaded(HART_SLICE);
+        }
+        if (hart.step_reason) stopping = true;
+    }
+
+    void report(const string& mode, double seconds) {
+        long long total = 0;
+        for (size_t id = 0; id < harts.size(); id++) {
+            const FunctionalSimulator& hart = *harts[id];
+            total += executed[id];
+            out << "Hart " << id << ": " << executed[id] << " instructions, ";
+            if (hart.syscalls.exited()) out << "exited with code " << hart.syscalls.exitCode() << "\n";
+            else {
+                out << "stopped at " << "0x" << hex << uppercase << setw(8) << setfill('0') << hart.pc
+                    << dec << nouppercase << setfill(' ');
+                if (hart.step_reason) out << " (" << hart.step_reason << ")";
+                out << "\n";
+            }
+        }
+        out << "Multi-hart mode (" << harts.size() << " harts, " << mode << "): " << total << " instructions in "
+            << fixed << setprecision(3) << seconds << " s";
+        if (seconds > 0) out << " (" << setprecision(1) << total / seconds / 1e6 << " MIPS)";
+        out << defaultfloat << "\n";
+    }
+};
+
+#endif
@@ -0,0 +1,1800 @@
+#ifndef PIPELINE_SIMULATOR_H
+#define PIPELINE_SIMULATOR_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cctype>
+#include <set>
+#include <map>
+#include <memory>
+#include "Riscv_Instructions.h"
+#include "Instructions_Func.h"
+#include "Auxiliary_Functions.h"
+#include "Sparse_Memory.h"
+#include "Memory_Writeback.h"
+#include "Snapshot.h"
+#include "Fork_Server.h"
+#include "Predecoder.h"
+#include "Syscalls.h"
+#include "Atomics.h"
+#include "Csr.h"
+#include "Clint.h"
+#include "Mmio_Bus.h"
+#include "Lockstep_Checker.h"
+#include "Gdb_Stub.h"
+#include "Watchpoints.h"
+
+using namespace std;
+
+
+// Hazard state for data hazard tracking
+struct HazardState {
+    uint32_t current_hazard_pc = 0;
+    int stall_cycles_remaining = 0;
+    
+    void reset() {
+        current_hazard_pc = 0;
+        stall_cycles_remaining = 0;
+    }
+    
+    void set_hazard(uint32_t pc, int stalls_needed) {
+        if (current_hazard_pc != pc) {
+            current_hazard_pc = pc;
+            stall_cycles_remaining = stalls_needed;
+        }
+    }
+    
+    bool is_same_hazard(uint32_t pc) {
+        return current_hazard_pc == pc;
+    }
+};
+
+// Instruction tracing structure
+struct InstructionTrace {
+    int fetch_cycle = -1;
+    int decode_cycle = -1;
+    int execute_cycle = -1;
+    int memory_cycle = -1;
+    int writeback_cycle = -1;
+    string decode_instruction = "";
+    vector<string> forwarding_events;
+    vector<string> btb_updates;
+};
+
+// Per-PC execution profile for profile-guided block layout
+struct BranchProfile {
+    long long executed = 0;
+    long long taken = 0;
+};
+
+// Configuration knobs
+struct Knobs {
+    bool enable_pipelining = true;
+    bool enable_data_forwarding = true;
+    bool print_reg_file = false;
+    bool print_pipeline_regs = false;
+    int trace_instruction = -1;
+    bool print_branch_predictor = false;
+    bool enable_structural_hazard = false;
+    string branch_profile_file;                        // Per-PC profile written at the end, empty for none
+    uint64_t writeback_interval = 0;                   // Cycles between data.mc writebacks (0: end only)
+    string memory_image_file;                          // mmap'd memory image, empty for none
+    string save_state_file;                            // Snapshot written at save_at_cycle or at the end
+    int save_at_cycle = -1;                            // -1: save when the run ends
+    string restore_state_file;                         // Snapshot to continue from
+    int fork_at_cycle = -1;                            // Fork-server marker cycle, -1 for none
+    int64_t fork_at_pc = -1;                           // Fork-server marker PC, -1 for none
+    string variants_file;                              // One forked run per line
+    int fork_jobs = 0;                                 // Concurrent forked runs (0: one per CPU)
+};
+
+// Statistics
+struct Stats {
+    int total_cycles = 0;
+    int total_instructions = 0;
+    int data_transfer_instructions = 0;
+    int alu_instructions = 0;
+    int control_instructions = 0;
+    int stall_count = 0;
+    int data_hazards = 0;
+    int control_hazards = 0;
+    int branch_mispredictions = 0;
+    int stalls_data_hazards = 0;
+    int stalls_control_hazards = 0;
+    int traps = 0;                    // Exceptions taken (illegal instruction, ebreak)
+    int interrupts = 0;               // Timer and external interrupts taken
+    int interrupt_latency_total = 0;  // Cycles from pending and enabled to the trap redirect
+    int interrupt_latency_max = 0;
+
+    double get_cpi() const {
+        return total_instructions > 0 ? static_cast<double>(total_cycles) / total_instructions : 0;
+    }
+};
+
+// Control signals
+struct Control {
+    bool mem_read = false;
+    bool mem_write = false;
+    bool reg_write = false;
+    bool branch = false;
+    bool use_imm = false;
+    int output_sel = 0; // 0: ALU, 1: Memory, 2: PC
+    Op alu_op = OP_INVALID;
+    bool is_nop = false;
+};
+
+// Pipeline Registers
+struct IF_ID_Register {
+    uint32_t pc = 0;
+    uint32_t ir = 0;
+    MicroOp uop;
+    bool is_valid = false;
+    int instr_number = 0;
+};
+
+struct ID_EX_Register {
+    uint32_t pc = 0;
+    uint32_t ir = 0;
+    int32_t reg_a_val = 0;
+    int32_t reg_b_val = 0;
+    int32_t imm = 0;
+    uint32_t rs1 = 0;
+    uint32_t rs2 = 0;
+    uint32_t rd = 0;
+    Control ctrl;
+    bool is_valid = false;
+    int instr_number = 0;
+};
+
+struct EX_MEM_Register {
+    uint32_t pc = 0;
+    int32_t alu_result = 0;
+    int32_t rs2_val = 0;
+    uint32_t rd = 0;
+    Control ctrl;
+    bool is_valid = false;
+    int instr_number = 0;
+};
+
+struct MEM_WB_Register {
+    uint32_t pc = 0;
+    int32_t write_data = 0;
+    uint32_t mem_addr = 0; // Address of a store or atomic, for the lockstep checker
+    uint32_t rd = 0;
+    Control ctrl;
+    bool is_valid = false;
+    int instr_number = 0;
+};
+
+// The five-stage pipeline simulator: knobs, latches, branch predictor,
+// statistics and memory of one run. Instances share nothing, so a process
+// can run several at once; each logs to its own stream.
+class PipelineSimulator {
+public:
+    explicit PipelineSimulator(ostream& out = cout, const string& data_file = "data.mc")
+        : data_writeback(data_memory, data_file), syscalls(data_memory), out(out) {
+        syscalls.setOutput(out, cerr);
+        map_standard_devices(bus, clint, dma, syscalls);
+    }
+
+    PipelineSimulator(const PipelineSimulator&) = delete;
+    PipelineSimulator& operator=(const PipelineSimulator&) = delete;
+
+    static constexpr int MAX_CYCLES = 10000;
+
+    Knobs knobs;
+    Stats stats;
+
+    uint32_t pc = 0;
+    array<int32_t, 32> reg_file = {0};
+    PredecodedText text_memory;
+    SparseMemory data_memory;
+    MemoryWriteback data_writeback;
+    SyscallEmulator syscalls;
+    Reservation reservation; // LR.W reservation
+    CsrFile csrs;            // Zicsr state; the counters read Stats (counters())
+    Clint clint;             // Machine timer; mtime is the cycle count
+    DmaEngine dma;           // DMA engine, ticked at the end of every cycle
+    MmioBus bus;             // Devices in the MMIO window, CLINT and DMA included
+    WatchList watches;       // Data watchpoints, checked by the memory stage
+    bool watch_stopped = false; // A watchpoint that stops ended the run
+    unique_ptr<LockstepChecker> lockstep;   // Functional reference checked at every retirement, if enabled
+
+    vector<RunVariant> variants; // Fork server runs from the marker
+
+    // Load memory from text and data files
+    bool load_memory(const string& text_file, const string& data_file) {
+        ifstream text_in(text_file);
+        if (!text_in) {
+            cerr << "Error: Cannot open text file: " << text_file << endl;
+            return false;
+        }
+
+        string line;
+        int line_num = 0;
+        int valid_lines = 0;
+        while (getline(text_in, line)) {
+            ++line_num;
+            size_t comment_pos = line.find('#');
+            if (comment_pos != string::npos) {
+                line = line.substr(0, comment_pos);
+            }
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t") + 1);
+            if (line.empty()) continue;
+
+            stringstream ss(line);
+            string addr_str, instr_str;
+            if (!(ss >> addr_str >> instr_str)) {
+                out << "Warning: Skipping malformed line " << line_num << " in " << text_file << ": " << line << endl;
+                continue;
+            }
+
+            if (!is_valid_hex(addr_str) || !is_valid_hex(instr_str)) {
+                out << "Warning: Invalid hex at line " << line_num << " in " << text_file
+                     << ": " << addr_str << " " << instr_str << endl;
+                continue;
+            }
+
+            try {
+                uint32_t addr = stoul(addr_str, nullptr, 16);
+                uint32_t instr = stoul(instr_str, nullptr, 16);
+                text_memory.add(addr, instr);
+                ++valid_lines;
+                out << "Loaded text: Addr=" << to_hex(addr) << ", Instr=" << to_hex(instr) << "\n";
+            } catch (const exception& e) {
+                out << "Warning: Invalid number format at line " << line_num << " in " << text_file
+                     << ": " << addr_str << " " << instr_str << endl;
+                continue;
+            }
+        }
+        text_in.close();
+
+        if (valid_lines == 0) {
+            cerr << "Error: No valid instructions loaded from " << text_file << endl;
+            return false;
+        }
+        out << "Total valid text instructions loaded: " << valid_lines << "\n";
+
+        ifstream data_in(data_file);
+        if (data_in) {
+            line_num = 0;
+            valid_lines = 0;
+            while (getline(data_in, line)) {
+                ++line_num;
+                size_t comment_pos = line.find('#');
+                if (comment_pos != string::npos) {
+                    line = line.substr(0, comment_pos);
+                }
+                line.erase(0, line.find_first_not_of(" \t"));
+                line.erase(line.find_last_not_of(" \t") + 1);
+                if (line.empty()) continue;
+
+                stringstream ss(line);
+                string addr_str, value_str;
+                if (!(ss >> addr_str >> value_str)) {
+                    out << "Warning: Skipping malformed line " << line_num << " in " << data_file
+                         << ": " << line << endl;
+                    continue;
+                }
+
+                if (!is_valid_hex(addr_str) || !is_valid_hex(value_str)) {
+                    out << "Warning: Invalid hex at line " << line_num << " in " << data_file
+                         << ": " << addr_str << " " << value_str << endl;
+                    continue;
+                }
+
+                try {
+                    uint32_t addr = stoul(addr_str, nullptr, 16);
+                    uint64_t value = stoull(value_str, nullptr, 16);
+                    int size = (value_str.length() - 1) / 2; // Entry width follows its hex digits
+                    data_memory.writeValue(addr, value, size);
+                    ++valid_lines;
+                    out << "Loaded data: Addr=" << to_hex(addr) << ", Value=" << value_str << "\n";
+                } catch (const exception& e) {
+                    out << "Warning: Invalid number format at line " << line_num << " in " << data_file
+                         << ": " << addr_str << " " << value_str << endl;
+                    continue;
+                }
+            }
+            data_in.close();
+            out << "Total valid data entries loaded: " << valid_lines << "\n";
+        } else {
+            out << "No data file found or could not open: " << data_file << endl;
+        }
+
+        return true;
+    }
+
+    // Write data memory to data.mc (only pages changed since the last writeback)
+    void write_data_mc() {
+        data_writeback.finish();
+    }
+
+    // Print register file
+    void print_register_file() {
+        if (!knobs.print_reg_file) return;
+        out << "\nRegister File:\n";
+        for (int i = 0; i < 32; i++) {
+            if (i % 4 == 0 && i > 0) out << "\n";
+            out << "x" << setw(2) << setfill('0') << i << ": " << setw(10) << setfill(' ')
+                 << reg_file[i] << " (0x" << hex << setw(8) << setfill('0') << reg_file[i] << dec << ")  ";
+        }
+        out << "\n";
+    }
+
+    // Print simulation statistics
+    void print_statistics() {
+        out << "\nSimulation Statistics:\n";
+        out << "Total Cycles: " << stats.total_cycles << "\n";
+        out << "Total Instructions: " << stats.total_instructions << "\n";
+        out << "CPI: " << fixed << setprecision(3) << stats.get_cpi() << "\n";
+        out << "Data Transfer Instructions: " << stats.data_transfer_instructions << "\n";
+        out << "ALU Instructions: " << stats.alu_instructions << "\n";
+        out << "Control Instructions: " << stats.control_instructions << "\n";
+        out << "Total Stalls/Bubbles: " << stats.stall_count << "\n";
+        out << "Data Hazards: " << stats.data_hazards << "\n";
+        out << "Control Hazards: " << stats.control_hazards << "\n";
+        out << "Branch Mispredictions: " << stats.branch_mispredictions << "\n";
+        out << "Stalls Due to Data Hazards: " << stats.stalls_data_hazards << "\n";
+        out << "Stalls Due to Control Hazards: " << stats.stalls_control_hazards << "\n";
+        if (stats.traps || stats.interrupts) {
+            out << "Traps: " << stats.traps << "\n";
+            out << "Interrupts: " << stats.interrupts << "\n";
+            if (stats.interrupts) {
+                out << "Interrupt Latency: " << fixed << setprecision(2)
+                    << static_cast<double>(stats.interrupt_latency_total) / stats.interrupts
+                    << " cycles average, " << stats.interrupt_latency_max << " max\n";
+            }
+        }
+        if (dma.busy_cycles) {
+            out << "DMA Bytes Copied: " << dma.bytes_total << "\n";
+            out << "DMA Busy Cycles: " << dma.busy_cycles << "\n";
+            out << "DMA Cycles Lost to MEM: " << dma.port_conflicts << "\n";
+        }
+    }
+
+    // Configure simulator knobs
+    void configure_knobs() {
+        knobs.enable_pipelining = true;
+        knobs.enable_data_forwarding = true;
+        knobs.print_reg_file = true;
+        knobs.print_pipeline_regs = false;
+        knobs.enable_structural_hazard = false;
+        knobs.trace_instruction = 3;
+        knobs.print_branch_predictor = true;
+
+        out << "Knob settings:\n";
+        out << "  Pipelining: " << (knobs.enable_pipelining ? "Enabled" : "Disabled") << "\n";
+        out << "  Data Forwarding: " << (knobs.enable_data_forwarding ? "Enabled" : "Disabled") << "\n";
+        out << "  Print Register File: " << (knobs.print_reg_file ? "Enabled" : "Disabled") << "\n";
+        out << "  Print Pipeline Registers: " << (knobs.print_pipeline_regs ? "Enabled" : "Disabled") << "\n";
+        out << "  Structural Hazard Handling: " << (knobs.enable_structural_hazard ? "Enabled" : "Disabled") << "\n";
+        out << "  Trace Instruction: " << (knobs.trace_instruction >= 0 ? to_string(knobs.trace_instruction) : "Disabled") << "\n";
+        out << "  Print Branch Predictor: " << (knobs.print_branch_predictor ? "Enabled" : "Disabled") << "\n";
+    }
+
+    // Initialize simulator
+    void initialize_simulator() {
+        text_memory.clear();
+        data_memory.clear();
+        reg_file.fill(0);
+        reg_file[2] = 0x7FFFFFE4;
+        reg_file[3] = 0x10000000;
+        reg_file[10] = 0x00000001;
+        reg_file[11] = 0x07FFFFE4;
+
+        hazard.reset();
+        instruction_traces.clear();
+        branch_profile.clear();
+        initialize_tracing();
+        pc = 0;
+        if_id = IF_ID_Register();
+        id_ex = ID_EX_Register();
+        ex_mem = EX_MEM_Register();
+        mem_wb = MEM_WB_Register();
+        stall_pipeline = false;
+        reservation = Reservation();
+        csrs = CsrFile();
+        clint = Clint();
+        bus.reset();
+        interrupt_ready_since = -1;
+
+        stats = Stats();
+        instruction_count = 0;
+        program_done = false;
+        halted = false;
+        watch_stopped = false;
+
+        branch_predictor.reset(new BranchPredictor(*this, 16));
+        out << "Simulator initialized, BTB cleared\n";
+    }
+
+    // Save architectural and pipeline state
+    bool save_state(const string& filename) {
+        SnapshotWriter writer(filename);
+        CoreState core;
+        core.pc = pc;
+        for (int i = 0; i < 32; i++) core.regs[i] = reg_file[i];
+        core.cycles = stats.total_cycles;
+        core.instructions = stats.total_instructions;
+        core.text_fingerprint = text_fingerprint(text_memory);
+        writer.begin(SNAP_CORE);
+        writer(core);
+        writer.end();
+        writer.begin(SNAP_MEMORY);
+        writer.memory(data_memory);
+        writer.end();
+        writer.begin(SNAP_PIPELINE);
+        snapshot_pipeline(writer);
+        writer.end();
+        uint32_t heap_end = syscalls.heapEnd();
+        uint64_t input_offset = syscalls.inputOffset();
+        writer.begin(SNAP_SYSCALL);
+        writer(heap_end);
+        writer(input_offset);
+        writer.end();
+        writer.begin(SNAP_CSR);
+        writer(csrs);
+        writer.end();
+        writer.begin(SNAP_TIMER);
+        writer(clint.mtimecmp);
+        writer.end();
+        writer.begin(SNAP_DEVICES);
+        bus.save(writer);
+        writer.end();
+        writer.begin(SNAP_RESERVATION);
+        writer(reservation);
+        writer.end();
+        if (!writer.ok()) {
+            out << "Error: Cannot write snapshot " << filename << endl;
+            return false;
+        }
+        out << "Saved state at cycle " << stats.total_cycles << " to " << filename << "\n";
+        return true;
+    }
+
+    // Continue from a snapshot; one from code.cpp starts with an empty pipeline at its PC
+    bool restore_state(const string& filename) {
+        SnapshotReader in(filename);
+        if (!in.ok()) {
+            out << "Error: " << in.message() << endl;
+            return false;
+        }
+        CoreState core;
+        if (in.open(SNAP_CORE)) in(core);
+        if (in.open(SNAP_MEMORY)) in.memory(data_memory);
+        if (in.open(SNAP_PIPELINE)) {
+            snapshot_pipeline(in);
+            if_id.uop = if_id.ir ? predecode(if_id.ir) : MicroOp();
+        }
+        uint32_t heap_end = HEAP_BASE;
+        uint64_t input_offset = 0;
+        if (in.open(SNAP_SYSCALL)) {
+            in(heap_end);
+            in(input_offset);
+        }
+        CsrFile restored_csrs;
+        if (in.open(SNAP_CSR)) in(restored_csrs);
+        Clint restored_clint;
+        if (in.open(SNAP_TIMER)) in(restored_clint.mtimecmp);
+        Reservation restored_reservation;
+        if (in.open(SNAP_RESERVATION)) in(restored_reservation);
+        if (!in.ok()) {
+            out << "Error: " << in.message() << endl;
+            return false;
+        }
+        if (core.text_fingerprint != text_fingerprint(text_memory)) {
+            out << "Warning: " << filename << " was saved with a different text.mc\n";
+        }
+        pc = core.pc;
+        for (int i = 1; i < 32; i++) reg_file[i] = core.regs[i];
+        syscalls.restore(heap_end, input_offset);
+        csrs = restored_csrs;
+        clint = restored_clint;
+        reservation = restored_reservation;
+        bus.reset();
+        if (in.open(SNAP_DEVICES)) bus.restore(in);
+        out << "Restored state at cycle " << stats.total_cycles << " from " << filename << "\n";
+        return true;
+    }
+
+    // Counts behind cycle, time, instret and the hpmcounters (HpmEvent)
+    CounterValues counters() const {
+        CounterValues raw = {};
+        raw[COUNTER_CYCLE] = raw[COUNTER_TIME] = stats.total_cycles;
+        raw[COUNTER_INSTRET] = stats.total_instructions;
+        raw[HPM_STALLS] = stats.stall_count;
+        raw[HPM_DATA_HAZARDS] = stats.data_hazards;
+        raw[HPM_CONTROL_HAZARDS] = stats.control_hazards;
+        raw[HPM_MISPREDICTIONS] = stats.branch_mispredictions;
+        raw[HPM_DATA_HAZARD_STALLS] = stats.stalls_data_hazards;
+        raw[HPM_CONTROL_HAZARD_STALLS] = stats.stalls_control_hazards;
+        raw[HPM_DATA_TRANSFERS] = stats.data_transfer_instructions;
+        raw[HPM_ALU_INSTRUCTIONS] = stats.alu_instructions;
+        raw[HPM_CONTROL_INSTRUCTIONS] = stats.control_instructions;
+        return raw;
+    }
+
+    // Check every retired instruction against the functional simulator
+    // running the same program (call after load_memory)
+    bool enable_lockstep(const string& text_file, const string& data_file, const string& input_file) {
+        lockstep.reset(new LockstepChecker(out));
+        return lockstep->load(text_file, data_file, input_file);
+    }
+
+    bool lockstep_diverged() const { return lockstep && lockstep->diverged(); }
+
+    // Set one knob from a variants or batch file line; false for an unknown key
+    bool apply_setting(const string& key, const string& value) {
+        bool on = value != "0";
+        if (key == "forwarding") knobs.enable_data_forwarding = on;
+        else if (key == "structural") knobs.enable_structural_hazard = on;
+        else if (key == "trace") knobs.trace_instruction = stoi(value);
+        else return false;
+        return true;
+    }
+
+    // Run simulation
+    void run_simulation() {
+        start_simulation();
+        simulate(MAX_CYCLES);
+        finish_simulation();
+    }
+
+    void start_simulation() {
+        if (knobs.restore_state_file.empty()) {
+            stats.total_cycles = 0;
+            stats.total_instructions = 0;
+            program_done = false;
+            stall_pipeline = false;
+        }
+        instruction_traces.clear();
+
+        out << "Starting simulation...\n";
+        out << "Pipelining: " << (knobs.enable_pipelining ? "Enabled" : "Disabled") << "\n";
+    }
+
+    // Up to max_cycles more cycles, until the program is done
+    void simulate(int max_cycles) {
+        int start_cycles = stats.total_cycles;
+        while (stats.total_cycles - start_cycles < max_cycles && running()) cycle();
+    }
+
+    void finish_simulation() {
+        print_statistics();
+        if (lockstep) lockstep->report();
+        trace_instruction(knobs.trace_instruction);
+        if (!variants.empty() && !fork_started) {
+            out << "Warning: Fork marker never reached, ran without forking\n";
+        }
+        if (!knobs.save_state_file.empty() && knobs.save_at_cycle < 0) save_state(knobs.save_state_file);
+        write_data_mc();
+        sendForkReport(to_string(stats.total_cycles) + " " + to_string(stats.total_instructions) + " " +
+                       to_string(stats.stall_count) + " " + to_string(stats.data_hazards) + " " +
+                       to_string(stats.branch_mispredictions));
+        if (!knobs.branch_profile_file.empty()) {
+            write_branch_profile(knobs.branch_profile_file);
+        }
+    }
+
+    bool running() const {
+        if (lockstep_diverged()) return false;
+        if (!knobs.enable_pipelining) return !program_done;
+        return !program_done || if_id.is_valid || id_ex.is_valid || ex_mem.is_valid || mem_wb.is_valid;
+    }
+
+    // One clock cycle
+    void cycle() {
+        if (at_fork_marker()) start_fork_server();
+        out << "\n=== Cycle " << stats.total_cycles + 1 << " ===\n";
+
+        if (knobs.enable_pipelining) {
+            stall_pipeline = detect_data_hazard();
+
+            writeback();
+            if (lockstep_diverged()) return;
+            memory();
+            execute();
+            decode();
+            fetch();
+            if (dma.busy) tick_dma();
+
+            stats.total_cycles++;
+            data_writeback.tick(stats.total_cycles);
+            if (stats.total_cycles == knobs.save_at_cycle) save_state(knobs.save_state_file);
+
+            if (knobs.print_pipeline_regs) {
+                print_pipeline_registers();
+            }
+            if (knobs.print_reg_file) {
+                print_register_file();
+            }
+            if (knobs.print_branch_predictor) {
+                branch_predictor->print_state();
+            }
+        } else {
+            fetch();
+            if (!if_id.is_valid) {
+                stats.total_cycles++;
+                return;
+            }
+
+            decode();
+            if (!id_ex.is_valid) {
+                stats.total_cycles++;
+                return;
+            }
+
+            execute();
+            if (!ex_mem.is_valid) {
+                stats.total_cycles++;
+                return;
+            }
+
+            memory();
+            if (!mem_wb.is_valid) {
+                stats.total_cycles++;
+                return;
+            }
+
+            writeback();
+            if (dma.busy) tick_dma();
+
+            stats.total_cycles++;
+            data_writeback.tick(stats.total_cycles);
+            if (stats.total_cycles == knobs.save_at_cycle) save_state(knobs.save_state_file);
+
+            print_pipeline_registers();
+            print_register_file();
+            branch_predictor->print_state();
+        }
+    }
+
+    // Run for the debugger (Gdb_Stub.h) between start_simulation() and
+    // finish_simulation(): one instruction, or until the next one is at a
+    // breakpoint. The pipeline stops the next instruction at EX like an
+    // interrupt and drains, so it returns empty, with the register file and
+    // memory exactly those before the instruction at pc. The instruction at pc
+    // always runs, so continuing leaves the breakpoint it stopped at. There is
+    // no MAX_CYCLES limit; stop_requested() is polled every 1024 cycles.
+    DebugStop debug_resume(bool single_step, const BreakpointMap& breakpoints, const function<bool()>& stop_requested) {
+        debug_breakpoints = &breakpoints;
+        debug_single_step = single_step;
+        debug_interrupt = false;
+        debug_watch = false;
+        debug_executed = 0;
+        for (uint64_t n = 1; running(); n++) {
+            cycle();
+            if (debug_draining && !if_id.is_valid && !id_ex.is_valid && !ex_mem.is_valid && !mem_wb.is_valid) {
+                debug_draining = false;
+                debug_breakpoints = nullptr;
+                return debug_interrupt ? DEBUG_INTERRUPT : debug_watch ? DEBUG_WATCH : DEBUG_TRAP;
+            }
+            if (n % 1024 == 0 && !debug_interrupt && stop_requested()) debug_interrupt = true;
+        }
+        debug_draining = false;
+        debug_breakpoints = nullptr;
+        return halted ? DEBUG_FAULT : DEBUG_EXITED;
+    }
+
+private:
+    // Branch Predictor
+    class BranchPredictor {
+    private:
+        struct BTBEntry {
+            uint32_t pc;
+            uint32_t target;
+            bool valid;
+            bool prediction; // 1-bit predictor: 0 (not taken), 1 (taken)
+        };
+        PipelineSimulator& sim;
+        vector<BTBEntry> btb; // No fixed size, grows dynamically
+
+    public:
+        BranchPredictor(PipelineSimulator& sim, uint32_t btb_s) : sim(sim) {
+            btb.clear(); // Initialize empty
+            sim.out << "Branch Predictor initialized with dynamic size\n";
+        }
+
+        bool predict(uint32_t pc) {
+            for (const auto& entry : btb) {
+                if (entry.valid && entry.pc == pc) {
+                    bool predicted_taken = entry.prediction;
+                    sim.out << "Predict: PC=" << to_hex(pc) << ", BTB hit, Prediction=" << predicted_taken << "\n";
+                    return predicted_taken;
+                }
+            }
+            sim.out << "Predict: PC=" << to_hex(pc) << ", No BTB entry, predict not taken\n";
+            return false; // Default: predict not taken
+        }
+
+        uint32_t get_target(uint32_t pc) {
+            for (const auto& entry : btb) {
+                if (entry.valid && entry.pc == pc) {
+                    return entry.target;
+                }
+            }
+            return pc + 4; // Default: next instruction
+        }
+
+        void update(uint32_t pc, bool taken, uint32_t target) {
+            string update_msg = "BTB Update: PC=" + to_hex(pc) + ", Taken=" + (taken ? "1" : "0") +
+                                ", Target=" + to_hex(target) + ", Prediction=" + (taken ? "1" : "0");
+            for (auto& entry : btb) {
+                if (entry.valid && entry.pc == pc) {
+                    if (entry.target == target && entry.prediction == taken) {
+                        sim.out << update_msg << " (No change)\n";
+                        if (sim.knobs.trace_instruction != -1 && sim.instruction_traces.count(sim.instruction_count) &&
+                            sim.instruction_traces[sim.instruction_count].decode_cycle == sim.stats.total_cycles) {
+                            sim.instruction_traces[sim.instruction_count].btb_updates.push_back(update_msg + " (No change)");
+                        }
+                        return;
+                    }
+                    entry.target = target;
+                    entry.prediction = taken;
+                    sim.out << update_msg << "\n";
+                    if (sim.knobs.trace_instruction != -1 && sim.instruction_traces.count(sim.instruction_count) &&
+                        sim.instruction_traces[sim.instruction_count].decode_cycle == sim.stats.total_cycles) {
+                        sim.instruction_traces[sim.instruction_count].btb_updates.push_back(update_msg);
+                    }
+                    return;
+                }
+            }
+            btb.push_back({pc, target, true, taken});
+            sim.out << update_msg << " (New entry)\n";
+            if (sim.knobs.trace_instruction != -1 && sim.instruction_traces.count(sim.instruction_count) &&
+                sim.instruction_traces[sim.instruction_count].decode_cycle == sim.stats.total_cycles) {
+                sim.instruction_traces[sim.instruction_count].btb_updates.push_back(update_msg + " (New entry)");
+            }
+        }
+
+        // BTB contents for snapshots (save and restore)
+        template <typename Archive>
+        void snapshot(Archive& ar) {
+            uint32_t count = btb.size();
+            ar(count);
+            btb.resize(count);
+            for (auto& entry : btb) {
+                ar(entry.pc);
+                ar(entry.target);
+                ar(entry.valid);
+                ar(entry.prediction);
+            }
+        }
+
+        void print_state() {
+            if (!sim.knobs.print_branch_predictor) return;
+            sim.out << "Branch Predictor State:\n";
+            if (btb.empty()) {
+                sim.out << "BTB is empty\n";
+                return;
+            }
+            for (size_t i = 0; i < btb.size(); ++i) {
+                if (btb[i].valid) {
+                    sim.out << "BTB[" << i << "]: PC=" << to_hex(btb[i].pc)
+                         << ", Target=" << to_hex(btb[i].target)
+                         << ", Prediction=" << btb[i].prediction << "\n";
+                }
+            }
+        }
+    };
+
+    ostream& out; // Log of this run
+    int instruction_count = 0;
+    bool program_done = false;
+    bool halted = false;      // Stopped at a trap without a handler
+    int interrupt_ready_since = -1; // Cycle the timer interrupt became pending and enabled, or -1
+    bool interrupted = false;       // The instruction in EX was replaced by the interrupt
+    bool memory_port_used = false;  // MEM accessed data memory this cycle, so the DMA waits
+    const BreakpointMap* debug_breakpoints = nullptr; // Set while debug_resume() runs
+    bool debug_single_step = false;
+    bool debug_interrupt = false;   // The debugger asked to stop
+    bool debug_watch = false;       // A watchpoint hit in MEM; stop before the next instruction
+    int debug_executed = 0;         // Instructions through EX since debug_resume()
+    bool debug_draining = false;    // Stopped at EX for the debugger; fetch waits for MEM and WB to drain
+
+    // Pipeline registers
+    IF_ID_Register if_id;
+    ID_EX_Register id_ex;
+    EX_MEM_Register ex_mem;
+    MEM_WB_Register mem_wb;
+
+    // Hazard/stall controls
+    bool stall_pipeline = false;
+    HazardState hazard;
+
+    map<int, InstructionTrace> instruction_traces; // Traced instructions by number
+    map<uint32_t, BranchProfile> branch_profile;   // Per-PC profile for block layout
+    unique_ptr<BranchPredictor> branch_predictor;
+    bool fork_started = false;                     // Fork marker reached
+
+    // Utility function to convert to hex string
+    static string to_hex(uint32_t val) {
+        stringstream ss;
+        ss << "0x" << setfill('0') << setw(8) << hex << uppercase << val;
+        return ss.str();
+    }
+
+    // Function to sign-extend a value
+    static int32_t sign_extend(uint32_t value, int bits) {
+        int32_t mask = 1 << (bits - 1);
+        return (value ^ mask) - mask;
+    }
+
+    // Utility function to validate hex strings
+    static bool is_valid_hex(const string& str) {
+        if (str.empty() || str.length() < 3 || str.substr(0, 2) != "0x") return false;
+        for (size_t i = 2; i < str.length(); ++i) {
+            if (!isxdigit(str[i])) return false;
+        }
+        return true;
+    }
+
+    // Write "0xPC executed taken" lines for the assembler's --profile option
+    void write_branch_profile(const string& filename) {
+        ofstream file(filename);
+        if (!file.is_open()) {
+            out << "Error: Cannot write to " << filename << endl;
+            return;
+        }
+
+        file << "# pc executed taken\n";
+        for (const auto& entry : branch_profile) {
+            file << to_hex(entry.first) << " " << entry.second.executed << " " << entry.second.taken << "\n";
+        }
+        file.close();
+    }
+
+    // Detect data hazards
+    bool detect_data_hazard() {
+        if (!knobs.enable_pipelining || !if_id.is_valid) return false;
+
+        if (if_id.ir == 0) return false;
+
+        // ecall reads a0-a2, a7 and memory outside forwarding: let older
+        // instructions leave EX and MEM first (MEM/WB writes back this cycle).
+        // CSR instructions wait too, so instret counts every older instruction.
+        if (if_id.uop.klass == CLASS_SYSTEM || if_id.uop.klass == CLASS_CSR) {
+            return id_ex.is_valid || ex_mem.is_valid;
+        }
+
+        // Registers read by the instruction in decode
+        uint32_t reads = if_id.uop.read_mask;
+
+        bool new_hazard_detected = false;
+        int stalls_needed = 0;
+
+        if (id_ex.is_valid && id_ex.ctrl.reg_write && id_ex.rd != 0) {
+            if (reads & (1u << id_ex.rd)) {
+                if (id_ex.ctrl.mem_read) {
+                    stalls_needed = 1;
+                    new_hazard_detected = true;
+                } else if (!knobs.enable_data_forwarding) {
+                    stalls_needed = 1;
+                    new_hazard_detected = true;
+                }
+            }
+        }
+
+        if (!new_hazard_detected && ex_mem.is_valid && ex_mem.ctrl.reg_write && ex_mem.rd != 0) {
+            if (reads & (1u << ex_mem.rd)) {
+                if (!knobs.enable_data_forwarding) {
+                    stalls_needed = 2;
+                    new_hazard_detected = true;
+                }
+            }
+        }
+
+        if (!new_hazard_detected && !knobs.enable_structural_hazard && 
+            mem_wb.is_valid && mem_wb.ctrl.reg_write && mem_wb.rd != 0) {
+            if (reads & (1u << mem_wb.rd)) {
+                if (!knobs.enable_data_forwarding) {
+                    stalls_needed = 3;
+                    new_hazard_detected = true;
+                }
+            }
+        }
+
+        if (new_hazard_detected) {
+            if (!hazard.is_same_hazard(if_id.pc)) {
+                stats.data_hazards++;
+                hazard.set_hazard(if_id.pc, stalls_needed);
+            }
+            stats.stalls_data_hazards++;
+            return true;
+        } else {
+            hazard.reset();
+            return false;
+        }
+    }
+
+    // Handle data forwarding
+    void determine_forwarding(uint32_t& reg_a_val, uint32_t& reg_b_val, uint32_t rs1, uint32_t rs2, int instr_number) {
+        if (!knobs.enable_data_forwarding) return;
+
+        bool forwarding_performed = false;
+        vector<string> forwarding_events;
+
+        if (ex_mem.is_valid && ex_mem.ctrl.reg_write && ex_mem.rd != 0) {
+            if (ex_mem.rd == rs1) {
+                reg_a_val = ex_mem.alu_result;
+                forwarding_performed = true;
+                string msg = "Forwarding EX/MEM to rs1 (x" + to_string(rs1) + "): " + to_string(reg_a_val);
+                out << msg << "\n";
+                forwarding_events.push_back(msg);
+            }
+            if (ex_mem.rd == rs2) {
+                reg_b_val = ex_mem.alu_result;
+                forwarding_performed = true;
+                string msg = "Forwarding EX/MEM to rs2 (x" + to_string(rs2) + "): " + to_string(reg_b_val);
+                out << msg << "\n";
+                forwarding_events.push_back(msg);
+            }
+        }
+
+        if (mem_wb.is_valid && mem_wb.ctrl.reg_write && mem_wb.rd != 0) {
+            if (mem_wb.rd == rs1 && !(ex_mem.is_valid && ex_mem.ctrl.reg_write && ex_mem.rd == rs1)) {
+                reg_a_val = mem_wb.write_data;
+                forwarding_performed = true;
+                string msg = "Forwarding MEM/WB to rs1 (x" + to_string(rs1) + "): " + to_string(reg_a_val);
+                out << msg << "\n";
+                forwarding_events.push_back(msg);
+            }
+            if (mem_wb.rd == rs2 && !(ex_mem.is_valid && ex_mem.ctrl.reg_write && ex_mem.rd == rs2)) {
+                reg_b_val = mem_wb.write_data;
+                forwarding_performed = true;
+                string msg = "Forwarding MEM/WB to rs2 (x" + to_string(rs2) + "): " + to_string(reg_b_val);
+                out << msg << "\n";
+                forwarding_events.push_back(msg);
+            }
+        }
+
+        if (forwarding_performed && knobs.trace_instruction == instr_number) {
+            instruction_traces[instr_number].forwarding_events.insert(
+                instruction_traces[instr_number].forwarding_events.end(),
+                forwarding_events.begin(), forwarding_events.end());
+        }
+    }
+
+    // Fetch stage
+    void fetch() {
+        if (syscalls.exited()) {
+            out << "Fetch: Program exited, not fetching\n";
+            return;
+        }
+        if (halted) {
+            out << "Fetch: Stopped at a trap without a handler, not fetching\n";
+            return;
+        }
+        if (watch_stopped) {
+            out << "Fetch: Stopped at a watchpoint, not fetching\n";
+            return;
+        }
+        if (debug_draining) {
+            out << "Fetch: Stopped for the debugger, not fetching\n";
+            return;
+        }
+
+        if (program_done) {
+            if (!if_id.is_valid && !id_ex.is_valid && !ex_mem.is_valid && !mem_wb.is_valid) {
+                out << "Fetch: Pipeline empty and program done\n";
+                return;
+            }
+        }
+
+        if (stall_pipeline && knobs.enable_pipelining) {
+            stats.stall_count++;
+            out << "Fetch: Stalled, keeping IF/ID unchanged\n";
+            return;
+        }
+
+        const MicroOp* fetched = text_memory.at(pc);
+        if (!fetched) {
+            out << "Fetch: No instruction at PC=" << to_hex(pc) << ", marking IF/ID invalid\n";
+            if_id = IF_ID_Register();
+            pc += 4;
+            if (!if_id.is_valid && !id_ex.is_valid && !ex_mem.is_valid && !mem_wb.is_valid) {
+                out << "Fetch: Pipeline empty and no more instructions, setting program_done\n";
+                program_done = true;
+            }
+            return;
+        }
+
+        uint32_t ir = fetched->raw;
+        if_id.pc = pc;
+        if_id.ir = ir;
+        if_id.uop = *fetched;
+        if_id.is_valid = true;
+        if_id.instr_number = ++instruction_count;
+
+        if (knobs.trace_instruction == instruction_count) {
+            instruction_traces[instruction_count].fetch_cycle = stats.total_cycles;
+            out << "\n[TRACE] Cycle " << stats.total_cycles << ": Instruction #" << instruction_count << " in Fetch Stage\n";
+            out << "  PC: " << to_hex(if_id.pc) << "\n";
+            out << "  Instruction: " << to_hex(if_id.ir) << "\n";
+            bool is_control = if_id.uop.klass == CLASS_BRANCH || if_id.uop.klass == CLASS_JUMP;
+            out << "  Instruction Type: " << (is_control ? "Control" : "Non-control") << "\n";
+            if (is_control) {
+                bool predicted_taken = branch_predictor->predict(if_id.pc);
+                out << "  Branch Prediction: " << (predicted_taken ? "Taken" : "Not Taken")
+                     << ", Predicted Target: " << to_hex(branch_predictor->get_target(if_id.pc)) << "\n";
+            }
+        }
+
+        uint32_t next_pc = pc + 4;
+        if (knobs.enable_pipelining) {
+            bool predicted_taken = branch_predictor->predict(pc);
+            if (predicted_taken) {
+                next_pc = branch_predictor->get_target(pc);
+            }
+        }
+
+        pc = next_pc;
+        out << "Fetch: PC=" << to_hex(if_id.pc) << ", IR=" << to_hex(ir) << ", Instr#=" << instruction_count
+             << ", NextPC=" << to_hex(pc) << "\n";
+    }
+
+    // Decode stage
+    void decode() {
+        if (!if_id.is_valid) {
+            id_ex = ID_EX_Register();
+            out << "Decode: IF/ID invalid, inserting bubble\n";
+            return;
+        }
+
+        if (stall_pipeline) {
+            out << "Decode: Pipeline stalled, keeping ID/EX unchanged\n";
+            return;
+        }
+
+        const MicroOp& uop = if_id.uop;
+        uint32_t ir = uop.raw;
+        id_ex.ir = ir;
+        id_ex.pc = if_id.pc;
+        id_ex.instr_number = if_id.instr_number;
+        id_ex.is_valid = true;
+
+        Control& ctrl = id_ex.ctrl;
+        ctrl = Control();
+
+        if (ir == 0) {
+            ctrl.is_nop = true;
+            out << "Decode: Invalid instruction (IR=0)\n";
+            return;
+        }
+
+        uint32_t rd = uop.rd;
+        uint32_t rs1 = uop.rs1;
+        uint32_t rs2 = uop.rs2;
+        int32_t imm = uop.imm;
+
+        int32_t reg_a_val = reg_file[rs1];
+        int32_t reg_b_val = reg_file[rs2];
+
+        determine_forwarding(reinterpret_cast<uint32_t&>(reg_a_val), reinterpret_cast<uint32_t&>(reg_b_val), rs1, rs2, id_ex.instr_number);
+
+        id_ex.rs1 = rs1;
+        id_ex.rs2 = rs2;
+        id_ex.rd = rd;
+        id_ex.reg_a_val = reg_a_val;
+        id_ex.reg_b_val = reg_b_val;
+
+        out << "Decode: PC=" << to_hex(if_id.pc) << ", IR=" << to_hex(ir) << ", rs1=x" << rs1
+             << "(" << reg_a_val << "), rs2=x" << rs2 << "(" << reg_b_val << "), rd=x" << rd << "\n";
+
+        bool is_control = false;
+        bool branch_taken = false;
+        uint32_t branch_target = if_id.pc + 4;
+
+        ctrl.alu_op = uop.op;
+        ctrl.use_imm = uop.use_imm;
+        switch (uop.klass) {
+            case CLASS_ALU:
+                ctrl.reg_write = true;
+                stats.alu_instructions++;
+                if (uop.op == OP_LUI || uop.op == OP_AUIPC) {
+                    out << "Decode " << op_name(uop.op) << ": rd=x" << rd << ", imm=" << to_hex(imm) << "\n";
+                }
+                break;
+            case CLASS_LOAD:
+                ctrl.reg_write = true;
+                ctrl.mem_read = true;
+                ctrl.output_sel = 1;
+                stats.data_transfer_instructions++;
+                break;
+            case CLASS_STORE:
+                ctrl.mem_write = true;
+                stats.data_transfer_instructions++;
+                break;
+            case CLASS_BRANCH:
+                ctrl.branch = true;
+                id_ex.rd = 0;
+                is_control = true;
+                stats.control_instructions++;
+                branch_taken = ::branch_taken(uop.op, reg_a_val, reg_b_val);
+                branch_target = branch_taken ? if_id.pc + imm : if_id.pc + 4;
+                out << "Decode " << op_name(uop.op) << ": rs1=x" << rs1 << "(" << reg_a_val << "), rs2=x" << rs2
+                     << "(" << reg_b_val << "), Taken=" << branch_taken << ", Target=" << to_hex(branch_target) << "\n";
+                break;
+            case CLASS_JUMP:
+                ctrl.reg_write = true;
+                ctrl.output_sel = 2;
+                is_control = true;
+                stats.control_instructions++;
+                branch_taken = true;
+                if (uop.op == OP_JAL) {
+                    branch_target = if_id.pc + imm;
+                    out << "Decode JAL: rd=x" << rd << ", Target=" << to_hex(branch_target) << "\n";
+                } else {
+                    branch_target = (reg_a_val + imm) & ~1;
+                    out << "Decode JALR: rs1=x" << rs1 << "(" << reg_a_val << "), imm=" << imm
+                         << ", Target=" << to_hex(branch_target) << "\n";
+                }
+                break;
+            case CLASS_SYSTEM:
+                ctrl.reg_write = true;
+                out << "Decode ECALL: a7=" << reg_file[17] << "\n";
+                break;
+            case CLASS_ATOMIC:
+                // Read-modify-write in MEM; the old value goes to rd like a load
+                ctrl.reg_write = true;
+                ctrl.mem_read = true;
+                ctrl.output_sel = 1;
+                stats.data_transfer_instructions++;
+                break;
+            case CLASS_CSR:
+                ctrl.reg_write = true;
+                break;
+            case CLASS_PRIV:
+                // Handled in EX: ebreak traps, mret returns to mepc, wfi is a nop
+                if (uop.op == OP_MRET) stats.control_instructions++;
+                break;
+            default:
+                ctrl.is_nop = true;
+                out << "Decode: Unknown instruction " << to_hex(ir) << ", opcode=0x" << hex << (ir & 0x7F)
+                     << ", func3=0x" << ((ir >> 12) & 0x7) << ", func7=0x" << ((ir >> 25) & 0x7F) << dec << "\n";
+                break;
+        }
+
+        id_ex.imm = imm;
+
+        // Decode sees every correct-path instruction exactly once
+        BranchProfile& profile = branch_profile[if_id.pc];
+        profile.executed++;
+        if (is_control && branch_taken) profile.taken++;
+
+        if (knobs.trace_instruction == id_ex.instr_number) {
+            string instr_str = disassemble(uop);
+            instruction_traces[id_ex.instr_number].decode_cycle = stats.total_cycles;
+            instruction_traces[id_ex.instr_number].decode_instruction = instr_str;
+            out << "\n[TRACE] Cycle " << stats.total_cycles << ": Instruction #" << id_ex.instr_number << " in Decode Stage\n";
+            out << "  PC: " << to_hex(id_ex.pc) << "\n";
+            out << "  Decoded Instruction: " << instr_str << "\n";
+            out << "  Source Registers: rs1=x" << id_ex.rs1 << "(" << id_ex.reg_a_val 
+                 << "), rs2=x" << id_ex.rs2 << "(" << id_ex.reg_b_val << ")\n";
+            out << "  Destination Register: rd=x" << id_ex.rd << "\n";
+            out << "  Immediate: " << id_ex.imm << "\n";
+            if (instruction_traces[id_ex.instr_number].forwarding_events.size() > 0) {
+                out << "  Data Forwarding:\n";
+                for (const auto& event : instruction_traces[id_ex.instr_number].forwarding_events) {
+                    out << "    - " << event << "\n";
+                }
+            } else {
+                out << "  Data Forwarding: None\n";
+            }
+            if (stall_pipeline) {
+                out << "  Data Hazard Detected!\n";
+                out << "  Forwarding Enabled: " << (knobs.enable_data_forwarding ? "Yes" : "No") << "\n";
+            }
+            if (is_control) {
+                bool predicted_taken = branch_predictor->predict(id_ex.pc);
+                uint32_t predicted_target = predicted_taken ? branch_predictor->get_target(id_ex.pc) : id_ex.pc + 4;
+                out << "  Branch Outcome: " << (branch_taken ? "Taken" : "Not Taken") 
+                     << ", Actual Target: " << to_hex(branch_target) << "\n";
+                out << "  Prediction: " << (predicted_taken ? "Taken" : "Not Taken") 
+                     << ", Predicted Target: " << to_hex(predicted_target) << "\n";
+                if (branch_taken != predicted_taken || (branch_taken && branch_target != predicted_target)) {
+                    out << "  Misprediction: Pipeline will be flushed\n";
+                } else {
+                    out << "  Prediction Correct\n";
+                }
+            }
+        }
+
+        if (is_control) {
+            uint32_t current_pc = if_id.pc;
+            if (knobs.enable_pipelining) {
+                bool predicted_taken = branch_predictor->predict(if_id.pc);
+                uint32_t predicted_target = predicted_taken ? branch_predictor->get_target(if_id.pc) : if_id.pc + 4;
+
+                if (branch_taken != predicted_taken || (branch_taken && branch_target != predicted_target)) {
+                    out << "Misprediction: Flushing pipeline, ActualTarget=" << to_hex(branch_target)
+                         << ", PredictedTarget=" << to_hex(predicted_target) << "\n";
+                    pc = branch_target;
+                    if_id = IF_ID_Register();
+                    stall_pipeline = true;
+                    stats.branch_mispredictions++;
+                    stats.control_hazards++;
+                    stats.stalls_control_hazards++;
+                } else {
+                    out << "Prediction correct: Taken=" << branch_taken << ", Target=" << to_hex(branch_target) << "\n";
+                }
+
+                branch_predictor->update(current_pc, branch_taken, branch_target);
+            } else {
+                pc = branch_target;
+                if_id = IF_ID_Register();
+                branch_predictor->update(current_pc, branch_taken, branch_target);
+                out << "Non-pipelined: Setting PC to " << to_hex(branch_target) << ", Taken=" << branch_taken << endl;
+            }
+        }
+    }
+
+    // Instructions past EX that have not retired, once MEM has run this cycle
+    int unretired() const { return mem_wb.is_valid && !mem_wb.ctrl.is_nop ? 1 : 0; }
+
+    // One DMA cycle at the end of the cycle; it loses the cycle if MEM used
+    // the memory port. The lockstep reference gets the bytes once the
+    // instructions that ran MEM before them have retired.
+    void tick_dma() {
+        uint32_t chunk_addr;
+        vector<uint8_t> chunk;
+        dma.tick(data_memory, !memory_port_used, chunk_addr, chunk);
+        if (chunk.empty()) return;
+        if (lockstep) lockstep->dma_write_at(unretired(), chunk_addr, chunk);
+        if (!dma.busy) {
+            out << "DMA: Copied " << dma.length << " bytes from " << to_hex(dma.src) << " to " << to_hex(dma.dst) << "\n";
+        }
+    }
+
+    // Take a pending interrupt before the instruction in EX, which becomes a
+    // bubble and is where mret returns to; older instructions still retire.
+    // Called at the start of execute(), after an older CSR write has landed.
+    void take_interrupt() {
+        csrs.mip = (clint.pending(stats.total_cycles) ? MIP_MTIP : 0) | (bus.interrupt() ? MIP_MEIP : 0);
+        uint32_t cause = csrs.pending_interrupt();
+        if (!cause) {
+            interrupt_ready_since = -1;
+            return;
+        }
+        if (interrupt_ready_since < 0) interrupt_ready_since = stats.total_cycles;
+        if (!id_ex.is_valid || id_ex.ctrl.is_nop || halted) return;
+
+        int latency = stats.total_cycles - interrupt_ready_since;
+        stats.interrupts++;
+        stats.interrupt_latency_total += latency;
+        stats.interrupt_latency_max = max(stats.interrupt_latency_max, latency);
+        interrupt_ready_since = -1;
+        if (lockstep) lockstep->interrupt_at(unretired(), cause);
+
+        pc = csrs.trap(cause, id_ex.pc, 0);
+        out << "Execute: Interrupt (" << trap_name(cause) << ") before " << to_hex(id_ex.pc) << " after " << latency
+             << " cycle(s), entering handler at " << to_hex(pc) << "\n";
+        id_ex.ctrl = Control();
+        id_ex.ctrl.is_nop = true;
+        if_id = IF_ID_Register();
+        interrupted = true;
+    }
+
+    // The instruction in EX raises an exception: it does not retire, younger
+    // instructions are squashed and fetch goes on at the handler. Without a
+    // handler (mtvec is 0) the run stops here.
+    void raise_exception(uint32_t cause, uint32_t tval) {
+        id_ex.ctrl = Control();
+        id_ex.ctrl.is_nop = true;
+        if_id = IF_ID_Register();
+        if (!csrs.has_handler()) {
+            out << "Error: Unhandled " << trap_name(cause) << " at " << to_hex(id_ex.pc)
+                 << " (mtvec is 0), squashing younger instructions\n";
+            pc = id_ex.pc;
+            halted = program_done = true;
+            return;
+        }
+        stats.traps++;
+        pc = csrs.trap(cause, id_ex.pc, tval);
+        out << "Execute: Trap (" << trap_name(cause) << ") at " << to_hex(id_ex.pc)
+             << ", entering handler at " << to_hex(pc) << "\n";
+    }
+
+    // Stop before the instruction in EX for the debugger (debug_resume()):
+    // it and everything younger are dropped and fetch goes on from its PC
+    // once resumed. One bit test per instruction when only breakpoints are set.
+    bool debug_stop() {
+        if (!id_ex.is_valid || interrupted || (id_ex.ctrl.is_nop && id_ex.ir == 0)) return false;
+        if (!debug_interrupt && !debug_watch &&
+            (debug_executed == 0 || (!debug_single_step && !debug_breakpoints->hit(id_ex.pc)))) {
+            debug_executed++;
+            return false;
+        }
+        pc = id_ex.pc;
+        out << "Execute: Stopped for the debugger before " << to_hex(pc) << ", draining\n";
+        if_id = IF_ID_Register();
+        id_ex = ID_EX_Register();
+        ex_mem = EX_MEM_Register();
+        debug_draining = true;
+        return true;
+    }
+
+    // Execute stage
+    void execute() {
+        take_interrupt();
+        if (debug_breakpoints && debug_stop()) return;
+        if (!id_ex.is_valid) {
+            ex_mem = EX_MEM_Register();
+            out << "Execute: ID/EX invalid, skipping\n";
+            return;
+        }
+
+        out << "Execute: PC=" << to_hex(id_ex.pc) << ", IR=" << to_hex(id_ex.ir) << ", ALU=" << op_name(id_ex.ctrl.alu_op) << "\n";
+
+        int32_t reg_a_val = id_ex.reg_a_val;
+        int32_t reg_b_val = id_ex.reg_b_val;
+        determine_forwarding(reinterpret_cast<uint32_t&>(reg_a_val), reinterpret_cast<uint32_t&>(reg_b_val), id_ex.rs1, id_ex.rs2, id_ex.instr_number);
+
+        int32_t alu_result = 0;
+
+        if (id_ex.ctrl.is_nop && id_ex.ir != 0 && !interrupted) {
+            raise_exception(CAUSE_ILLEGAL_INSTRUCTION, id_ex.ir);
+        }
+        interrupted = false;
+
+        if (id_ex.ctrl.is_nop) {
+            out << "Execute: NOP\n";
+            goto alu_done;
+        }
+
+        switch (id_ex.ctrl.alu_op) {
+            case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+            case OP_SB: case OP_SH: case OP_SW: case OP_JALR:
+            case OP_LR_W: case OP_SC_W: case OP_AMOSWAP_W: case OP_AMOADD_W: case OP_AMOXOR_W: case OP_AMOAND_W:
+            case OP_AMOOR_W: case OP_AMOMIN_W: case OP_AMOMAX_W: case OP_AMOMINU_W: case OP_AMOMAXU_W:
+                alu_result = reg_a_val + id_ex.imm; // Atomics have imm 0
+                break;
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE:
+                alu_result = id_ex.pc + id_ex.imm;
+                break;
+            case OP_JAL:
+                alu_result = id_ex.pc + 4;
+                break;
+            case OP_ECALL:
+                // Older instructions have all retired, so the register file is current
+                alu_result = syscalls.call(reg_file[17], reg_file[10], reg_file[11], reg_file[12], stats.total_cycles);
+                if (lockstep) lockstep->syscall_at(stats.total_cycles);
+                if (syscalls.exited()) {
+                    out << "Execute: Program exited with code " << syscalls.exitCode() << ", squashing younger instructions\n";
+                    if_id = IF_ID_Register();
+                    program_done = true;
+                }
+                break;
+            case OP_CSRRW: case OP_CSRRS: case OP_CSRRC: case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI: {
+                // Serialized like ecall: the counters cover every older instruction
+                CounterValues raw = counters();
+                MicroOp uop = predecode(id_ex.ir);
+                uint32_t old;
+                if (!csrs.execute(uop, reg_a_val, raw, old)) {
+                    out << "Execute: Illegal instruction " << disassemble(uop) << " at " << to_hex(id_ex.pc) << "\n";
+                    raise_exception(CAUSE_ILLEGAL_INSTRUCTION, id_ex.ir);
+                    break;
+                }
+                alu_result = old;
+                if (lockstep) lockstep->counters_at(raw);
+                break;
+            }
+            case OP_EBREAK:
+                raise_exception(CAUSE_BREAKPOINT, id_ex.pc);
+                break;
+            case OP_MRET:
+                pc = csrs.mret();
+                if_id = IF_ID_Register();
+                out << "Execute: MRET to " << to_hex(pc) << ", squashing younger instructions\n";
+                break;
+            case OP_WFI:
+                break;
+            default:
+                alu_result = ::alu_result(id_ex.ctrl.alu_op, reg_a_val, id_ex.ctrl.use_imm ? id_ex.imm : reg_b_val, id_ex.pc);
+                break;
+        }
+    alu_done:
+        ex_mem.pc = id_ex.pc;
+        ex_mem.alu_result = alu_result;
+        ex_mem.rs2_val = reg_b_val;
+        ex_mem.rd = id_ex.rd;
+        ex_mem.ctrl = id_ex.ctrl;
+        ex_mem.is_valid = true;
+        ex_mem.instr_number = id_ex.instr_number;
+
+        if (knobs.trace_instruction == ex_mem.instr_number) {
+            instruction_traces[ex_mem.instr_number].execute_cycle = stats.total_cycles;
+            out << "\n[TRACE] Cycle " << stats.total_cycles << ": Instruction #" << ex_mem.instr_number << " in Execute Stage\n";
+            out << "  PC: " << to_hex(ex_mem.pc) << "\n";
+            out << "  ALU Operation: " << op_name(id_ex.ctrl.alu_op) << "\n";
+            out << "  ALU Result: " << alu_result << "\n";
+            out << "  Control Signals: "
+                 << (ex_mem.ctrl.reg_write ? "RegWrite " : "")
+                 << (ex_mem.ctrl.mem_read ? "MemRead " : "")
+                 << (ex_mem.ctrl.mem_write ? "MemWrite " : "") << "\n";
+            if (id_ex.ctrl.use_imm) {
+                out << "  Immediate Used: " << id_ex.imm << "\n";
+            }
+            if (instruction_traces[ex_mem.instr_number].forwarding_events.size() > 0) {
+                out << "  Data Forwarding:\n";
+                for (const auto& event : instruction_traces[ex_mem.instr_number].forwarding_events) {
+                    out << "    - " << event << "\n";
+                }
+            } else {
+                out << "  Data Forwarding: None\n";
+            }
+        }
+
+        id_ex = ID_EX_Register();
+    }
+
+    // Memory stage
+    void memory() {
+        memory_port_used = false;
+        if (!ex_mem.is_valid) {
+            mem_wb = MEM_WB_Register();
+            out << "Memory: EX/MEM invalid, skipping\n";
+            return;
+        }
+
+        int32_t mem_result = ex_mem.alu_result;
+
+        if (ex_mem.ctrl.mem_read && MmioBus::contains(ex_mem.alu_result) && !is_atomic(ex_mem.ctrl.alu_op)) {
+            // Devices see this cycle's counters (mtime included); so does the reference
+            uint32_t addr = ex_mem.alu_result;
+            Op op = ex_mem.ctrl.alu_op;
+            CounterValues raw = counters();
+            mem_result = extend_load(op, bus.read(addr, load_size(op), MmioContext{raw, out}));
+            if (lockstep) {
+                lockstep->counters_at(raw);
+                lockstep->mmio_load_at(mem_result);
+            }
+            out << "Memory: Read " << op_name(op) << " from " << bus.name(addr) << " " << to_hex(addr) << ": "
+                 << to_hex(mem_result) << "\n";
+        } else if (ex_mem.ctrl.mem_read) {
+            uint32_t addr = ex_mem.alu_result;
+            Op op = ex_mem.ctrl.alu_op;
+            int size = load_size(op);
+            bool watched = watches.flagged(addr, size);
+            uint32_t old_value = watched ? data_memory.readValue(addr, size) : 0;
+            switch (ex_mem.ctrl.alu_op) {
+                case OP_LB: mem_result = sign_extend(data_memory.read8(addr), 8); break;
+                case OP_LH: mem_result = sign_extend(data_memory.read16(addr), 16); break;
+                case OP_LBU: mem_result = data_memory.read8(addr); break;
+                case OP_LHU: mem_result = data_memory.read16(addr); break;
+                case OP_LW: mem_result = data_memory.read32(addr); break;
+                default: mem_result = atomic_execute(data_memory, reservation, ex_mem.ctrl.alu_op, addr, ex_mem.rs2_val); break;
+            }
+            memory_port_used = true;
+            if (!data_memory.isMapped(addr)) {
+                out << "Warning: Memory read at address " << to_hex(addr) << " found no data, returning 0\n";
+            }
+            if (watched) {
+                // An AMO also writes; SC.W writes unless it failed, and does not read
+                bool write = is_atomic(op) && op != OP_LR_W && !(op == OP_SC_W && mem_result != 0);
+                watch_access(addr, size, op != OP_SC_W, write, old_value);
+            }
+        } else if (ex_mem.ctrl.mem_write && MmioBus::contains(ex_mem.alu_result)) {
+            uint32_t addr = ex_mem.alu_result;
+            CounterValues raw = counters();
+            out << "Memory: Wrote " << op_name(ex_mem.ctrl.alu_op) << " to " << bus.name(addr) << " " << to_hex(addr)
+                 << ": " << to_hex(ex_mem.rs2_val) << "\n";
+            bus.write(addr, ex_mem.rs2_val, store_size(ex_mem.ctrl.alu_op), MmioContext{raw, out});
+            if (lockstep) lockstep->counters_at(raw);
+            if (syscalls.exited()) {
+                // Test finisher: nothing younger has reached EX yet
+                out << "Memory: Program exited with code " << syscalls.exitCode() << ", squashing younger instructions\n";
+                id_ex = ID_EX_Register();
+                if_id = IF_ID_Register();
+                program_done = true;
+            }
+        } else if (ex_mem.ctrl.mem_write) {
+            uint32_t addr = ex_mem.alu_result;
+            int32_t value = ex_mem.rs2_val;
+            int size = store_size(ex_mem.ctrl.alu_op);
+            bool watched = watches.flagged(addr, size);
+            uint32_t old_value = watched ? data_memory.readValue(addr, size) : 0;
+            switch (ex_mem.ctrl.alu_op) {
+                case OP_SB: data_memory.write8(addr, value & 0xFF); break;
+                case OP_SH: data_memory.write16(addr, value & 0xFFFF); break;
+                default: data_memory.write32(addr, value); break;
+            }
+            memory_port_used = true;
+            if (watched) watch_access(addr, size, false, true, old_value);
+        }
+
+        mem_wb.pc = ex_mem.pc;
+        mem_wb.write_data = ex_mem.ctrl.output_sel == 1 ? mem_result : ex_mem.alu_result;
+        mem_wb.mem_addr = ex_mem.alu_result;
+        mem_wb.rd = ex_mem.rd;
+        mem_wb.ctrl = ex_mem.ctrl;
+        mem_wb.is_valid = true;
+        mem_wb.instr_number = ex_mem.instr_number;
+
+        if (knobs.trace_instruction == mem_wb.instr_number) {
+            instruction_traces[mem_wb.instr_number].memory_cycle = stats.total_cycles;
+            out << "\n[TRACE] Cycle " << stats.total_cycles << ": Instruction #" << mem_wb.instr_number << " in Memory Stage\n";
+            out << "  PC: " << to_hex(mem_wb.pc) << "\n";
+            out << "  Instruction: " << instruction_traces[mem_wb.instr_number].decode_instruction << "\n";
+            out << "  Control Signals: "
+                 << (ex_mem.ctrl.mem_read ? "MemRead " : "")
+                 << (ex_mem.ctrl.mem_write ? "MemWrite " : "")
+                 << (ex_mem.ctrl.reg_write ? "RegWrite " : "") << "\n";
+            if (ex_mem.ctrl.mem_read) {
+                out << "  Memory Operation: Read\n";
+                out << "  Address: " << to_hex(ex_mem.alu_result) << "\n";
+                out << "  Data Read: " << mem_result << " (" << op_name(ex_mem.ctrl.alu_op) << ")\n";
+            } else if (ex_mem.ctrl.mem_write) {
+                out << "  Memory Operation: Write\n";
+                out << "  Address: " << to_hex(ex_mem.alu_result) << "\n";
+                out << "  Data Written: " << ex_mem.rs2_val << " (" << op_name(ex_mem.ctrl.alu_op) << ")\n";
+            } else {
+                out << "  Memory Operation: None\n";
+            }
+            out << "  Write Data (for WB): " << mem_wb.write_data << "\n";
+            if (!instruction_traces[mem_wb.instr_number].forwarding_events.empty()) {
+                out << "  Data Forwarding:\n";
+                for (const auto& event : instruction_traces[mem_wb.instr_number].forwarding_events) {
+                    out << "    - " << event << "\n";
+                }
+            } else {
+                out << "  Data Forwarding: None\n";
+            }
+        }
+
+        ex_mem = EX_MEM_Register();
+        out << "Memory: PC=" << to_hex(mem_wb.pc) << ", Instr#=" << mem_wb.instr_number << "\n";
+    }
+
+    // The slow path of an access to a watched page (Watchpoints.h) by the
+    // instruction in MEM; old_value is what memory held before it. A hit that
+    // stops ends the run like the test finisher or, under the debugger, stops
+    // before the next instruction.
+    void watch_access(uint32_t addr, int size, bool read, bool write, uint32_t old_value) {
+        uint32_t new_value = data_memory.readValue(addr, size);
+        if (!watches.check(out, ex_mem.pc, stats.total_cycles + 1, addr, size, read, write, old_value, new_value)) return;
+        if (debug_breakpoints) {
+            debug_watch = true;
+            return;
+        }
+        out << "Memory: Watchpoint hit, squashing younger instructions\n";
+        id_ex = ID_EX_Register();
+        if_id = IF_ID_Register();
+        program_done = watch_stopped = true;
+    }
+
+    // Writeback stage
+    void writeback() {
+        if (!mem_wb.is_valid) {
+            out << "Writeback: MEM/WB invalid, skipping\n";
+            return;
+        }
+
+        if (!mem_wb.ctrl.is_nop) {
+            stats.total_instructions++;
+            out << "Total Instructions are: " << stats.total_instructions << endl;
+        }
+
+        if (mem_wb.ctrl.reg_write && mem_wb.rd != 0) {
+            if (mem_wb.ctrl.output_sel == 2) {
+                reg_file[mem_wb.rd] = mem_wb.pc + 4;
+            } else {
+                reg_file[mem_wb.rd] = mem_wb.write_data;
+            }
+            out << "Writeback: x" << mem_wb.rd << " = " << to_hex(mem_wb.write_data) << "\n";
+        }
+
+        if (lockstep && !mem_wb.ctrl.is_nop) {
+            Retirement retired;
+            retired.pc = mem_wb.pc;
+            if (mem_wb.ctrl.reg_write && mem_wb.rd != 0) {
+                retired.rd = mem_wb.rd;
+                retired.value = reg_file[mem_wb.rd];
+            }
+            if (mem_wb.ctrl.mem_write || is_atomic(mem_wb.ctrl.alu_op)) {
+                retired.store = true;
+                retired.addr = mem_wb.mem_addr;
+                retired.size = store_size(mem_wb.ctrl.alu_op);
+            }
+            if (!lockstep->retire(retired, data_memory, stats.total_cycles)) program_done = true;
+        }
+
+        if (knobs.trace_instruction == mem_wb.instr_number) {
+            instruction_traces[mem_wb.instr_number].writeback_cycle = stats.total_cycles;
+            out << "\n[TRACE] Cycle " << stats.total_cycles << ": Instruction #" << mem_wb.instr_number << " in Writeback Stage\n";
+            out << "  PC: " << to_hex(mem_wb.pc) << "\n";
+            out << "  Instruction: " << instruction_traces[mem_wb.instr_number].decode_instruction << "\n";
+            out << "  Control Signals: " << (mem_wb.ctrl.reg_write ? "RegWrite" : "None") << "\n";
+            out << "  Write Data: " << mem_wb.write_data << "\n";
+            out << "  Writing to Register: " << (mem_wb.ctrl.reg_write ? "Yes (x" + to_string(mem_wb.rd) + ")" : "No") << "\n";
+            if (mem_wb.ctrl.reg_write && mem_wb.rd != 0) {
+                out << "  Register x" << mem_wb.rd << " updated to: " << reg_file[mem_wb.rd] << "\n";
+            }
+            if (!instruction_traces[mem_wb.instr_number].forwarding_events.empty()) {
+                out << "  Data Forwarding:\n";
+                for (const auto& event : instruction_traces[mem_wb.instr_number].forwarding_events) {
+                    out << "    - " << event << "\n";
+                }
+            } else {
+                out << "  Data Forwarding: None\n";
+            }
+        }
+
+        out << "Writeback: PC=" << to_hex(mem_wb.pc) << ", Instr#=" << mem_wb.instr_number << "\n";
+        mem_wb = MEM_WB_Register();
+    }
+
+    // Print pipeline registers
+    void print_pipeline_registers() {
+        if (!knobs.print_pipeline_regs) return;
+        out << "\nPipeline Registers:\n";
+        out << "IF/ID: " << (if_id.is_valid ? "PC=" + to_hex(if_id.pc) + ", IR=" + to_hex(if_id.ir) +
+                                      ", Instr#=" + to_string(if_id.instr_number) : "INVALID") << "\n";
+        out << "ID/EX: ";
+        if (id_ex.is_valid) {
+            out << "PC=" << to_hex(id_ex.pc) << ", rs1=x" << id_ex.rs1 << "(" << id_ex.reg_a_val
+                 << "), rs2=x" << id_ex.rs2 << "(" << id_ex.reg_b_val << "), rd=x" << id_ex.rd
+                 << ", imm=" << id_ex.imm << ", ALU=" << op_name(id_ex.ctrl.alu_op) << ", Instr#=" << id_ex.instr_number;
+        } else {
+            out << "INVALID";
+        }
+        out << "\n";
+        out << "EX/MEM: ";
+        if (ex_mem.is_valid) {
+            out << "PC=" << to_hex(ex_mem.pc) << ", ALU=" << ex_mem.alu_result << ", rs2_val=" << ex_mem.rs2_val
+                 << ", rd=x" << ex_mem.rd << ", Ctrl=" << (ex_mem.ctrl.mem_read ? "MemRead " : "")
+                 << (ex_mem.ctrl.mem_write ? "MemWrite " : "") << (ex_mem.ctrl.reg_write ? "RegWrite " : "")
+                 << "Instr#=" << ex_mem.instr_number;
+        } else {
+            out << "INVALID";
+        }
+        out << "\n";
+        out << "MEM/WB: ";
+        if (mem_wb.is_valid) {
+            out << "PC=" << to_hex(mem_wb.pc) << ", WData=" << mem_wb.write_data << ", rd=x" << mem_wb.rd
+                 << ", Ctrl=" << (mem_wb.ctrl.reg_write ? "RegWrite " : "") << "Instr#=" << mem_wb.instr_number;
+        } else {
+            out << "INVALID";
+        }
+        out << "\n";
+    }
+
+    // Initialize tracing
+    void initialize_tracing() {
+        instruction_traces.clear();
+        if (knobs.trace_instruction != -1) {
+            out << "Instruction tracing enabled for instruction #" << knobs.trace_instruction << "\n";
+        }
+    }
+
+    // Trace instruction (summary)
+    void trace_instruction(int instr_number) {
+        if (instr_number == -1 || instruction_traces.find(instr_number) == instruction_traces.end()) {
+            out << "\nNo tracing data available for instruction #" << instr_number << "\n";
+            return;
+        }
+
+        out << "\n=== Trace Summary for Instruction #" << instr_number << " ===\n";
+        const InstructionTrace& trace = instruction_traces[instr_number];
+    
+        out << "Fetch Cycle: " << (trace.fetch_cycle != -1 ? to_string(trace.fetch_cycle) : "N/A") << "\n";
+        out << "Decode Cycle: " << (trace.decode_cycle != -1 ? to_string(trace.decode_cycle) : "N/A") << "\n";
+        if (trace.decode_cycle != -1 && !trace.decode_instruction.empty()) {
+            out << "  Decoded Instruction: " << trace.decode_instruction << "\n";
+            if (!trace.forwarding_events.empty()) {
+                out << "  Data Forwarding Events:\n";
+                for (const auto& event : trace.forwarding_events) {
+                    out << "    - " << event << "\n";
+                }
+            } else {
+                out << "  Data Forwarding: None\n";
+            }
+            if (!trace.btb_updates.empty()) {
+                out << "  BTB Updates:\n";
+                for (const auto& update : trace.btb_updates) {
+                    out << "    - " << update << "\n";
+                }
+            } else {
+                out << "  BTB Updates: None\n";
+            }
+        }
+        out << "Execute Cycle: " << (trace.execute_cycle != -1 ? to_string(trace.execute_cycle) : "N/A") << "\n";
+        out << "Memory Cycle: " << (trace.memory_cycle != -1 ? to_string(trace.memory_cycle) : "N/A") << "\n";
+        out << "Writeback Cycle: " << (trace.writeback_cycle != -1 ? to_string(trace.writeback_cycle) : "N/A") << "\n";
+    }
+
+    // Pipeline state for snapshots: one function serves SnapshotWriter and
+    // SnapshotReader, so saved and restored fields cannot drift apart.
+    // Instruction traces and the branch profile cover the current run only.
+    template <typename Archive>
+    void snapshot_control(Archive& ar, Control& c) {
+        ar(c.mem_read); ar(c.mem_write); ar(c.reg_write); ar(c.branch); ar(c.use_imm);
+        ar(c.output_sel); ar(c.alu_op); ar(c.is_nop);
+    }
+
+    template <typename Archive>
+    void snapshot_pipeline(Archive& ar) {
+        ar(if_id.pc); ar(if_id.ir); ar(if_id.is_valid); ar(if_id.instr_number);
+        ar(id_ex.pc); ar(id_ex.ir); ar(id_ex.reg_a_val); ar(id_ex.reg_b_val); ar(id_ex.imm);
+        ar(id_ex.rs1); ar(id_ex.rs2); ar(id_ex.rd); snapshot_control(ar, id_ex.ctrl);
+        ar(id_ex.is_valid); ar(id_ex.instr_number);
+        ar(ex_mem.pc); ar(ex_mem.alu_result); ar(ex_mem.rs2_val); ar(ex_mem.rd); snapshot_control(ar, ex_mem.ctrl);
+        ar(ex_mem.is_valid); ar(ex_mem.instr_number);
+        ar(mem_wb.pc); ar(mem_wb.write_data); ar(mem_wb.rd); snapshot_control(ar, mem_wb.ctrl);
+        ar(mem_wb.is_valid); ar(mem_wb.instr_number);
+        ar(hazard.current_hazard_pc); ar(hazard.stall_cycles_remaining);
+        ar(stats.total_cycles); ar(stats.total_instructions); ar(stats.data_transfer_instructions);
+        ar(stats.alu_instructions); ar(stats.control_instructions); ar(stats.stall_count);
+        ar(stats.data_hazards); ar(stats.control_hazards); ar(stats.branch_mispredictions);
+        ar(stats.stalls_data_hazards); ar(stats.stalls_control_hazards);
+        ar(instruction_count); ar(program_done); ar(stall_pipeline);
+        branch_predictor->snapshot(ar);
+    }
+
+    bool at_fork_marker() {
+        if (fork_started || variants.empty()) return false;
+        if (knobs.fork_at_cycle >= 0 && stats.total_cycles >= knobs.fork_at_cycle) return true;
+        return knobs.fork_at_pc >= 0 && pc == static_cast<uint32_t>(knobs.fork_at_pc);
+    }
+
+    // Apply one run's knobs and input patches in its forked child
+    void apply_variant(const RunVariant& variant) {
+        for (const auto& setting : variant.settings) {
+            if (!apply_setting(setting.first, setting.second)) {
+                out << "Warning: Unknown setting " << setting.first << " for run " << variant.name << "\n";
+            }
+        }
+        for (const auto& patch : variant.patches) {
+            data_memory.writeValue(patch.first, stoull(patch.second, nullptr, 16), (patch.second.length() - 1) / 2);
+        }
+        data_writeback.setFilename("data." + variant.name + ".mc");
+        knobs.branch_profile_file = "";
+        knobs.save_state_file = "";
+        knobs.save_at_cycle = -1;
+        out << "Run " << variant.name << " forked at cycle " << stats.total_cycles << ", PC " << to_hex(pc) << "\n";
+    }
+
+    // Reached the marker: fork every run from this state. Children return and
+    // keep simulating; the parent waits, prints their statistics and exits.
+    void start_fork_server() {
+        fork_started = true;
+        int jobs = knobs.fork_jobs > 0 ? knobs.fork_jobs : static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+        out << "Fork server: " << variants.size() << " runs from cycle " << stats.total_cycles
+             << ", PC " << to_hex(pc) << ", " << jobs << " at a time\n";
+        vector<string> reports;
+        int index = forkVariants(variants, jobs, reports);
+        if (index >= 0) {
+            apply_variant(variants[index]);
+            return;
+        }
+
+        out << "\nFork Server Results (shared prefix: " << stats.total_cycles << " cycles):\n";
+        out << setfill(' ') << left << setw(16) << "Run" << right << setw(10) << "Cycles" << setw(14) << "Instructions" << setw(8) << "CPI"
+             << setw(8) << "Stalls" << setw(13) << "Data Hazards" << setw(16) << "Mispredictions" << "\n";
+        int failed = 0;
+        for (size_t i = 0; i < variants.size(); i++) {
+            out << left << setw(16) << variants[i].name << right;
+            stringstream ss(reports[i]);
+            int cycles, instructions, stalls, hazards, mispredictions;
+            if (!(ss >> cycles >> instructions >> stalls >> hazards >> mispredictions)) {
+                out << "  failed, see " << variants[i].name << ".log\n";
+                failed++;
+                continue;
+            }
+            double cpi = instructions > 0 ? static_cast<double>(cycles) / instructions : 0;
+            out << setw(10) << cycles << setw(14) << instructions << setw(8) << fixed << setprecision(3) << cpi
+                 << setw(8) << stalls << setw(13) << hazards << setw(16) << mispredictions << "\n";
+        }
+        exit(failed ? 1 : 0);
+    }
+};
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef PREDECODER_H
+#define PREDECODER_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+#include "Riscv_Instructions.h"
+
+using namespace std;
+
+// Every operation the simulators execute. Names match the mnemonics, so
+// op_name() gives the upper-case form used in simulator logs.
+enum Op : uint8_t {
+    OP_INVALID,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_REM, OP_AND, OP_OR, OP_XOR,
+    OP_SLL, OP_SRL, OP_SRA, OP_SLT,
+    OP_ADDI, OP_ANDI, OP_ORI, OP_XORI, OP_SLTI, OP_SLTIU, OP_SLLI, OP_SRLI, OP_SRAI,
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+    OP_SB, OP_SH, OP_SW,
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE,
+    OP_JAL, OP_JALR, OP_LUI, OP_AUIPC,
+    OP_ECALL,
+    OP_LR_W, OP_SC_W, OP_AMOSWAP_W, OP_AMOADD_W, OP_AMOXOR_W, OP_AMOAND_W, OP_AMOOR_W,
+    OP_AMOMIN_W, OP_AMOMAX_W, OP_AMOMINU_W, OP_AMOMAXU_W,
+    OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI,
+    OP_EBREAK, OP_MRET, OP_WFI,
+    OP_COUNT
+};
+
+const char* const OP_NAMES[OP_COUNT] = {
+    "INVALID",
+    "ADD", "SUB", "MUL", "DIV", "REM", "AND", "OR", "XOR",
+    "SLL", "SRL", "SRA", "SLT",
+    "ADDI", "ANDI", "ORI", "XORI", "SLTI", "SLTIU", "SLLI", "SRLI", "SRAI",
+    "LB", "LH", "LW", "LBU", "LHU",
+    "SB", "SH", "SW",
+    "BEQ", "BNE", "BLT", "BGE",
+    "JAL", "JALR", "LUI", "AUIPC",
+    "ECALL",
+    "LR.W", "SC.W", "AMOSWAP.W", "AMOADD.W", "AMOXOR.W", "AMOAND.W", "AMOOR.W",
+    "AMOMIN.W", "AMOMAX.W", "AMOMINU.W", "AMOMAXU.W",
+    "CSRRW", "CSRRS", "CSRRC", "CSRRWI", "CSRRSI", "CSRRCI",
+    "EBREAK", "MRET", "WFI"
+};
+
+inline const char* op_name(Op op) {
+    return op < OP_COUNT ? OP_NAMES[op] : "INVALID";
+}
+
+// Pipeline-relevant class of an instruction
+enum InstrClass : uint8_t {
+    CLASS_INVALID,
+    CLASS_ALU,    // Register/immediate arithmetic, LUI, AUIPC
+    CLASS_LOAD,
+    CLASS_STORE,
+    CLASS_BRANCH, // Conditional branches
+    CLASS_JUMP,   // JAL, JALR
+    CLASS_SYSTEM, // ECALL: reads a0-a2 and a7, writes a0 (Syscalls.h)
+    CLASS_ATOMIC, // RV32A: LR.W, SC.W and the AMOs on the word at rs1 (Atomics.h)
+    CLASS_CSR,    // Zicsr: read-modify-write of CSR imm (Csr.h)
+    CLASS_PRIV    // EBREAK, MRET, WFI: no registers, trap state in Csr.h
+};
+
+// One instruction decoded at load time
+struct MicroOp {
+    uint32_t raw = 0;          // Original instruction word (0 = no instruction)
+    Op op = OP_INVALID;
+    InstrClass klass = CLASS_INVALID;
+    uint8_t rd = 0, rs1 = 0, rs2 = 0; // Raw register fields
+    bool use_imm = false;      // Second ALU operand is imm instead of rs2
+    int32_t imm = 0;           // Sign-extended immediate (shift amount for shifts)
+    uint32_t read_mask = 0;    // Bit i set when xi is read (x0 never set)
+    uint32_t write_mask = 0;   // Bit rd set when rd is written (x0 never set)
+};
+
+// Encoding key -> Op, built from the assembler's opcode and function maps
+// so that the simulators accept exactly what part1code.cpp emits
+inline unordered_map<uint32_t, Op> build_decode_table() {
+    unordered_map<uint32_t, Op> table;
+
+    unordered_map<string, Op> by_name;
+    for (int op = OP_ADD; op < OP_COUNT; op++) {
+        string name = OP_NAMES[op];
+        for (char& c : name) c = tolower(c);
+        by_name[name] = static_cast<Op>(op);
+    }
+
+    // Key: opcode | func3 << 7 | func7 << 10 | which fields take part << 17
+    auto add = [&](const unordered_map<string, string>& opcodes, bool use_func3, bool use_func7) {
+        for (const auto& entry : opcodes) {
+            auto op = by_name.find(entry.first);
+            if (op == by_name.end()) continue; // RV64-only mnemonics (ld, sd)
+            uint32_t key = stoul(entry.second, nullptr, 2);
+            if (use_func3) key |= (stoul(func3_map.at(entry.first), nullptr, 2) << 7) | (1u << 17);
+            if (use_func7) key |= (stoul(func7_map.at(entry.first), nullptr, 2) << 10) | (1u << 18);
+            table[key] = op->second;
+        }
+    };
+    add(R_opcode_map, true, true);
+    add(I_new_opcode, true, true);
+    add(I_opcode_map, true, false);
+    add(S_opcode_map, true, false);
+    add(SB_opcode_map, true, false);
+    add(U_opcode_map, false, false);
+    add(UJ_opcode_map, false, false);
+    add(SYS_opcode_map, true, false);
+    add(A_opcode_map, true, true);
+    add(CSR_opcode_map, true, false);
+    return table;
+}
+
+// Built on first use; static initialization is thread-safe, so simulators
+// on several threads can predecode at once
+inline const unordered_map<uint32_t, Op>& decode_table() {
+    static const unordered_map<uint32_t, Op> table = build_decode_table();
+    return table;
+}
+
+inline int32_t predecode_sign_extend(uint32_t value, int bits) {
+    int32_t mask = 1 << (bits - 1);
+    return (value ^ mask) - mask;
+}
+
+// Decode one instruction word
+inline MicroOp predecode(uint32_t ir) {
+    MicroOp uop;
+    uop.raw = ir;
+    if (ir == 0) return uop;
+
+    uint32_t opcode = ir & 0x7F;
+    uint32_t func3 = (ir >> 12) & 0x7;
+    uint32_t func7 = (ir >> 25) & 0x7F;
+    if (opcode == 0x2F) func7 &= 0x7C; // Atomics: the aq/rl ordering bits do not select the op
+    uop.rd = (ir >> 7) & 0x1F;
+    uop.rs1 = (ir >> 15) & 0x1F;
+    uop.rs2 = (ir >> 20) & 0x1F;
+
+    const unordered_map<uint32_t, Op>& table = decode_table();
+    auto it = table.find(opcode | (func3 << 7) | (func7 << 10) | (3u << 17));
+    if (it == table.end()) it = table.find(opcode | (func3 << 7) | (1u << 17));
+    if (it == table.end()) it = table.find(opcode);
+    if (it == table.end()) return uop;
+    uop.op = it->second;
+
+    bool reads_rs1 = true, reads_rs2 = false, writes_rd = true;
+    switch (uop.op) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_REM: case OP_AND:
+        case OP_OR: case OP_XOR: case OP_SLL: case OP_SRL: case OP_SRA: case OP_SLT:
+            uop.klass = CLASS_ALU;
+            reads_rs2 = true;
+            break;
+        case OP_SLLI: case OP_SRLI: case OP_SRAI:
+            uop.klass = CLASS_ALU;
+            uop.use_imm = true;
+            uop.imm = (ir >> 20) & 0x1F;
+            break;
+        case OP_ADDI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_SLTI: case OP_SLTIU:
+            uop.klass = CLASS_ALU;
+            uop.use_imm = true;
+            uop.imm = predecode_sign_extend(ir >> 20, 12);
+            break;
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+            uop.klass = CLASS_LOAD;
+            uop.use_imm = true;
+            uop.imm = predecode_sign_extend(ir >> 20, 12);
+            break;
+        case OP_SB: case OP_SH: case OP_SW:
+            uop.klass = CLASS_STORE;
+            uop.use_imm = true;
+            uop.imm = predecode_sign_extend(((ir >> 25) << 5) | ((ir >> 7) & 0x1F), 12);
+            reads_rs2 = true;
+            writes_rd = false;
+            break;
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE:
+            uop.klass = CLASS_BRANCH;
+            uop.imm = predecode_sign_extend(((ir >> 31) << 12) | (((ir >> 7) & 0x1) << 11) |
+                                            (((ir >> 25) & 0x3F) << 5) | (((ir >> 8) & 0xF) << 1), 13);
+            reads_rs2 = true;
+            writes_rd = false;
+            break;
+        case OP_JAL:
+            uop.klass = CLASS_JUMP;
+            uop.imm = predecode_sign_extend(((ir >> 31) << 20) | (((ir >> 21) & 0x3FF) << 1) |
+                                            (((ir >> 20) & 0x1) << 11) | (((ir >> 12) & 0xFF) << 12), 21);
+            reads_rs1 = false;
+            break;
+        case OP_JALR:
+            uop.klass = CLASS_JUMP;
+            uop.use_imm = true;
+            uop.imm = predecode_sign_extend(ir >> 20, 12);
+            break;
+        case OP_LUI: case OP_AUIPC:
+            uop.klass = CLASS_ALU;
+            uop.use_imm = true;
+            uop.imm = ir & 0xFFFFF000;
+            reads_rs1 = false;
+            break;
+        case OP_ECALL: case OP_EBREAK: case OP_MRET: case OP_WFI:
+            // Same opcode and func3: the whole word tells them apart
+            uop.op = ir == 0x00000073 ? OP_ECALL : ir == 0x00100073 ? OP_EBREAK :
+                     ir == 0x30200073 ? OP_MRET : ir == 0x10500073 ? OP_WFI : OP_INVALID;
+            if (uop.op != OP_ECALL) {
+                uop.rd = uop.rs1 = uop.rs2 = 0;
+                if (uop.op != OP_INVALID) uop.klass = CLASS_PRIV;
+                return uop;
+            }
+            uop.klass = CLASS_SYSTEM;
+            uop.rd = 10;
+            uop.rs1 = 17;
+            uop.rs2 = 10;
+            uop.read_mask = (1u << 10) | (1u << 11) | (1u << 12) | (1u << 17);
+            uop.write_mask = 1u << 10;
+            return uop;
+        case OP_LR_W:
+            if (uop.rs2 != 0) {
+                uop.op = OP_INVALID;
+                return uop;
+            }
+            uop.klass = CLASS_ATOMIC;
+            break;
+        case OP_SC_W: case OP_AMOSWAP_W: case OP_AMOADD_W: case OP_AMOXOR_W: case OP_AMOAND_W:
+        case OP_AMOOR_W: case OP_AMOMIN_W: case OP_AMOMAX_W: case OP_AMOMINU_W: case OP_AMOMAXU_W:
+            uop.klass = CLASS_ATOMIC;
+            reads_rs2 = true;
+            break;
+        case OP_CSRRW: case OP_CSRRS: case OP_CSRRC:
+            uop.klass = CLASS_CSR;
+            uop.imm = ir >> 20; // CSR number
+            break;
+        case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI:
+            uop.klass = CLASS_CSR;
+            uop.imm = ir >> 20;
+            reads_rs1 = false; // rs1 holds a 5-bit immediate
+            break;
+        default:
+            uop.op = OP_INVALID;
+            return uop;
+    }
+    if (reads_rs1) uop.read_mask |= 1u << uop.rs1;
+    if (reads_rs2) uop.read_mask |= 1u << uop.rs2;
+    if (writes_rd) uop.write_mask |= 1u << uop.rd;
+    uop.read_mask &= ~1u;
+    uop.write_mask &= ~1u;
+    return uop;
+}
+
+// Result of a CLASS_ALU operation; b is already imm when use_imm is set,
+// pc is the address of the instruction itself (for AUIPC)
+inline int32_t alu_result(Op op, int32_t a, int32_t b, uint32_t pc) {
+    switch (op) {
+        case OP_ADD: case OP_ADDI: return static_cast<uint32_t>(a) + static_cast<uint32_t>(b);
+        case OP_SUB: return static_cast<uint32_t>(a) - static_cast<uint32_t>(b);
+        case OP_MUL: return static_cast<uint32_t>(a) * static_cast<uint32_t>(b);
+        case OP_DIV:
+            if (b == 0) return -1;
+            if (a == INT32_MIN && b == -1) return a;
+            return a / b;
+        case OP_REM:
+            if (b == 0) return a;
+            if (a == INT32_MIN && b == -1) return 0;
+            return a % b;
+        case OP_AND: case OP_ANDI: return a & b;
+        case OP_OR: case OP_ORI: return a | b;
+        case OP_XOR: case OP_XORI: return a ^ b;
+        case OP_SLL: case OP_SLLI: return static_cast<uint32_t>(a) << (b & 0x1F);
+        case OP_SRL: case OP_SRLI: return static_cast<uint32_t>(a) >> (b & 0x1F);
+        case OP_SRA: case OP_SRAI: return a >> (b & 0x1F);
+        case OP_SLT: case OP_SLTI: return a < b ? 1 : 0;
+        case OP_SLTIU: return static_cast<uint32_t>(a) < static_cast<uint32_t>(b) ? 1 : 0;
+        case OP_LUI: return b;
+        case OP_AUIPC: return pc + b;
+        default: return 0;
+    }
+}
+
+// Outcome of a CLASS_BRANCH operation
+inline bool branch_taken(Op op, int32_t a, int32_t b) {
+    switch (op) {
+        case OP_BEQ: return a == b;
+        case OP_BNE: return a != b;
+        case OP_BLT: return a < b;
+        case OP_BGE: return a >= b;
+        default: return false;
+    }
+}
+
+// RV32A operations (CLASS_ATOMIC)
+inline bool is_atomic(Op op) { return op >= OP_LR_W && op <= OP_AMOMAXU_W; }
+
+// Zicsr operations (CLASS_CSR); the i forms take rs1 as an immediate
+inline bool is_csr(Op op) { return op >= OP_CSRRW && op <= OP_CSRRCI; }
+
+// Name of a CSR for disassembly, or its number
+inline string csr_name(uint32_t csr) {
+    for (const auto& entry : csr_map) {
+        if (static_cast<uint32_t>(entry.second) == csr) return entry.first;
+    }
+    stringstream ss;
+    ss << "0x" << hex << csr;
+    return ss.str();
+}
+
+// Bytes read by a load
+inline int load_size(Op op) {
+    switch (op) {
+        case OP_LB: case OP_LBU: return 1;
+        case OP_LH: case OP_LHU: return 2;
+        default: return 4;
+    }
+}
+
+// Register value of a load from its bytes: LB and LH sign-extend
+inline uint32_t extend_load(Op op, uint32_t bytes) {
+    switch (op) {
+        case OP_LB: return static_cast<int8_t>(bytes);
+        case OP_LH: return static_cast<int16_t>(bytes);
+        default: return bytes;
+    }
+}
+
+// Bytes written by a store or atomic
+inline int store_size(Op op) {
+    switch (op) {
+        case OP_SB: return 1;
+        case OP_SH: return 2;
+        default: return 4;
+    }
+}
+
+// Assembly text of a micro-op, for traces
+inline string disassemble(const MicroOp& uop) {
+    stringstream ss;
+    ss << op_name(uop.op);
+    switch (uop.klass) {
+        case CLASS_ALU:
+            if (uop.op == OP_LUI || uop.op == OP_AUIPC)
+                ss << " x" << +uop.rd << ", " << (uop.imm >> 12);
+            else if (uop.use_imm)
+                ss << " x" << +uop.rd << ", x" << +uop.rs1 << ", " << uop.imm;
+            else
+                ss << " x" << +uop.rd << ", x" << +uop.rs1 << ", x" << +uop.rs2;
+            break;
+        case CLASS_LOAD:
+            ss << " x" << +uop.rd << ", " << uop.imm << "(x" << +uop.rs1 << ")";
+            break;
+        case CLASS_STORE:
+            ss << " x" << +uop.rs2 << ", " << uop.imm << "(x" << +uop.rs1 << ")";
+            break;
+        case CLASS_BRANCH:
+            ss << " x" << +uop.rs1 << ", x" << +uop.rs2 << ", " << uop.imm;
+            break;
+        case CLASS_JUMP:
+            if (uop.op == OP_JAL) ss << " x" << +uop.rd << ", " << uop.imm;
+            else ss << " x" << +uop.rd << ", x" << +uop.rs1 << ", " << uop.imm;
+            break;
+        case CLASS_SYSTEM:
+        case CLASS_PRIV:
+            break;
+        case CLASS_ATOMIC:
+            ss << " x" << +uop.rd;
+            if (uop.op != OP_LR_W) ss << ", x" << +uop.rs2;
+            ss << ", (x" << +uop.rs1 << ")";
+            break;
+        case CLASS_CSR:
+            ss << " x" << +uop.rd << ", " << csr_name(uop.imm) << ", ";
+            if (uop.op >= OP_CSRRWI) ss << +uop.rs1;
+            else ss << "x" << +uop.rs1;
+            break;
+        default:
+            return "NOP";
+    }
+    return ss.str();
+}
+
+// Predecoded text segment, indexed by (pc - base) / 4
+struct PredecodedText {
+    uint32_t base = 0;
+    vector<MicroOp> ops;
+
+    void clear() {
+        base = 0;
+        ops.clear();
+    }
+
+    bool empty() const { return ops.empty(); }
+
+    void add(uint32_t pc, uint32_t ir) {
+        if (ops.empty()) base = pc & ~3u;
+        if (pc < base) {
+            ops.insert(ops.begin(), (base - pc) / 4, MicroOp());
+            base = pc & ~3u;
+        }
+        size_t index = (pc - base) / 4;
+        if (index >= ops.size()) ops.resize(index + 1);
+        ops[index] = predecode(ir);
+    }
+
+    // Micro-op at pc, or nullptr when there is no instruction there
+    const MicroOp* at(uint32_t pc) const {
+        if (pc < base || (pc & 3)) return nullptr;
+        size_t index = (pc - base) / 4;
+        if (index >= ops.size() || ops[index].raw == 0) return nullptr;
+        return &ops[index];
+    }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define RISCV_INSTRUCTIONS_H
 
 #include <unordered_map>
+#include <string>
 #include <string.h>
 #include <limits.h>
 
@@ -87,6 +88,69 @@ unordered_map<string, string> UJ_opcode_map = {
     // UJ_Type
     {"jal", "1101111"}};
 
+unordered_map<string, string> SYS_opcode_map = {
+    // System (no operands)
+    {"ecall", "1110011"},
+    {"ebreak", "1110011"},
+    {"mret", "1110011"},
+    {"wfi", "1110011"}};
+
+// funct12 (the immediate field) of the system instructions
+unordered_map<string, int> SYS_funct12_map = {
+    {"ecall", 0x000},
+    {"ebreak", 0x001},
+    {"wfi", 0x105},
+    {"mret", 0x302}};
+
+unordered_map<string, string> A_opcode_map = {
+    // RV32A atomics (R-Type layout; func7 is funct5, aq, rl)
+    {"lr.w", "0101111"},
+    {"sc.w", "0101111"},
+    {"amoswap.w", "0101111"},
+    {"amoadd.w", "0101111"},
+    {"amoxor.w", "0101111"},
+    {"amoand.w", "0101111"},
+    {"amoor.w", "0101111"},
+    {"amomin.w", "0101111"},
+    {"amomax.w", "0101111"},
+    {"amominu.w", "0101111"},
+    {"amomaxu.w", "0101111"},
+};
+
+unordered_map<string, string> CSR_opcode_map = {
+    // Zicsr (I-Type layout; imm is the CSR number, rs1 a register or, for the
+    // i forms, a 5-bit unsigned immediate)
+    {"csrrw", "1110011"},
+    {"csrrs", "1110011"},
+    {"csrrc", "1110011"},
+    {"csrrwi", "1110011"},
+    {"csrrsi", "1110011"},
+    {"csrrci", "1110011"},
+};
+
+// CSR names accepted by the assembler, with their numbers
+unordered_map<string, int> Build_Csr_Map()
+{
+    unordered_map<string, int> csrs = {
+        {"cycle", 0xC00}, {"time", 0xC01}, {"instret", 0xC02},
+        {"cycleh", 0xC80}, {"timeh", 0xC81}, {"instreth", 0xC82},
+        {"mcycle", 0xB00}, {"minstret", 0xB02},
+        {"mcycleh", 0xB80}, {"minstreth", 0xB82},
+        {"mstatus", 0x300}, {"misa", 0x301}, {"mie", 0x304}, {"mtvec", 0x305},
+        {"mscratch", 0x340}, {"mepc", 0x341}, {"mcause", 0x342}, {"mtval", 0x343}, {"mip", 0x344},
+        {"mhartid", 0xF14},
+    };
+    for (int n = 3; n < 32; n++)
+    {
+        csrs["hpmcounter" + to_string(n)] = 0xC00 + n;
+        csrs["hpmcounter" + to_string(n) + "h"] = 0xC80 + n;
+        csrs["mhpmcounter" + to_string(n)] = 0xB00 + n;
+        csrs["mhpmcounter" + to_string(n) + "h"] = 0xB80 + n;
+    }
+    return csrs;
+}
+unordered_map<string, int> csr_map = Build_Csr_Map();
+
 // func3 map
 unordered_map<string, string> func3_map = {
     // R-Type
@@ -139,6 +203,33 @@ unordered_map<string, string> func3_map = {
     {"bne", "001"},
     {"bge", "101"},
     {"blt", "100"},
+
+    // System
+    {"ecall", "000"},
+    {"ebreak", "000"},
+    {"mret", "000"},
+    {"wfi", "000"},
+
+    // Atomics (word)
+    {"lr.w", "010"},
+    {"sc.w", "010"},
+    {"amoswap.w", "010"},
+    {"amoadd.w", "010"},
+    {"amoxor.w", "010"},
+    {"amoand.w", "010"},
+    {"amoor.w", "010"},
+    {"amomin.w", "010"},
+    {"amomax.w", "010"},
+    {"amominu.w", "010"},
+    {"amomaxu.w", "010"},
+
+    // Zicsr
+    {"csrrw", "001"},
+    {"csrrs", "010"},
+    {"csrrc", "011"},
+    {"csrrwi", "101"},
+    {"csrrsi", "110"},
+    {"csrrci", "111"},
     
 };
 
@@ -163,6 +254,19 @@ unordered_map<string, string> func7_map = {
     {"slli", "0000000"},
     {"srli", "0000000"},
     {"srai", "0100000"}, 
+
+    // Atomics: funct5 with aq = rl = 0
+    {"lr.w", "0001000"},
+    {"sc.w", "0001100"},
+    {"amoswap.w", "0000100"},
+    {"amoadd.w", "0000000"},
+    {"amoxor.w", "0010000"},
+    {"amoand.w", "0110000"},
+    {"amoor.w", "0100000"},
+    {"amomin.w", "1000000"},
+    {"amomax.w", "1010000"},
+    {"amominu.w", "1100000"},
+    {"amomaxu.w", "1110000"},
     
    
 
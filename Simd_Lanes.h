@@ -0,0 +1,573 @@
+#ifndef SIMD_LANES_H
+#define SIMD_LANES_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include "Functional_Simulator.h"
+#include "Fork_Server.h"
+
+using namespace std;
+
+// Multi-instance interpreter: one program run on many inputs at once, one
+// instance per lane. Registers and PCs are kept structure-of-arrays in
+// LaneVecs (GCC vector extensions): four lanes per SSE2 register by default,
+// eight per AVX2 register when built with -mavx2. Each step picks a PC and
+// executes that instruction for every lane at it under a lane mask: ALU ops,
+// branches and jumps are vector operations, while loads, stores, atomics,
+// CSR instructions and ecalls go lane by lane to each lane's own data memory,
+// CSRs and syscall state.
+// The PC is the lowest one among the lanes that have taken the fewest
+// backward jumps, so lanes that diverge run masked and meet again where their
+// paths join, and no lane starts the next loop iteration before the others
+// have finished this one. Lanes are only rescheduled after a jump, an ecall,
+// a CSR instruction or when they reach a waiting lane. A lane that has
+// waited more than split_after steps while other lanes ran is split out and
+// finished on the fast interpreter. A lane that reaches what only step mode
+// models (mret, wfi, a trap handler being installed, an MMIO access) stops
+// there and the run reports an error.
+// Lanes come from a variants file (Fork_Server.h): a name and
+// patch=0xADDR:0xVALUE inputs per line.
+
+#ifdef __AVX2__
+const unsigned LANE_BYTES = 32;
+#else
+const unsigned LANE_BYTES = 16;
+#endif
+typedef uint32_t LaneVec __attribute__((vector_size(LANE_BYTES)));
+typedef int32_t LaneMask __attribute__((vector_size(LANE_BYTES)));
+
+const unsigned VEC_LANES = LANE_BYTES / 4; // Lanes per LaneVec
+const unsigned LANE_GROUP = 256;           // Lanes run together; larger files run in several groups
+
+inline LaneVec lane_splat(uint32_t value) {
+    return LaneVec{} + value;
+}
+
+// Lanes of mask set: a, others: b
+inline LaneVec lane_select(LaneVec mask, LaneVec a, LaneVec b) {
+    return (a & mask) | (b & ~mask);
+}
+
+// Final state of one lane
+struct LaneResult {
+    string name;
+    bool exited = false;    // Called exit; otherwise ran off the end of the program
+    bool split = false;     // Finished on the scalar interpreter
+    const char* stopped = nullptr; // Reached what only step mode models (FunctionalSimulator::leave_for_step())
+    uint32_t stop_pc = 0;
+    int exit_code = 0;
+    long long instructions = 0;
+    uint32_t a0 = 0;
+};
+
+// Up to LANE_GROUP lanes of one program. Lanes live in slots; as lanes end,
+// the running ones are packed into the lowest slots so the vector loops only
+// cover vectors that still have work.
+class LaneGroup {
+public:
+    LaneGroup(const FunctionalSimulator& program, const vector<RunVariant>& runs, size_t first, size_t count,
+              long long split_after)
+        : program(program), count(count), stride((count + VEC_LANES - 1) / VEC_LANES), vecs(stride),
+          split_after(split_after), null_out(nullptr) {
+        regs.assign(32 * stride, lane_splat(0));
+        pcs.assign(stride, lane_splat(program.pc));
+        live.assign(stride, lane_splat(0));
+        active.assign(stride, lane_splat(0));
+        last_run.assign(stride, lane_splat(0));
+        trips.assign(stride, lane_splat(0));
+        executed.assign(stride, lane_splat(0));
+        slot_lane.assign(stride * VEC_LANES, NO_LANE);
+        results.resize(count);
+        reservations.resize(count);
+        csrs.resize(count);
+        for (size_t lane = 0; lane < count; lane++) {
+            const RunVariant& run = runs[first + lane];
+            results[lane].name = run.name;
+            for (int r = 1; r < 32; r++) reg(r, lane) = program.reg_file[r];
+            at(live, lane) = ~0u;
+            slot_lane[lane] = lane;
+
+            memories.emplace_back(new SparseMemory());
+            SparseMemory& memory = *memories.back();
+            program.memory.forEachPage([&](uint32_t base, const SparseMemory::Page& page) {
+                memory.copyIn(base, page.bytes, SparseMemory::PAGE_SIZE);
+            });
+            for (const auto& patch : run.patches) {
+                memory.writeValue(patch.first, stoull(patch.second, nullptr, 16), (patch.second.length() - 1) / 2);
+            }
+            syscalls.emplace_back(new SyscallEmulator(memory));
+            syscalls.back()->setOutput(null_out, null_out);
+        }
+    }
+
+    // Run every lane to its end; returns the vector steps taken
+    long long run() {
+        uint32_t pc = 0;
+        bool schedule = true;
+        long long next_compact = 64, next_split = 256;
+        while (true) {
+            if (schedule) {
+                retire_run();
+                if (steps >= next_compact) {
+                    if (steps >= next_split) {
+                        split_waiting();
+                        next_split = steps + 256;
+                    }
+                    compact();
+                    next_compact = steps + 64;
+                }
+                if (!next_pc(pc)) break;
+            }
+            const MicroOp* uop = program.code.at(pc);
+            if (uop && trap_only(*uop)) {
+                for (size_t v = 0; v < vecs; v++) {
+                    each_active(v, [&](size_t, unsigned i) { stop_lane(v, i, pc, "mret or wfi"); });
+                }
+                schedule = true;
+                continue;
+            }
+            if (!uop || uop->op == OP_INVALID || uop->klass == CLASS_PRIV) {
+                for (size_t v = 0; v < vecs; v++) live[v] &= ~active[v]; // End of the program
+                schedule = true;
+                continue;
+            }
+            schedule = execute(*uop, pc);
+            steps++;
+            run_length++;
+            if (!schedule) {
+                // Straight-line code: the same lanes go on at pc + 4 unless
+                // a waiting lane sits at or before it
+                pc += 4;
+                if (pc >= bound) {
+                    LaneVec next = lane_splat(pc);
+                    for (size_t v = 0; v < vecs; v++) pcs[v] = lane_select(active[v], next, pcs[v]);
+                    schedule = true;
+                }
+            }
+        }
+        for (size_t slot = 0; slot < vecs * VEC_LANES; slot++) finish(slot);
+        for (SplitLane& split : split_lanes) run_scalar(split);
+        return steps;
+    }
+
+    const vector<LaneResult>& lane_results() const { return results; }
+    size_t splits() const { return split_lanes.size(); }
+
+private:
+    static constexpr size_t NO_LANE = SIZE_MAX;
+
+    // State of a lane handed to the scalar interpreter
+    struct SplitLane {
+        size_t lane;
+        array<int32_t, 32> regs;
+        uint32_t pc;
+    };
+
+    const FunctionalSimulator& program;
+    size_t count;                                   // Lanes in the group
+    size_t stride;                                  // Vectors per register
+    size_t vecs;                                    // Vectors that hold running lanes
+    long long split_after;
+    long long steps = 0;                            // Vector steps taken
+    uint32_t run_length = 0;                        // Steps the active lanes have run since the last schedule
+    uint32_t bound = ~0u;                           // Lowest PC of a waiting lane with the active lanes' trips
+    ostream null_out;                               // Guest output of the lanes
+    vector<LaneVec> regs;                           // x[r] of the slots in vector v at regs[r * stride + v]
+    vector<LaneVec> pcs;
+    vector<LaneVec> live;                           // ~0 for slots with a running lane
+    vector<LaneVec> active;                         // ~0 for slots executing this step
+    vector<LaneVec> last_run;                       // Step each lane last ran at
+    vector<LaneVec> trips;                          // Backward jumps each lane has taken
+    vector<LaneVec> executed;                       // Instructions per lane in vector mode
+    vector<size_t> slot_lane;                       // Lane in each slot, NO_LANE when empty
+    vector<unique_ptr<SparseMemory>> memories;      // Per lane, like the rest below
+    vector<unique_ptr<SyscallEmulator>> syscalls;
+    vector<Reservation> reservations;
+    vector<CsrFile> csrs;
+    vector<LaneResult> results;
+    vector<SplitLane> split_lanes;
+
+    static uint32_t& at(vector<LaneVec>& values, size_t slot) { return values[slot / VEC_LANES][slot % VEC_LANES]; }
+    uint32_t& reg(int r, size_t slot) { return regs[r * stride + slot / VEC_LANES][slot % VEC_LANES]; }
+
+    // Lowest element of a lane vector
+    static uint32_t lowest(LaneVec low) {
+        uint32_t result = ~0u;
+        for (unsigned i = 0; i < VEC_LANES; i++) result = low[i] < result ? low[i] : result;
+        return result;
+    }
+
+    // Credit the active lanes with the steps they ran since the last schedule
+    void retire_run() {
+        LaneVec ran = lane_splat(run_length), now = lane_splat(static_cast<uint32_t>(steps));
+        for (size_t v = 0; v < vecs; v++) {
+            executed[v] += active[v] & ran;
+            last_run[v] = lane_select(active[v], now, last_run[v]);
+        }
+        run_length = 0;
+    }
+
+    // PC of the next step and the mask of lanes at it; false when no lane is left
+    bool next_pc(uint32_t& pc) {
+        LaneVec none = lane_splat(~0u), low = none;
+        for (size_t v = 0; v < vecs; v++) {
+            LaneVec candidate = lane_select(live[v], trips[v], none);
+            low = lane_select((LaneVec)(candidate < low), candidate, low);
+        }
+        LaneVec trip = lane_splat(lowest(low));
+        low = none;
+        for (size_t v = 0; v < vecs; v++) {
+            active[v] = live[v] & (LaneVec)(trips[v] == trip);
+            LaneVec candidate = lane_select(active[v], pcs[v], none);
+            low = lane_select((LaneVec)(candidate < low), candidate, low);
+        }
+        pc = lowest(low);
+        LaneVec target = lane_splat(pc), any = lane_splat(0);
+        low = none;
+        for (size_t v = 0; v < vecs; v++) {
+            LaneVec same_trip = active[v];
+            active[v] &= (LaneVec)(pcs[v] == target);
+            LaneVec candidate = lane_select(same_trip & ~active[v], pcs[v], none);
+            low = lane_select((LaneVec)(candidate < low), candidate, low);
+            any |= active[v];
+        }
+        bound = lowest(low);
+        return lowest(~any) == 0;
+    }
+
+    // Move lanes that have waited too long to the scalar interpreter
+    void split_waiting() {
+        LaneVec limit = lane_splat(static_cast<uint32_t>(split_after)), now = lane_splat(static_cast<uint32_t>(steps));
+        for (size_t v = 0; v < vecs; v++) {
+            LaneVec over = (LaneVec)(now - last_run[v] > limit) & live[v];
+            for (unsigned i = 0; i < VEC_LANES; i++) {
+                if (!over[i]) continue;
+                size_t slot = v * VEC_LANES + i;
+                SplitLane split{slot_lane[slot], {}, at(pcs, slot)};
+                for (int r = 1; r < 32; r++) split.regs[r] = reg(r, slot);
+                results[split.lane].split = true;
+                split_lanes.push_back(split);
+                live[v][i] = 0;
+            }
+        }
+    }
+
+    // Record the result of the lane that ended in slot and free the slot
+    void finish(size_t slot) {
+        size_t lane = slot_lane[slot];
+        if (lane == NO_LANE) return;
+        LaneResult& result = results[lane];
+        result.instructions += at(executed, slot);
+        if (!result.split) {
+            result.exited = syscalls[lane]->exited();
+            result.exit_code = syscalls[lane]->exitCode();
+            result.a0 = reg(10, slot);
+        }
+        slot_lane[slot] = NO_LANE;
+    }
+
+    // Pack the running lanes into the lowest slots once a whole vector is free
+    void compact() {
+        size_t running = 0;
+        for (size_t v = 0; v < vecs; v++) {
+            for (unsigned i = 0; i < VEC_LANES; i++) running += live[v][i] != 0;
+        }
+        if (running + VEC_LANES > vecs * VEC_LANES) return;
+
+        size_t kept = 0;
+        for (size_t slot = 0; slot < vecs * VEC_LANES; slot++) {
+            if (!at(live, slot)) {
+                finish(slot);
+                continue;
+            }
+            if (kept != slot) {
+                for (int r = 1; r < 32; r++) reg(r, kept) = reg(r, slot);
+                at(pcs, kept) = at(pcs, slot);
+                at(trips, kept) = at(trips, slot);
+                at(last_run, kept) = at(last_run, slot);
+                at(executed, kept) = at(executed, slot);
+                at(live, kept) = ~0u;
+                at(live, slot) = 0;
+                slot_lane[kept] = slot_lane[slot];
+                slot_lane[slot] = NO_LANE;
+            }
+            kept++;
+        }
+        vecs = (kept + VEC_LANES - 1) / VEC_LANES;
+        for (size_t slot = kept; slot < vecs * VEC_LANES; slot++) at(executed, slot) = 0;
+    }
+
+    // Finish a split lane on the fast interpreter, over the lane's own memory
+    void run_scalar(const SplitLane& split) {
+        LaneResult& result = results[split.lane];
+        FunctionalSimulator sim(*memories[split.lane], null_out);
+        sim.syscalls.setOutput(null_out, null_out);
+        sim.syscalls.restore(syscalls[split.lane]->heapEnd(), 0);
+        sim.code = program.code;
+        sim.reg_file = split.regs;
+        sim.pc = split.pc;
+        sim.clock_cycles = result.instructions;
+        sim.reservation = reservations[split.lane];
+        sim.csrs = csrs[split.lane];
+        result.instructions += sim.run_threaded(LLONG_MAX);
+        result.stopped = sim.step_reason;
+        result.stop_pc = sim.pc;
+        result.exited = sim.syscalls.exited();
+        result.exit_code = sim.syscalls.exitCode();
+        result.a0 = sim.reg_file[10];
+    }
+
+    // Element i of vector v reached what --lanes does not model: the lane
+    // ends at pc and the run reports it
+    void stop_lane(size_t v, unsigned i, uint32_t pc, const char* reason) {
+        LaneResult& result = results[slot_lane[v * VEC_LANES + i]];
+        result.stopped = reason;
+        result.stop_pc = pc;
+        live[v][i] = 0;
+    }
+
+    // A load or store of element i of vector v is in the MMIO window: the lane
+    // stops before it and leaves the straight-line run it was part of
+    void stop_at_mmio(size_t v, unsigned i, uint32_t pc) {
+        executed[v][i] += run_length;
+        active[v][i] = 0;
+        stop_lane(v, i, pc, "an MMIO access");
+    }
+
+    void write_rd(uint8_t rd, size_t v, LaneVec value) {
+        if (rd) regs[rd * stride + v] = lane_select(active[v], value, regs[rd * stride + v]);
+    }
+
+    // Active lanes of v continue at target; a jump back counts as a trip
+    void jump(size_t v, LaneVec target, uint32_t pc) {
+        pcs[v] = lane_select(active[v], target, pcs[v]);
+        trips[v] += active[v] & (LaneVec)(target <= lane_splat(pc)) & 1;
+    }
+
+    // Lanes of vector v executing this step, one at a time: body(lane, element)
+    template <typename Body>
+    void each_active(size_t v, Body body) {
+        for (unsigned i = 0; i < VEC_LANES; i++) {
+            if (active[v][i]) body(slot_lane[v * VEC_LANES + i], i);
+        }
+    }
+
+    // Execute uop for the active lanes; true when it set their PCs itself
+    bool execute(const MicroOp& uop, uint32_t pc) {
+        const LaneVec* rs1 = &regs[uop.rs1 * stride];
+        const LaneVec* rs2 = &regs[uop.rs2 * stride];
+        LaneVec imm = lane_splat(uop.imm);
+        LaneVec next = lane_splat(pc + 4);
+
+#define LANE_ALU(expr)                                                      \
+        for (size_t v = 0; v < vecs; v++) {                                 \
+            LaneVec a = rs1[v], b = uop.use_imm ? imm : rs2[v];             \
+            (void)a, (void)b;                                               \
+            write_rd(uop.rd, v, (expr));                                    \
+        }                                                                   \
+        break;
+
+        switch (uop.op) {
+            case OP_ADD: case OP_ADDI: LANE_ALU(a + b)
+            case OP_SUB: LANE_ALU(a - b)
+            case OP_MUL: LANE_ALU(a * b)
+            case OP_AND: case OP_ANDI: LANE_ALU(a & b)
+            case OP_OR: case OP_ORI: LANE_ALU(a | b)
+            case OP_XOR: case OP_XORI: LANE_ALU(a ^ b)
+            case OP_SLL: case OP_SLLI: LANE_ALU(a << (b & 31))
+            case OP_SRL: case OP_SRLI: LANE_ALU(a >> (b & 31))
+            case OP_SRA: case OP_SRAI: LANE_ALU((LaneVec)((LaneMask)a >> (LaneMask)(b & 31)))
+            case OP_SLT: case OP_SLTI: LANE_ALU((LaneVec)((LaneMask)a < (LaneMask)b) & 1)
+            case OP_SLTIU: LANE_ALU((LaneVec)(a < b) & 1)
+            case OP_LUI: LANE_ALU(imm)
+            case OP_AUIPC: LANE_ALU(lane_splat(pc + uop.imm))
+            case OP_DIV: case OP_REM:
+                // No vector divide: per lane, with the RISC-V divide-by-zero results
+                for (size_t v = 0; v < vecs; v++) {
+                    LaneVec result = regs[uop.rd * stride + v];
+                    each_active(v, [&](size_t, unsigned i) { result[i] = alu_result(uop.op, rs1[v][i], rs2[v][i], pc); });
+                    write_rd(uop.rd, v, result);
+                }
+                break;
+            case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+                for (size_t v = 0; v < vecs; v++) {
+                    LaneVec result = regs[uop.rd * stride + v];
+                    each_active(v, [&](size_t lane, unsigned i) {
+                        uint32_t addr = rs1[v][i] + uop.imm;
+                        if (MmioBus::contains(addr)) return stop_at_mmio(v, i, pc);
+                        const SparseMemory& memory = *memories[lane];
+                        switch (uop.op) {
+                            case OP_LB: result[i] = static_cast<int8_t>(memory.read8(addr)); break;
+                            case OP_LH: result[i] = static_cast<int16_t>(memory.read16(addr)); break;
+                            case OP_LBU: result[i] = memory.read8(addr); break;
+                            case OP_LHU: result[i] = memory.read16(addr); break;
+                            default: result[i] = memory.read32(addr); break;
+                        }
+                    });
+                    write_rd(uop.rd, v, result);
+                }
+                break;
+            case OP_SB: case OP_SH: case OP_SW:
+                for (size_t v = 0; v < vecs; v++) {
+                    each_active(v, [&](size_t lane, unsigned i) {
+                        uint32_t addr = rs1[v][i] + uop.imm;
+                        if (MmioBus::contains(addr)) return stop_at_mmio(v, i, pc);
+                        SparseMemory& memory = *memories[lane];
+                        switch (uop.op) {
+                            case OP_SB: memory.write8(addr, rs2[v][i] & 0xFF); break;
+                            case OP_SH: memory.write16(addr, rs2[v][i] & 0xFFFF); break;
+                            default: memory.write32(addr, rs2[v][i]); break;
+                        }
+                    });
+                }
+                break;
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: {
+                LaneVec target = lane_splat(pc + uop.imm);
+                for (size_t v = 0; v < vecs; v++) {
+                    LaneVec a = rs1[v], b = rs2[v], taken;
+                    switch (uop.op) {
+                        case OP_BEQ: taken = (LaneVec)(a == b); break;
+                        case OP_BNE: taken = (LaneVec)(a != b); break;
+                        case OP_BLT: taken = (LaneVec)((LaneMask)a < (LaneMask)b); break;
+                        default: taken = (LaneVec)((LaneMask)a >= (LaneMask)b); break;
+                    }
+                    jump(v, lane_select(taken, target, next), pc);
+                }
+                return true;
+            }
+            case OP_JAL:
+                for (size_t v = 0; v < vecs; v++) {
+                    write_rd(uop.rd, v, next);
+                    jump(v, lane_splat(pc + uop.imm), pc);
+                }
+                return true;
+            case OP_JALR:
+                for (size_t v = 0; v < vecs; v++) {
+                    LaneVec target = (rs1[v] + imm) & lane_splat(~1u); // Before rd, which may be rs1
+                    write_rd(uop.rd, v, next);
+                    jump(v, target, pc);
+                }
+                return true;
+            case OP_ECALL:
+                for (size_t v = 0; v < vecs; v++) {
+                    each_active(v, [&](size_t lane, unsigned i) {
+                        SyscallEmulator& sys = *syscalls[lane];
+                        size_t slot = v * VEC_LANES + i;
+                        reg(10, slot) = sys.call(reg(17, slot), reg(10, slot), reg(11, slot), reg(12, slot),
+                                                   executed[v][i] + run_length);
+                        if (sys.exited()) live[v][i] = 0;
+                    });
+                    pcs[v] = lane_select(active[v], next, pcs[v]);
+                }
+                return true; // Lanes that exited leave the schedule
+            case OP_CSRRW: case OP_CSRRS: case OP_CSRRC: case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI:
+                for (size_t v = 0; v < vecs; v++) {
+                    LaneVec result = regs[uop.rd * stride + v];
+                    each_active(v, [&](size_t lane, unsigned i) {
+                        uint64_t retired = executed[v][i] + run_length;
+                        CounterValues raw = {};
+                        raw[COUNTER_CYCLE] = raw[COUNTER_TIME] = raw[COUNTER_INSTRET] = retired;
+                        uint32_t old;
+                        if (csrs[lane].execute(uop, rs1[v][i], raw, old)) {
+                            result[i] = old;
+                            if (csrs[lane].has_handler()) stop_lane(v, i, pc + 4, "mtvec installs a trap handler");
+                            return;
+                        }
+                        live[v][i] = 0; // Illegal instruction: the lane stops here, uncounted
+                        executed[v][i]--;
+                    });
+                    write_rd(uop.rd, v, result);
+                    pcs[v] = lane_select(active[v] & live[v], next, pcs[v]);
+                }
+                return true;
+            default:
+                if (is_atomic(uop.op)) {
+                    for (size_t v = 0; v < vecs; v++) {
+                        LaneVec result = regs[uop.rd * stride + v];
+                        each_active(v, [&](size_t lane, unsigned i) {
+                            result[i] = atomic_execute(*memories[lane], reservations[lane], uop.op, rs1[v][i], rs2[v][i]);
+                        });
+                        write_rd(uop.rd, v, result);
+                    }
+                }
+                break;
+        }
+#undef LANE_ALU
+        return false;
+    }
+};
+
+// Every lane of a variants file, LANE_GROUP lanes at a time, with a summary
+// and a results table
+class SimdLanes {
+public:
+    SimdLanes(const FunctionalSimulator& program, const vector<RunVariant>& runs, long long split_after,
+              ostream& out = cout)
+        : program(program), runs(runs), split_after(split_after), out(out) {}
+
+    bool run(const string& results_file) {
+        auto start = chrono::steady_clock::now();
+        long long steps = 0, instructions = 0;
+        size_t splits = 0;
+        vector<LaneResult> results;
+        for (size_t first = 0; first < runs.size(); first += LANE_GROUP) {
+            size_t count = runs.size() - first < LANE_GROUP ? runs.size() - first : LANE_GROUP;
+            LaneGroup group(program, runs, first, count, split_after);
+            steps += group.run();
+            splits += group.splits();
+            for (const LaneResult& result : group.lane_results()) {
+                instructions += result.instructions;
+                results.push_back(result);
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        out << "SIMD lanes: " << runs.size() << " instances in groups of up to " << LANE_GROUP << ", " << steps
+            << " steps, " << instructions << " instructions, " << splits << " split to the scalar interpreter\n";
+        out << "SIMD lanes: " << fixed << setprecision(3) << seconds << " s";
+        if (seconds > 0) {
+            out << " (" << setprecision(0) << runs.size() / seconds << " instances/s, " << setprecision(1)
+                << instructions / seconds / 1e6 << " MIPS)";
+        }
+        out << defaultfloat << "\n";
+        bool ok = true;
+        for (const LaneResult& r : results) {
+            if (!r.stopped) continue;
+            out << "Error: Lane " << r.name << " stopped at 0x" << hex << uppercase << setw(8) << setfill('0')
+                << r.stop_pc << dec << nouppercase << setfill(' ') << " (" << r.stopped
+                << "); --lanes does not model traps or MMIO devices\n";
+            ok = false;
+        }
+        return write_results(results_file, results) && ok;
+    }
+
+private:
+    const FunctionalSimulator& program;
+    const vector<RunVariant>& runs;
+    long long split_after;
+    ostream& out;
+
+    bool write_results(const string& filename, const vector<LaneResult>& results) {
+        ofstream file(filename);
+        if (!file.is_open()) {
+            out << "Error: Cannot write to " << filename << endl;
+            return false;
+        }
+        file << "# run\tstatus\texit\tinstructions\ta0\tsplit\n";
+        for (const LaneResult& r : results) {
+            file << r.name << "\t" << (r.stopped ? "stopped" : r.exited ? "exited" : "ended") << "\t" << r.exit_code << "\t"
+                 << r.instructions << "\t" << static_cast<int32_t>(r.a0) << "\t" << (r.split ? 1 : 0) << "\n";
+        }
+        out << "Lane results in " << filename << "\n";
+        return file.good();
+    }
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "Sparse_Memory.h"
+#include "Predecoder.h"
+#include "Csr.h"
+#include "Dma_Engine.h"
+#include "Atomics.h"
+
+using namespace std;
+
+// Binary simulator snapshot:
+//   "RVSNAP\0\0", version (u32), then sections of tag (u32), length (u32), payload
+// All integers are little-endian. Unknown sections are skipped, so later
+// versions can add state without breaking older readers of the core parts.
+const char SNAPSHOT_MAGIC[8] = {'R', 'V', 'S', 'N', 'A', 'P', 0, 0};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+enum SnapshotSection : uint32_t {
+    SNAP_CORE = 1,     // pc, x0-x31, cycles, instructions, text fingerprint
+    SNAP_MEMORY = 2,   // Page count, then base and 4 KiB of bytes per non-zero page
+    SNAP_PIPELINE = 3, // pipeline.cpp latches, BTB, hazard state and statistics
+    SNAP_SYSCALL = 4,  // Program break (u32) and input file offset (u64)
+    SNAP_CSR = 5,      // mscratch (u32), the 32 counter offsets (u64), then mstatus, mie, mtvec, mepc, mcause, mtval (u32)
+    SNAP_TIMER = 6,    // CLINT mtimecmp (u64)
+    SNAP_DEVICES = 7,  // MMIO device state in mapping order (MmioDevice::save in Mmio_Bus.h)
+    SNAP_RESERVATION = 8 // LR.W reservation: address, value (u32), valid (u8)
+};
+
+// Architectural state shared by both simulators
+struct CoreState {
+    uint32_t pc = 0;
+    uint32_t regs[32] = {0};
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t text_fingerprint = 0;
+};
+
+// FNV-1a over the loaded text, to catch a snapshot restored with another program
+inline uint64_t text_fingerprint(const PredecodedText& text) {
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&](uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (v >> (8 * i)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(text.base);
+    for (const MicroOp& uop : text.ops) mix(uop.raw);
+    return hash;
+}
+
+// Section layouts of the shared state: one function per struct serves
+// SnapshotWriter and SnapshotReader, so saved and restored fields cannot
+// drift apart
+template <typename Archive>
+void serialize(Archive& ar, CoreState& core) {
+    ar(core.pc);
+    for (uint32_t& r : core.regs) ar(r);
+    ar(core.cycles);
+    ar(core.instructions);
+    ar(core.text_fingerprint);
+}
+
+template <typename Archive>
+void serialize(Archive& ar, CsrFile& csrs) {
+    ar(csrs.mscratch);
+    for (uint64_t& offset : csrs.offsets) ar(offset);
+    ar(csrs.mstatus);
+    ar(csrs.mie);
+    ar(csrs.mtvec);
+    ar(csrs.mepc);
+    ar(csrs.mcause);
+    ar(csrs.mtval);
+}
+
+template <typename Archive>
+void serialize(Archive& ar, DmaEngine& dma) {
+    ar(dma.src);
+    ar(dma.dst);
+    ar(dma.length);
+    ar(dma.copied);
+    ar(dma.busy);
+    ar(dma.done);
+    ar(dma.interrupt_enable);
+}
+
+template <typename Archive>
+void serialize(Archive& ar, Reservation& reservation) {
+    ar(reservation.addr);
+    ar(reservation.value);
+    ar(reservation.valid);
+}
+
+// Writes sections; each section is built in memory and framed on end()
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const string& filename) : file(filename, ios::binary), stream(file) {
+        start();
+    }
+
+    // Into memory, for checkpoints (Checkpoint_Log.h); see image()
+    SnapshotWriter() : stream(buffer) {
+        start();
+    }
+
+    bool ok() const { return stream.good(); }
+
+    string image() const { return buffer.str(); }
+
+    void begin(SnapshotSection tag) {
+        section = tag;
+        payload.clear();
+    }
+
+    void end() {
+        putRaw(stream, static_cast<uint32_t>(section));
+        putRaw(stream, static_cast<uint32_t>(payload.size()));
+        stream.write(payload.data(), payload.size());
+    }
+
+    // Scalars and enums, and the structs that have a serialize() above; the
+    // same call reads in SnapshotReader
+    template <typename T>
+    void operator()(T& value) {
+        if constexpr (is_arithmetic<T>::value || is_enum<T>::value) putScalar(value);
+        else serialize(*this, value);
+    }
+
+    // Only allocated pages that hold a non-zero byte
+    void memory(const SparseMemory& memory) {
+        uint32_t count = 0;
+        string pages;
+        memory.forEachPage([&](uint32_t base, const SparseMemory::Page& page) {
+            bool touched = false;
+            for (uint32_t i = 0; i < SparseMemory::PAGE_SIZE && !touched; i++) touched = page.bytes[i] != 0;
+            if (!touched) return;
+            count++;
+            for (int i = 0; i < 4; i++) pages += static_cast<char>((base >> (8 * i)) & 0xFF);
+            pages.append(reinterpret_cast<const char*>(page.bytes), SparseMemory::PAGE_SIZE);
+        });
+        (*this)(count);
+        payload += pages;
+    }
+
+private:
+    ofstream file;
+    ostringstream buffer;
+    ostream& stream;
+    SnapshotSection section = SNAP_CORE;
+    string payload;
+
+    void start() {
+        stream.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        putRaw(stream, SNAPSHOT_VERSION);
+    }
+
+    template <typename T>
+    void putScalar(T value) {
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++) payload += static_cast<char>((bits >> (8 * i)) & 0xFF);
+    }
+
+    static void putRaw(ostream& out, uint32_t value) {
+        char bytes[4];
+        for (int i = 0; i < 4; i++) bytes[i] = (value >> (8 * i)) & 0xFF;
+        out.write(bytes, 4);
+    }
+};
+
+// Reads a whole snapshot; open(tag) positions on a section for operator()
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const string& filename) {
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            error = "Cannot open " + filename;
+            return;
+        }
+        stringstream ss;
+        ss << file.rdbuf();
+        parse(ss.str(), filename);
+    }
+
+    // A SnapshotWriter::image()
+    static SnapshotReader fromImage(const string& image) {
+        SnapshotReader reader;
+        reader.parse(image, "checkpoint");
+        return reader;
+    }
+
+    bool ok() const { return valid && !failed; }
+    const string& message() const { return error; }
+
+    bool has(SnapshotSection tag) const { return sections.count(tag) != 0; }
+
+    bool open(SnapshotSection tag) {
+        auto it = sections.find(tag);
+        if (it == sections.end()) return false;
+        payload = &it->second;
+        cursor = 0;
+        return true;
+    }
+
+    // Reads what SnapshotWriter::operator() wrote
+    template <typename T>
+    void operator()(T& value) {
+        if constexpr (is_arithmetic<T>::value || is_enum<T>::value) getScalar(value);
+        else serialize(*this, value);
+    }
+
+    // Replaces the whole memory with the snapshot's pages
+    void memory(SparseMemory& memory) {
+        uint32_t count = 0;
+        (*this)(count);
+        memory.clear();
+        for (uint32_t i = 0; i < count && ok(); i++) {
+            uint32_t base = 0;
+            (*this)(base);
+            if (cursor + SparseMemory::PAGE_SIZE > payload->size()) {
+                fail("memory section ends early");
+                return;
+            }
+            memory.copyIn(base, payload->data() + cursor, SparseMemory::PAGE_SIZE);
+            cursor += SparseMemory::PAGE_SIZE;
+        }
+    }
+
+private:
+    map<uint32_t, string> sections;
+    const string* payload = nullptr;
+    size_t cursor = 0;
+    uint32_t version = 0;
+    bool valid = false;
+    bool failed = false;
+    string error;
+
+    SnapshotReader() {}
+
+    template <typename T>
+    void getScalar(T& value) {
+        uint64_t bits = 0;
+        if (!payload || cursor + sizeof(T) > payload->size()) {
+            fail("section ends early");
+            value = T();
+            return;
+        }
+        for (size_t i = 0; i < sizeof(T); i++) bits |= static_cast<uint64_t>(static_cast<uint8_t>((*payload)[cursor + i])) << (8 * i);
+        cursor += sizeof(T);
+        memcpy(&value, &bits, sizeof(T));
+    }
+
+    void parse(const string& data, const string& filename) {
+        if (data.size() < 12 || memcmp(data.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            error = filename + " is not a simulator snapshot";
+            return;
+        }
+        version = getRaw(data, 8);
+        if (version != SNAPSHOT_VERSION) {
+            error = filename + " has snapshot version " + to_string(version) + ", expected " + to_string(SNAPSHOT_VERSION);
+            return;
+        }
+        size_t pos = 12;
+        while (pos + 8 <= data.size()) {
+            uint32_t tag = getRaw(data, pos);
+            uint32_t length = getRaw(data, pos + 4);
+            pos += 8;
+            if (pos + length > data.size()) {
+                error = filename + " is truncated";
+                return;
+            }
+            sections[tag] = data.substr(pos, length);
+            pos += length;
+        }
+        valid = true;
+    }
+
+    void fail(const string& why) {
+        if (!failed) error = "Snapshot " + why;
+        failed = true;
+    }
+
+    static uint32_t getRaw(const string& data, size_t pos) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+        return value;
+    }
+};
+
+#endif
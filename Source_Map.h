@@ -0,0 +1,49 @@
+#ifndef SOURCE_MAP_H
+#define SOURCE_MAP_H
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "Auxiliary_Functions.h"
+
+using namespace std;
+
+// Source line that produced the instruction at a given PC
+struct SourceLine {
+    int line_number = 0;
+    string text;
+};
+
+// Rebuild the PC of every .text instruction the same way the assembler's first pass does
+inline bool loadSourceMap(const string& asm_file, unordered_map<uint32_t, SourceLine>& source_map) {
+    ifstream input(asm_file);
+    if (!input.is_open()) return false;
+
+    string line;
+    int line_number = 0;
+    uint32_t pc = 0;
+    bool isText = true, isData = true;
+    while (getline(input, line)) {
+        ++line_number;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        if (line == ".data") {
+            isText = false;
+            isData = true;
+            continue;
+        } else if (line == ".text") {
+            isText = true;
+            isData = false;
+            continue;
+        }
+        if (isData || !isText) continue;
+        if (line.find(':') != string::npos) continue; // Labels take no space
+
+        source_map[pc] = {line_number, line};
+        pc += 4;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef SPARSE_MEMORY_H
+#define SPARSE_MEMORY_H
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+using namespace std;
+
+// Byte-addressable little-endian memory for the whole 32-bit address space.
+// 4 KiB pages are allocated on first write and found through a two-level
+// page table (10 + 10 bits of page number), so every access is O(1) and
+// unwritten memory reads as zero without using space. Every write marks its
+// page dirty for each consumer until takeDirty() collects it for that one, so
+// writers of memory images and checkpoints only touch the pages that changed.
+// Several threads may read and write one memory at once (multi-hart runs):
+// table and page slots are installed with compare-and-swap, so a lookup
+// never takes a lock.
+class SparseMemory {
+public:
+    static const uint32_t PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t TABLE_BITS = 10;
+    static const uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+
+    // Consumers of the dirty marks
+    static const uint8_t DIRTY_WRITEBACK = 1;  // Memory_Writeback.h
+    static const uint8_t DIRTY_CHECKPOINT = 2; // Checkpoint_Log.h
+    static const uint8_t DIRTY_ALL = DIRTY_WRITEBACK | DIRTY_CHECKPOINT;
+
+    struct Page {
+        uint8_t bytes[PAGE_SIZE];
+        atomic<uint8_t> dirty{0};
+    };
+
+    SparseMemory() {
+        for (uint32_t i = 0; i < TABLE_SIZE; i++) tables[i].store(nullptr, memory_order_relaxed);
+    }
+
+    ~SparseMemory() { clear(); }
+
+    SparseMemory(const SparseMemory&) = delete;
+    SparseMemory& operator=(const SparseMemory&) = delete;
+
+    // Drop every page; no other thread may use the memory meanwhile
+    void clear() {
+        for (uint32_t i = 0; i < TABLE_SIZE; i++) {
+            Table* table = tables[i].exchange(nullptr, memory_order_relaxed);
+            if (!table) continue;
+            for (uint32_t j = 0; j < TABLE_SIZE; j++) delete table->pages[j].load(memory_order_relaxed);
+            delete table;
+        }
+        page_count = 0;
+    }
+
+    size_t pages() const { return page_count; }
+
+    bool isMapped(uint32_t addr) const { return findPage(addr) != nullptr; }
+
+    uint8_t read8(uint32_t addr) const {
+        const Page* page = findPage(addr);
+        return page ? page->bytes[addr & (PAGE_SIZE - 1)] : 0;
+    }
+
+    uint16_t read16(uint32_t addr) const {
+        uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (offset > PAGE_SIZE - 2) return read8(addr) | (read8(addr + 1) << 8);
+        const Page* page = findPage(addr);
+        if (!page) return 0;
+        const uint8_t* p = page->bytes + offset;
+        return p[0] | (p[1] << 8);
+    }
+
+    uint32_t read32(uint32_t addr) const {
+        uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (offset > PAGE_SIZE - 4) return read16(addr) | (static_cast<uint32_t>(read16(addr + 2)) << 16);
+        const Page* page = findPage(addr);
+        if (!page) return 0;
+        const uint8_t* p = page->bytes + offset;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    void write8(uint32_t addr, uint8_t value) {
+        pageFor(addr)->bytes[addr & (PAGE_SIZE - 1)] = value;
+    }
+
+    void write16(uint32_t addr, uint16_t value) {
+        uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (offset > PAGE_SIZE - 2) {
+            write8(addr, value & 0xFF);
+            write8(addr + 1, value >> 8);
+            return;
+        }
+        uint8_t* p = pageFor(addr)->bytes + offset;
+        p[0] = value & 0xFF;
+        p[1] = value >> 8;
+    }
+
+    void write32(uint32_t addr, uint32_t value) {
+        uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (offset > PAGE_SIZE - 4) {
+            write16(addr, value & 0xFFFF);
+            write16(addr + 2, value >> 16);
+            return;
+        }
+        uint8_t* p = pageFor(addr)->bytes + offset;
+        p[0] = value & 0xFF;
+        p[1] = (value >> 8) & 0xFF;
+        p[2] = (value >> 16) & 0xFF;
+        p[3] = value >> 24;
+    }
+
+    // Aligned word for atomic read-modify-write (addr must be a multiple of 4);
+    // the host is little-endian like the guest, so it holds the guest value
+    uint32_t* word(uint32_t addr) {
+        return reinterpret_cast<uint32_t*>(pageFor(addr)->bytes + (addr & (PAGE_SIZE - 1) & ~3u));
+    }
+
+    // Store the low size bytes of value, for data.mc entries of any width
+    void writeValue(uint32_t addr, uint64_t value, int size) {
+        for (int i = 0; i < size; i++) write8(addr + i, (value >> (8 * i)) & 0xFF);
+    }
+
+    // Load size bytes (up to 8) as one little-endian value
+    uint64_t readValue(uint32_t addr, int size) const {
+        uint64_t value = 0;
+        for (int i = 0; i < size; i++) value |= static_cast<uint64_t>(read8(addr + i)) << (8 * i);
+        return value;
+    }
+
+    // Bulk copy for loaders, one page at a time
+    void copyIn(uint32_t addr, const void* src, size_t length) {
+        const uint8_t* from = static_cast<const uint8_t*>(src);
+        while (length > 0) {
+            uint32_t offset = addr & (PAGE_SIZE - 1);
+            size_t chunk = PAGE_SIZE - offset < length ? PAGE_SIZE - offset : length;
+            memcpy(pageFor(addr)->bytes + offset, from, chunk);
+            addr += chunk;
+            from += chunk;
+            length -= chunk;
+        }
+    }
+
+    // Bulk copy for dumps; unmapped ranges read as zero
+    void copyOut(uint32_t addr, void* dst, size_t length) const {
+        uint8_t* to = static_cast<uint8_t*>(dst);
+        while (length > 0) {
+            uint32_t offset = addr & (PAGE_SIZE - 1);
+            size_t chunk = PAGE_SIZE - offset < length ? PAGE_SIZE - offset : length;
+            const Page* page = findPage(addr);
+            if (page) memcpy(to, page->bytes + offset, chunk);
+            else memset(to, 0, chunk);
+            addr += chunk;
+            to += chunk;
+            length -= chunk;
+        }
+    }
+
+    // Call visit(page_base, page) for every allocated page in address order
+    template <typename Visitor>
+    void forEachPage(Visitor visit) const {
+        for (uint32_t i = 0; i < TABLE_SIZE; i++) {
+            const Table* table = tables[i].load(memory_order_acquire);
+            if (!table) continue;
+            for (uint32_t j = 0; j < TABLE_SIZE; j++) {
+                const Page* page = table->pages[j].load(memory_order_acquire);
+                if (page) visit((i << (TABLE_BITS + PAGE_BITS)) | (j << PAGE_BITS), *page);
+            }
+        }
+    }
+
+    // Call visit(addr, word) for every non-zero aligned word in address order
+    template <typename Visitor>
+    void forEachWord(Visitor visit) const {
+        forEachPage([&](uint32_t base, const Page& page) {
+            for (uint32_t offset = 0; offset < PAGE_SIZE; offset += 4) {
+                const uint8_t* p = page.bytes + offset;
+                uint32_t word = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+                if (word) visit(base + offset, word);
+            }
+        });
+    }
+
+    // Call visit(page_base, page) for every page written since the last call
+    // for the same consumer, clearing that consumer's dirty mark
+    template <typename Visitor>
+    void takeDirty(Visitor visit, uint8_t consumer = DIRTY_WRITEBACK) {
+        for (uint32_t i = 0; i < TABLE_SIZE; i++) {
+            Table* table = tables[i].load(memory_order_acquire);
+            if (!table) continue;
+            for (uint32_t j = 0; j < TABLE_SIZE; j++) {
+                Page* page = table->pages[j].load(memory_order_acquire);
+                if (!page || !(page->dirty.fetch_and(static_cast<uint8_t>(~consumer), memory_order_relaxed) & consumer)) continue;
+                visit((i << (TABLE_BITS + PAGE_BITS)) | (j << PAGE_BITS), *page);
+            }
+        }
+    }
+
+private:
+    struct Table {
+        atomic<Page*> pages[TABLE_SIZE];
+        Table() {
+            for (uint32_t i = 0; i < TABLE_SIZE; i++) pages[i].store(nullptr, memory_order_relaxed);
+        }
+    };
+
+    atomic<Table*> tables[TABLE_SIZE];
+    atomic<size_t> page_count{0};
+
+    const Page* findPage(uint32_t addr) const {
+        const Table* table = tables[addr >> (TABLE_BITS + PAGE_BITS)].load(memory_order_acquire);
+        if (!table) return nullptr;
+        return table->pages[(addr >> PAGE_BITS) & (TABLE_SIZE - 1)].load(memory_order_acquire);
+    }
+
+    Page* pageFor(uint32_t addr) {
+        atomic<Table*>& table_slot = tables[addr >> (TABLE_BITS + PAGE_BITS)];
+        Table* table = table_slot.load(memory_order_acquire);
+        if (!table) table = install(table_slot, new Table());
+        atomic<Page*>& page_slot = table->pages[(addr >> PAGE_BITS) & (TABLE_SIZE - 1)];
+        Page* page = page_slot.load(memory_order_acquire);
+        if (!page) {
+            Page* fresh = new Page();
+            page = install(page_slot, fresh);
+            if (page == fresh) page_count++;
+        }
+        if (page->dirty.load(memory_order_relaxed) != DIRTY_ALL) page->dirty.store(DIRTY_ALL, memory_order_relaxed);
+        return page;
+    }
+
+    // Publish a fresh slot value; if another thread got there first, keep
+    // its value and drop ours
+    template <typename T>
+    T* install(atomic<T*>& slot, T* fresh) {
+        T* current = nullptr;
+        if (slot.compare_exchange_strong(current, fresh, memory_order_acq_rel, memory_order_acquire)) return fresh;
+        delete fresh;
+        return current;
+    }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include "Sparse_Memory.h"
+
+using namespace std;
+
+// Linux RV32 system call numbers (a7) understood by the simulators
+const uint32_t SYS_READ = 63;
+const uint32_t SYS_WRITE = 64;
+const uint32_t SYS_EXIT = 93;
+const uint32_t SYS_EXIT_GROUP = 94;
+const uint32_t SYS_CLOCK_GETTIME = 113;
+const uint32_t SYS_BRK = 214;
+
+const uint32_t HEAP_BASE = 0x10008000;  // Heap start in the memory layout
+const uint32_t HEAP_LIMIT = 0x7FF00000; // brk never reaches the stack
+const uint64_t NS_PER_CYCLE = 1;        // clock_gettime runs on a 1 GHz cycle clock
+
+const int32_t SYS_EBADF = -9;
+const int32_t SYS_EFAULT = -14;
+const int32_t SYS_ENOSYS = -38;
+
+// ecall emulation with the Linux ABI: a7 selects the call, a0-a2 carry the
+// arguments and the result (or -errno) is returned in a0. Guest writes go to
+// the host's stdout (fd 1) and stderr (fd 2); fd 0 reads only the input file
+// given to setInput(), so a guest cannot reach any other host file.
+class SyscallEmulator {
+public:
+    explicit SyscallEmulator(SparseMemory& memory) : memory(memory) {}
+    ~SyscallEmulator() { flushConsole(); }
+
+    // Streams behind the guest's fd 1 and fd 2
+    void setOutput(ostream& stdout_stream, ostream& stderr_stream) {
+        guest_out = &stdout_stream;
+        guest_err = &stderr_stream;
+    }
+
+    bool setInput(const string& path) {
+        input.close();
+        input.clear();
+        input.open(path, ios::binary);
+        if (!input.is_open()) {
+            *guest_out << "Error: Cannot open input file " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool exited() const { return has_exited; }
+    int exitCode() const { return exit_code; }
+
+    // State carried by snapshots
+    uint32_t heapEnd() const { return brk; }
+    uint64_t inputOffset() { return input.is_open() ? static_cast<uint64_t>(input.tellg()) : 0; }
+
+    // Back to a state before the program exited
+    void restore(uint32_t heap_end, uint64_t input_offset) {
+        brk = heap_end;
+        has_exited = false;
+        exit_code = 0;
+        if (input.is_open()) {
+            input.clear();
+            input.seekg(input_offset);
+        }
+    }
+
+    // End the program with code, as exit does (also the MMIO test finisher)
+    void exit(int code) {
+        has_exited = true;
+        exit_code = code;
+        flushConsole();
+        guest_out->flush();
+    }
+
+    // Console device (Mmio_Bus.h): one byte to fd 1, or the next byte of the
+    // input file (-1 at its end), sharing the position with read. Output is
+    // written a line at a time, so it is not split up by the simulator's log.
+    void putByte(char c) {
+        console_line += c;
+        if (c == '\n') flushConsole();
+    }
+
+    void flushConsole() {
+        if (console_line.empty()) return;
+        *guest_out << console_line;
+        guest_out->flush();
+        console_line.clear();
+    }
+
+    int getByte() {
+        if (!input.is_open()) return -1;
+        int c = input.get();
+        if (c != char_traits<char>::eof()) return c;
+        input.clear(); // Stay at the end, so inputOffset() still works
+        return -1;
+    }
+
+    // Run one ecall and return the new a0
+    uint32_t call(uint32_t number, uint32_t a0, uint32_t a1, uint32_t a2, uint64_t cycle) {
+        switch (number) {
+            case SYS_EXIT:
+            case SYS_EXIT_GROUP:
+                exit(static_cast<int32_t>(a0));
+                return a0;
+            case SYS_WRITE: {
+                if (a0 != 1 && a0 != 2) return SYS_EBADF;
+                if (a1 + a2 < a1 || !mapped(a1, a2)) return SYS_EFAULT;
+                flushConsole();
+                ostream& out = a0 == 1 ? *guest_out : *guest_err;
+                char buffer[SparseMemory::PAGE_SIZE];
+                for (uint32_t done = 0; done < a2;) {
+                    uint32_t length = chunk(a1 + done, a2 - done);
+                    memory.copyOut(a1 + done, buffer, length);
+                    out.write(buffer, length);
+                    done += length;
+                }
+                out.flush();
+                return a2;
+            }
+            case SYS_READ: {
+                if (a0 != 0) return SYS_EBADF;
+                if (a1 + a2 < a1) return SYS_EFAULT;
+                if (!input.is_open()) return 0; // No input file: end of file
+                char buffer[SparseMemory::PAGE_SIZE];
+                uint32_t got = 0;
+                while (got < a2) {
+                    uint32_t length = chunk(a1 + got, a2 - got);
+                    input.read(buffer, length);
+                    uint32_t count = input.gcount();
+                    memory.copyIn(a1 + got, buffer, count);
+                    got += count;
+                    if (count < length) break;
+                }
+                if (input.eof()) input.clear(); // Stay at the end, so inputOffset() still works
+                return got;
+            }
+            case SYS_BRK:
+                // brk(0) or an address outside the heap returns the current break
+                if (a0 >= HEAP_BASE && a0 < HEAP_LIMIT) brk = a0;
+                return brk;
+            case SYS_CLOCK_GETTIME: {
+                // struct timespec with 64-bit fields, as on rv32 Linux
+                if (a1 == 0) return SYS_EFAULT;
+                uint64_t ns = cycle * NS_PER_CYCLE;
+                memory.writeValue(a1, ns / 1000000000, 8);
+                memory.writeValue(a1 + 8, ns % 1000000000, 8);
+                return 0;
+            }
+            default:
+                *guest_out << "Warning: Unsupported ecall " << number << ", returning -ENOSYS\n";
+                return SYS_ENOSYS;
+        }
+    }
+
+private:
+    SparseMemory& memory;
+    ostream* guest_out = &cout;
+    ostream* guest_err = &cerr;
+    ifstream input;
+    uint32_t brk = HEAP_BASE;
+    string console_line;       // Console output since the last newline
+    bool has_exited = false;
+    int exit_code = 0;
+
+    // Bytes of a guest buffer at addr up to the end of its page, at most left:
+    // read and write copy page by page, whatever size the guest asks for
+    static uint32_t chunk(uint32_t addr, uint32_t left) {
+        return min(left, SparseMemory::PAGE_SIZE - (addr & (SparseMemory::PAGE_SIZE - 1)));
+    }
+
+    // Whether every page of [addr, addr + length) has been loaded or written:
+    // write must not stream zeros from memory the program never touched
+    bool mapped(uint32_t addr, uint32_t length) const {
+        for (uint32_t done = 0; done < length; done += chunk(addr + done, length - done)) {
+            if (!memory.isMapped(addr + done)) return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef WATCHPOINTS_H
+#define WATCHPOINTS_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "Sparse_Memory.h"
+#include "Source_Map.h"
+
+using namespace std;
+
+// Kinds of access a watchpoint reports
+const uint8_t WATCH_READ = 1;
+const uint8_t WATCH_WRITE = 2;   // Every store to the range
+const uint8_t WATCH_CHANGE = 4;  // Stores that change a byte of the range
+
+struct Watchpoint {
+    uint32_t addr = 0;
+    uint32_t size = 4;
+    uint8_t kinds = 0;
+    bool stop = false;      // Stop the run (or, under --gdb, the debugger's resume) after the access
+    bool debugger = false;  // Set by GDB (Z2-Z4)
+};
+
+// A watchpoint hit the simulator stopped for
+struct WatchHit {
+    uint32_t addr = 0;
+    uint8_t kinds = 0;
+};
+
+// Data watchpoints for the memory stage of code.cpp's step mode and of
+// pipeline.cpp. Every 4 KiB page a watch covers has its bit set in a flat
+// bitmap of the 32-bit address space (128 KiB, allocated with the first
+// watch), so a load or store tests one bit, and only accesses to a flagged
+// page walk the watch list. A hit is logged with the PC, the cycle, the old
+// and new value and the source line from main.asm.
+class WatchList {
+public:
+    bool empty() const { return watches.empty(); }
+    const vector<Watchpoint>& list() const { return watches; }
+
+    // The source lines of the hit reports
+    void loadSource(const string& asm_file) { loadSourceMap(asm_file, source); }
+
+    void add(const Watchpoint& watch) {
+        watches.push_back(watch);
+        flag(watch);
+    }
+
+    // Remove a watch the debugger set; false if there was none
+    bool remove(uint32_t addr, uint32_t size, uint8_t kinds) {
+        for (size_t i = 0; i < watches.size(); i++) {
+            const Watchpoint& watch = watches[i];
+            if (watch.debugger && watch.addr == addr && watch.size == size && watch.kinds == kinds) {
+                watches.erase(watches.begin() + i);
+                pages.assign(pages.size(), 0);
+                for (const Watchpoint& rest : watches) flag(rest);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The fast check: an access of size bytes at addr touches a watched page
+    bool flagged(uint32_t addr, uint32_t size) const {
+        if (pages.empty()) return false;
+        uint32_t first = addr >> SparseMemory::PAGE_BITS, last = (addr + size - 1) >> SparseMemory::PAGE_BITS;
+        return (pages[first >> 6] >> (first & 63) & 1) || (pages[last >> 6] >> (last & 63) & 1);
+    }
+
+    // The slow check for an access to a flagged page. A load passes its value
+    // as both old and new; an AMO is a read and a write. Logs each hit and
+    // returns true if one of them stops the run.
+    bool check(ostream& log, uint32_t pc, uint64_t cycle, uint32_t addr, uint32_t size, bool read, bool write,
+               uint32_t old_value, uint32_t new_value) {
+        bool stop = false;
+        for (const Watchpoint& watch : watches) {
+            if (addr >= watch.addr + watch.size || watch.addr >= addr + size) continue;
+            uint8_t kinds = 0;
+            if (read && (watch.kinds & WATCH_READ)) kinds |= WATCH_READ;
+            if (write && (watch.kinds & WATCH_WRITE)) kinds |= WATCH_WRITE;
+            if (write && (watch.kinds & WATCH_CHANGE) && changed(watch, addr, size, old_value, new_value)) kinds |= WATCH_CHANGE;
+            if (!kinds) continue;
+            hits++;
+            const char* kind = kinds == WATCH_READ ? "read" : kinds & WATCH_READ ? "access" : kinds & WATCH_WRITE ? "write" : "change";
+            log << "Watchpoint: " << kind << " of " << to_hex(watch.addr) << " (" << watch.size << " bytes) by " << size << "-byte access at "
+                << to_hex(addr) << ", pc " << to_hex(pc);
+            auto line = source.find(pc);
+            if (line != source.end()) log << " (line " << line->second.line_number << ": " << line->second.text << ")";
+            log << ", cycle " << cycle << ": ";
+            if (write) log << to_hex(old_value) << " -> " << to_hex(new_value);
+            else log << to_hex(new_value);
+            log << (watch.stop ? ", stopping\n" : "\n");
+            if (watch.stop && !stop) {
+                stop = true;
+                last = {watch.addr, watch.kinds};
+            }
+        }
+        return stop;
+    }
+
+    const WatchHit& lastHit() const { return last; }
+    uint64_t hitCount() const { return hits; }
+
+private:
+    vector<Watchpoint> watches;
+    vector<uint64_t> pages;  // One bit per page
+    unordered_map<uint32_t, SourceLine> source;
+    WatchHit last;
+    uint64_t hits = 0;
+
+    void flag(const Watchpoint& watch) {
+        if (pages.empty()) pages.assign((1u << (32 - SparseMemory::PAGE_BITS)) / 64, 0);
+        uint32_t first = watch.addr >> SparseMemory::PAGE_BITS;
+        uint32_t last_page = (watch.addr + watch.size - 1) >> SparseMemory::PAGE_BITS;
+        for (uint32_t page = first;; page++) {
+            pages[page >> 6] |= 1ull << (page & 63);
+            if (page == last_page) break;
+        }
+    }
+
+    // A byte of the watched range differs between old and new
+    static bool changed(const Watchpoint& watch, uint32_t addr, uint32_t size, uint32_t old_value, uint32_t new_value) {
+        for (uint32_t i = 0; i < size; i++) {
+            uint32_t byte = addr + i;
+            if (byte - watch.addr >= watch.size) continue;
+            if ((old_value >> (8 * i) & 0xFF) != (new_value >> (8 * i) & 0xFF)) return true;
+        }
+        return false;
+    }
+
+    static string to_hex(uint32_t value) {
+        stringstream ss;
+        ss << "0x" << setfill('0') << setw(8) << hex << uppercase << value;
+        return ss.str();
+    }
+};
+
+// --watch KIND:ADDR[:BYTES][:stop], KIND one of r, w, rw (reads and writes)
+// and c (writes that change the value); BYTES defaults to 4
+inline bool parse_watch(const string& spec, Watchpoint& watch) {
+    vector<string> parts;
+    stringstream ss(spec);
+    string part;
+    while (getline(ss, part, ':')) parts.push_back(part);
+    if (parts.size() < 2 || parts.size() > 4) return false;
+    if (parts[0] == "r") watch.kinds = WATCH_READ;
+    else if (parts[0] == "w") watch.kinds = WATCH_WRITE;
+    else if (parts[0] == "rw") watch.kinds = WATCH_READ | WATCH_WRITE;
+    else if (parts[0] == "c") watch.kinds = WATCH_CHANGE;
+    else return false;
+    try {
+        watch.addr = stoul(parts[1], nullptr, 0);
+        size_t next = 2;
+        if (parts.size() > next && parts[next] != "stop") watch.size = stoul(parts[next++], nullptr, 0);
+        if (parts.size() > next) {
+            if (parts[next] != "stop" || next + 1 != parts.size()) return false;
+            watch.stop = true;
+        }
+    } catch (const exception&) {
+        return false;
+    }
+    return watch.size > 0 && watch.addr + (watch.size - 1) >= watch.addr;
+}
+
+#endif
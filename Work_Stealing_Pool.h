@@ -0,0 +1,77 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+// Fixed set of worker threads, each with its own deque of task indices.
+// run() deals the tasks out round-robin; a worker takes tasks from the back
+// of its own deque and, once that is empty, steals from the front of the
+// others', so a few long tasks do not leave the remaining threads idle.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads) : workers(threads ? threads : 1) {}
+
+    unsigned size() const { return workers; }
+    size_t steals() const { return steal_count; }
+
+    // Call task(i) for every i in [0, count) and return once all have finished.
+    // Tasks run concurrently and must not throw.
+    void run(size_t count, const function<void(size_t)>& task) {
+        queues.clear();
+        for (unsigned w = 0; w < workers; w++) queues.emplace_back(new Queue());
+        for (size_t i = 0; i < count; i++) queues[i % workers]->tasks.push_back(i);
+
+        vector<thread> threads;
+        for (unsigned w = 0; w < workers; w++) {
+            threads.emplace_back([this, w, &task]() {
+                size_t index;
+                while (pop(w, index) || steal(w, index)) task(index);
+            });
+        }
+        for (thread& t : threads) t.join();
+    }
+
+private:
+    struct Queue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    unsigned workers;
+    vector<unique_ptr<Queue>> queues;
+    atomic<size_t> steal_count{0};
+
+    bool pop(unsigned w, size_t& index) {
+        Queue& q = *queues[w];
+        lock_guard<mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        index = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+
+    // Every task is queued before the workers start, so a full pass over
+    // the other deques that finds nothing means the work is done
+    bool steal(unsigned w, size_t& index) {
+        for (unsigned k = 1; k < workers; k++) {
+            Queue& victim = *queues[(w + k) % workers];
+            lock_guard<mutex> guard(victim.lock);
+            if (victim.tasks.empty()) continue;
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            steal_count++;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif
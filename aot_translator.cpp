@@ -0,0 +1,406 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <cstdint>
+#include "Riscv_Instructions.h"
+#include "Auxiliary_Functions.h"
+#include "Predecoder.h"
+#include "Csr.h"
+
+using namespace std;
+
+// Ahead-of-time translator: turns text.mc/data.mc into one C++ translation
+// unit that runs the program natively. Guest registers become locals, the
+// program is a switch on PC with a case per basic block (direct branches
+// are gotos, JALR goes back through the switch) and data memory is the
+// simulators' SparseMemory. The executable prints the same final state as
+// code.cpp.
+
+struct TranslatorKnobs {
+    string text_file = "text.mc";
+    string data_file = "data.mc";
+    string output_file = "translated.cpp";
+} knobs;
+
+// One data.mc entry
+struct DataEntry {
+    uint32_t addr = 0;
+    uint64_t value = 0;
+    int size = 0;
+};
+
+map<uint32_t, MicroOp> program; // Valid instructions by PC
+vector<DataEntry> data_entries;
+
+string to_hex(uint32_t val) {
+    stringstream ss;
+    ss << "0x" << setfill('0') << setw(8) << hex << uppercase << val;
+    return ss.str();
+}
+
+bool is_valid_hex(const string& str) {
+    if (str.empty() || str.length() < 3 || str.substr(0, 2) != "0x") return false;
+    for (size_t i = 2; i < str.length(); ++i) {
+        if (!isxdigit(str[i])) return false;
+    }
+    return true;
+}
+
+// Address/value pairs of an .mc file, comments stripped
+template <typename Visitor>
+bool read_mc(const string& filename, Visitor visit) {
+    ifstream file(filename);
+    if (!file.is_open()) return false;
+    string line;
+    while (getline(file, line)) {
+        size_t comment_pos = line.find('#');
+        if (comment_pos != string::npos) line = line.substr(0, comment_pos);
+        stringstream ss(line);
+        string addr_str, value_str;
+        if (!(ss >> addr_str >> value_str)) continue;
+        if (!is_valid_hex(addr_str) || !is_valid_hex(value_str)) continue;
+        try {
+            visit(stoul(addr_str, nullptr, 16), value_str);
+        } catch (const exception&) {
+            continue;
+        }
+    }
+    return true;
+}
+
+// Load text.mc; words that do not decode stop the program, as in code.cpp's
+// fast modes, and so does ebreak: translated code has no traps. mret and wfi
+// stop it with an error (translate_exit()).
+bool load_text(const string& filename) {
+    bool opened = read_mc(filename, [](uint32_t addr, const string& value) {
+        uint32_t ir = stoul(value, nullptr, 16);
+        if (ir == 0) return;
+        MicroOp uop = predecode(ir);
+        if (uop.op != OP_INVALID && (uop.klass != CLASS_PRIV || trap_only(uop))) program[addr] = uop;
+    });
+    return opened && !program.empty();
+}
+
+bool load_data(const string& filename) {
+    return read_mc(filename, [](uint32_t addr, const string& value) {
+        DataEntry entry;
+        entry.addr = addr;
+        entry.value = stoull(value, nullptr, 16);
+        entry.size = (value.length() - 1) / 2; // Entry width follows its hex digits
+        data_entries.push_back(entry);
+    });
+}
+
+bool in_text(uint32_t addr) {
+    return program.count(addr) != 0;
+}
+
+// Block leaders: the entry, targets of direct jumps and instructions after
+// control transfers, ecalls or gaps
+set<uint32_t> find_leaders(uint32_t entry) {
+    set<uint32_t> leaders;
+    if (in_text(entry)) leaders.insert(entry);
+    uint32_t prev = 0;
+    bool first = true;
+    for (const auto& item : program) {
+        uint32_t pc = item.first;
+        const MicroOp& uop = item.second;
+        if (first || pc != prev + 4) leaders.insert(pc);
+        first = false;
+        prev = pc;
+        if (uop.klass == CLASS_BRANCH || uop.klass == CLASS_JUMP) {
+            if (in_text(pc + 4)) leaders.insert(pc + 4);
+            if (uop.op != OP_JALR && in_text(pc + uop.imm)) leaders.insert(pc + uop.imm);
+        }
+        if ((uop.klass == CLASS_SYSTEM || uop.klass == CLASS_CSR || uop.klass == CLASS_PRIV) && in_text(pc + 4)) {
+            leaders.insert(pc + 4);
+        }
+    }
+    return leaders;
+}
+
+string reg(uint32_t r) {
+    return r == 0 ? "0u" : "x" + to_string(r);
+}
+
+string sreg(uint32_t r) {
+    return "(int32_t)" + reg(r);
+}
+
+string imm_text(int32_t imm) {
+    return "(uint32_t)" + to_string(imm);
+}
+
+string label(uint32_t pc) {
+    stringstream ss;
+    ss << "L_" << hex << setfill('0') << setw(8) << pc;
+    return ss.str();
+}
+
+// Jump to a guest address: a goto inside the text, otherwise stop there
+string jump_to(uint32_t target) {
+    if (in_text(target)) return "goto " + label(target) + ";";
+    return "{ pc = " + to_hex(target) + "u; goto done; }";
+}
+
+// C++ statement(s) for a non-control instruction; remaining counts it and the
+// rest of its block, for a load or store that stops at an MMIO address
+string translate(const MicroOp& uop, uint32_t pc, uint32_t remaining) {
+    string a = reg(uop.rs1), b = reg(uop.rs2), sa = sreg(uop.rs1), sb = sreg(uop.rs2);
+    string i = imm_text(uop.imm);
+    string value;
+    switch (uop.op) {
+        case OP_ADD: value = a + " + " + b; break;
+        case OP_SUB: value = a + " - " + b; break;
+        case OP_MUL: value = a + " * " + b; break;
+        case OP_DIV: value = "div32(" + a + ", " + b + ")"; break;
+        case OP_REM: value = "rem32(" + a + ", " + b + ")"; break;
+        case OP_AND: value = a + " & " + b; break;
+        case OP_OR: value = a + " | " + b; break;
+        case OP_XOR: value = a + " ^ " + b; break;
+        case OP_SLL: value = a + " << (" + b + " & 31)"; break;
+        case OP_SRL: value = a + " >> (" + b + " & 31)"; break;
+        case OP_SRA: value = "(uint32_t)(" + sa + " >> (" + b + " & 31))"; break;
+        case OP_SLT: value = "(uint32_t)(" + sa + " < " + sb + ")"; break;
+        case OP_ADDI: value = a + " + " + i; break;
+        case OP_ANDI: value = a + " & " + i; break;
+        case OP_ORI: value = a + " | " + i; break;
+        case OP_XORI: value = a + " ^ " + i; break;
+        case OP_SLTI: value = "(uint32_t)(" + sa + " < " + to_string(uop.imm) + ")"; break;
+        case OP_SLTIU: value = "(uint32_t)(" + a + " < " + i + ")"; break;
+        case OP_SLLI: value = a + " << " + to_string(uop.imm & 31); break;
+        case OP_SRLI: value = a + " >> " + to_string(uop.imm & 31); break;
+        case OP_SRAI: value = "(uint32_t)(" + sa + " >> " + to_string(uop.imm & 31) + ")"; break;
+        case OP_LUI: value = to_hex(uop.imm) + "u"; break;
+        case OP_AUIPC: value = to_hex(pc + uop.imm) + "u"; break;
+        case OP_LB: value = "(uint32_t)(int8_t)memory.read8(addr)"; break;
+        case OP_LH: value = "(uint32_t)(int16_t)memory.read16(addr)"; break;
+        case OP_LW: value = "memory.read32(addr)"; break;
+        case OP_LBU: value = "memory.read8(addr)"; break;
+        case OP_LHU: value = "memory.read16(addr)"; break;
+        case OP_SB: value = "memory.write8(addr, " + b + " & 0xFF)"; break;
+        case OP_SH: value = "memory.write16(addr, " + b + " & 0xFFFF)"; break;
+        case OP_SW: value = "memory.write32(addr, " + b + ")"; break;
+        case OP_LR_W: case OP_SC_W: case OP_AMOSWAP_W: case OP_AMOADD_W: case OP_AMOXOR_W: case OP_AMOAND_W:
+        case OP_AMOOR_W: case OP_AMOMIN_W: case OP_AMOMAX_W: case OP_AMOMINU_W: case OP_AMOMAXU_W:
+        {
+            string name = string("OP_") + op_name(uop.op);
+            name[name.length() - 2] = '_'; // LR.W -> OP_LR_W
+            value = "atomic_execute(memory, reservation, " + name + ", " + a + ", " + b + ")";
+            break;
+        }
+        default: return "";
+    }
+    string statement = uop.write_mask ? reg(uop.rd) + " = " + value + ";" : "(void)(" + value + ");";
+    if (uop.klass != CLASS_LOAD && uop.klass != CLASS_STORE) return statement;
+    return "{ uint32_t addr = " + a + " + " + i + "; MMIO_STOP(addr, " + to_hex(pc) + "u, " + to_string(remaining) + ") " +
+           statement + " }";
+}
+
+// Control transfer, ecall, CSR instruction, mret or wfi ending a block
+string translate_exit(const MicroOp& uop, uint32_t pc) {
+    stringstream ss;
+    string link = uop.write_mask ? reg(uop.rd) + " = " + to_hex(pc + 4) + "u; " : "";
+    switch (uop.op) {
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: {
+            string cmp = uop.op == OP_BEQ ? " == " : uop.op == OP_BNE ? " != " : uop.op == OP_BLT ? " < " : " >= ";
+            ss << "if (" << sreg(uop.rs1) << cmp << sreg(uop.rs2) << ") " << jump_to(pc + uop.imm) << "\n";
+            ss << "        " << jump_to(pc + 4);
+            break;
+        }
+        case OP_JAL:
+            ss << link << jump_to(pc + uop.imm);
+            break;
+        case OP_ECALL:
+            // executed already counts the ecall; the simulators pass the count before it
+            ss << "x10 = sys.call(x17, x10, x11, x12, executed - 1);\n";
+            ss << "        if (sys.exited()) { pc = " << to_hex(pc + 4) << "u; goto done; }\n";
+            ss << "        " << jump_to(pc + 4);
+            break;
+        case OP_CSRRW: case OP_CSRRS: case OP_CSRRC: case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI: {
+            // Counts as in code.cpp: one cycle per instruction, before this one
+            string a = uop.op >= OP_CSRRWI ? "0u" : reg(uop.rs1);
+            ss << "{ static const MicroOp uop = predecode(" << to_hex(uop.raw) << "u);\n";
+            ss << "          CounterValues raw = {};\n";
+            ss << "          raw[COUNTER_CYCLE] = raw[COUNTER_TIME] = raw[COUNTER_INSTRET] = executed - 1;\n";
+            ss << "          uint32_t old;\n";
+            ss << "          if (!csrs.execute(uop, " << a << ", raw, old)) {\n";
+            ss << "              cout << \"Error: Illegal instruction " << disassemble(uop) << " at " << to_hex(pc) << "\\n\";\n";
+            ss << "              executed--; pc = " << to_hex(pc) << "u; goto done;\n";
+            ss << "          }\n";
+            ss << "          " << (uop.write_mask ? reg(uop.rd) + " = old;" : "(void)old;") << " }\n";
+            ss << "        if (csrs.has_handler()) {\n";
+            ss << "            cout << \"Error: " << disassemble(uop) << " at " << to_hex(pc)
+               << " installs a trap handler; run the program with code.cpp or pipeline.cpp\\n\";\n";
+            ss << "            pc = " << to_hex(pc + 4) << "u; goto done;\n";
+            ss << "        }\n";
+            ss << "        " << jump_to(pc + 4);
+            break;
+        }
+        case OP_MRET: case OP_WFI:
+            ss << "cout << \"Error: " << disassemble(uop) << " at " << to_hex(pc)
+               << " needs traps; run the program with code.cpp or pipeline.cpp\\n\";\n";
+            ss << "        executed--; pc = " << to_hex(pc) << "u; goto done;";
+            break;
+        default: // JALR
+            ss << "{ uint32_t target = (" << reg(uop.rs1) << " + " << imm_text(uop.imm) << ") & ~1u; "
+               << link << "pc = target; goto dispatch; }";
+            break;
+    }
+    return ss.str();
+}
+
+void write_program(ostream& out) {
+    const uint32_t entry = 0;
+    set<uint32_t> leaders = find_leaders(entry);
+
+    out << "// Generated by aot_translator from " << knobs.text_file << " and " << knobs.data_file << "; do not edit.\n";
+    out << "// Build: g++ -std=c++17 -O2 -I <simulator sources> " << knobs.output_file << "\n";
+    out << "#include <iostream>\n#include <iomanip>\n#include <sstream>\n#include <chrono>\n#include <cstdint>\n";
+    out << "#include \"Sparse_Memory.h\"\n#include \"Syscalls.h\"\n#include \"Atomics.h\"\n#include \"Csr.h\"\n#include \"Mmio_Bus.h\"\n\nusing namespace std;\n\n";
+    out << "#if defined(__GNUC__)\n#pragma GCC diagnostic ignored \"-Wunused-label\"\n#endif\n\n";
+    out << "SparseMemory memory;\nSyscallEmulator sys(memory);\nReservation reservation;\nCsrFile csrs;\n\n";
+    out << "string to_hex(uint32_t val) {\n"
+           "    stringstream ss;\n"
+           "    ss << \"0x\" << setfill('0') << setw(8) << hex << uppercase << val;\n"
+           "    return ss.str();\n"
+           "}\n\n";
+    out << "inline uint32_t div32(uint32_t a, uint32_t b) {\n"
+           "    if (b == 0) return 0xFFFFFFFFu;\n"
+           "    if (a == 0x80000000u && b == 0xFFFFFFFFu) return a;\n"
+           "    return (uint32_t)((int32_t)a / (int32_t)b);\n"
+           "}\n\n";
+    out << "inline uint32_t rem32(uint32_t a, uint32_t b) {\n"
+           "    if (b == 0) return a;\n"
+           "    if (a == 0x80000000u && b == 0xFFFFFFFFu) return 0;\n"
+           "    return (uint32_t)((int32_t)a % (int32_t)b);\n"
+           "}\n\n";
+
+    // Initial data.mc image
+    out << "// Only the simulators model the MMIO devices: an access stops the run before it\n";
+    out << "#define MMIO_STOP(addr, at, remaining) if (MmioBus::contains(addr)) { \\\n"
+           "    cout << \"Error: MMIO access to \" << to_hex(addr) << \" at \" << to_hex(at) \\\n"
+           "         << \"; run the program with code.cpp or pipeline.cpp\\n\"; \\\n"
+           "    executed -= remaining; pc = at; goto done; \\\n"
+           "}\n\n";
+    out << "struct DataEntry { uint32_t addr; uint64_t value; int size; };\n";
+    out << "const DataEntry data_image[] = {\n";
+    for (const DataEntry& e : data_entries)
+        out << "    {" << to_hex(e.addr) << "u, 0x" << hex << uppercase << e.value << dec << "ull, " << e.size << "},\n";
+    out << "    {0, 0, 0}\n};\n\n";
+
+    out << "int main(int argc, char* argv[]) {\n";
+    out << "    if (argc > 1 && !sys.setInput(argv[1])) return 1; // Input for read(0, ...)\n";
+    out << "    for (const DataEntry& e : data_image) memory.writeValue(e.addr, e.value, e.size);\n";
+    // Same initial registers as init_sim() in code.cpp
+    uint32_t init[32] = {0};
+    init[2] = 0x7FFFFFE4;
+    init[3] = 0x10000000;
+    init[10] = 0x00000001;
+    init[11] = 0x07FFFFE4;
+    out << "    uint32_t";
+    for (int r = 1; r < 32; r++) out << (r > 1 ? "," : "") << (r % 8 == 0 ? "\n        " : " ") << "x" << r << " = " << to_hex(init[r]) << "u";
+    out << ";\n";
+    out << "    uint32_t pc = " << to_hex(entry) << "u;\n";
+    out << "    long long executed = 0;\n";
+    out << "    auto start = chrono::steady_clock::now();\n\n";
+    out << "dispatch:\n";
+    out << "    switch (pc) {\n";
+
+    // Blocks in address order; later instructions of a block are entered
+    // from the switch (indirect jumps) through stubs that count the rest
+    vector<string> mid_entries;
+    auto it = program.begin();
+    while (it != program.end()) {
+        uint32_t block_pc = it->first;
+        auto end = it;
+        uint32_t length = 0;
+        bool control = false;
+        do {
+            length++;
+            control = end->second.klass == CLASS_BRANCH || end->second.klass == CLASS_JUMP || end->second.klass == CLASS_SYSTEM ||
+                      end->second.klass == CLASS_CSR || end->second.klass == CLASS_PRIV;
+            ++end;
+        } while (!control && end != program.end() && !leaders.count(end->first));
+
+        out << "    case " << to_hex(block_pc) << "u: " << label(block_pc) << ":\n";
+        out << "        executed += " << length << ";\n";
+        uint32_t remaining = length;
+        for (auto cur = it; cur != end; ++cur, --remaining) {
+            uint32_t pc = cur->first;
+            const MicroOp& uop = cur->second;
+            if (pc != block_pc) {
+                out << "    I_" << label(pc).substr(2) << ":\n";
+                stringstream stub;
+                stub << "    case " << to_hex(pc) << "u: executed += " << remaining << "; goto I_" << label(pc).substr(2) << ";\n";
+                mid_entries.push_back(stub.str());
+            }
+            out << "        // " << to_hex(pc) << ": " << disassemble(uop) << "\n";
+            bool exit = uop.klass == CLASS_BRANCH || uop.klass == CLASS_JUMP || uop.klass == CLASS_SYSTEM ||
+                        uop.klass == CLASS_CSR || uop.klass == CLASS_PRIV;
+            if (exit) out << "        " << translate_exit(uop, pc) << "\n";
+            else out << "        " << translate(uop, pc, remaining) << "\n";
+        }
+        if (!control) {
+            uint32_t next = prev(end)->first + 4;
+            if (end == program.end() || end->first != next) out << "        pc = " << to_hex(next) << "u; goto done;\n";
+            else out << "        [[fallthrough]];\n";
+        }
+        it = end;
+    }
+    for (const string& stub : mid_entries) out << stub;
+    out << "    default:\n        goto done;\n    }\n\n";
+
+    out << "done:\n";
+    out << "    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();\n";
+    out << "    (void)pc;\n";
+    out << "    cout << \"AOT mode: \" << executed << \" instructions in \" << fixed << setprecision(3) << seconds << \" s\";\n";
+    out << "    if (seconds > 0) cout << \" (\" << setprecision(1) << executed / seconds / 1e6 << \" MIPS)\";\n";
+    out << "    cout << defaultfloat << \"\\n\";\n";
+    out << "    uint32_t regs[32] = {0";
+    for (int r = 1; r < 32; r++) out << ", x" << r;
+    out << "};\n";
+    out << "    cout << \"\\nSimulation Ended\\n\";\n";
+    out << "    cout << \"Total Clock Cycles: \" << executed << \"\\n\";\n";
+    out << "    cout << \"Final Register State:\\n\";\n";
+    out << "    for (int i = 0; i < 32; ++i) cout << \"x\" << i << \": \" << to_hex(regs[i]) << endl;\n";
+    out << "    cout << \"Final Memory State:\\n\";\n";
+    out << "    memory.forEachWord([](uint32_t addr, uint32_t val) { cout << to_hex(addr) << \": \" << to_hex(val) << endl; });\n";
+    out << "    return sys.exited() ? sys.exitCode() : 0;\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--text" && i + 1 < argc) knobs.text_file = argv[++i];
+        else if (arg == "--data" && i + 1 < argc) knobs.data_file = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) knobs.output_file = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--text text.mc] [--data data.mc] [-o translated.cpp]\n";
+            return 1;
+        }
+    }
+
+    if (!load_text(knobs.text_file)) {
+        cerr << "Error: No instructions loaded from " << knobs.text_file << endl;
+        return 1;
+    }
+    if (!load_data(knobs.data_file)) {
+        cout << "Note: " << knobs.data_file << " not found, starting with empty data memory\n";
+    }
+
+    ofstream out(knobs.output_file);
+    if (!out.is_open()) {
+        cerr << "Error: Cannot write to " << knobs.output_file << endl;
+        return 1;
+    }
+    write_program(out);
+    cout << "Translated " << program.size() << " instructions from " << knobs.text_file
+         << " into " << knobs.output_file << "\n";
+    return 0;
+}
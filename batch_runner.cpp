@@ -0,0 +1,225 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include "Functional_Simulator.h"
+#include "Pipeline_Simulator.h"
+#include "Fork_Server.h"
+#include "Work_Stealing_Pool.h"
+
+using namespace std;
+
+// Batch runner: runs every line of a jobs file as an independent simulator
+// instance on a work-stealing thread pool and writes one results table.
+// Jobs use the variants file syntax (Fork_Server.h):
+//   name [sim=pipeline|functional] [dir=path] [text=file] [data=file] [input=file]
+//        [mode=step|fast|blocks|jit] [pipelining=0|1] [forwarding=0|1] [structural=0|1]
+//        [trace=n] [patch=0xADDR:0xVALUE ...]
+// Each run logs to <name>.log and writes its memory to data.<name>.mc.
+
+struct BatchKnobs {
+    string jobs_file;
+    string results_file = "batch_results.tsv";
+    unsigned threads = 0; // 0: one per CPU
+} knobs;
+
+struct BatchResult {
+    bool ok = false;
+    string error;
+    int exit_code = 0;
+    long long cycles = 0;
+    long long instructions = 0;
+    long long stalls = 0;
+    long long data_hazards = 0;
+    long long mispredictions = 0;
+    double seconds = 0;
+};
+
+// Keys the runner handles itself; the rest are pipeline knobs
+const set<string> RUNNER_KEYS = {"sim", "dir", "text", "data", "input", "mode", "pipelining"};
+
+string setting(const RunVariant& job, const string& key, const string& fallback) {
+    auto it = job.settings.find(key);
+    return it == job.settings.end() ? fallback : it->second;
+}
+
+string job_path(const RunVariant& job, const string& key, const string& file) {
+    auto it = job.settings.find(key);
+    if (it != job.settings.end()) return it->second;
+    return setting(job, "dir", ".") + "/" + file;
+}
+
+void apply_patches(const RunVariant& job, SparseMemory& memory) {
+    for (const auto& patch : job.patches) {
+        memory.writeValue(patch.first, stoull(patch.second, nullptr, 16), (patch.second.length() - 1) / 2);
+    }
+}
+
+bool run_pipeline(const RunVariant& job, ostream& log, BatchResult& result) {
+    PipelineSimulator sim(log, "data." + job.name + ".mc");
+    sim.syscalls.setOutput(log, log);
+    sim.configure_knobs();
+    for (const auto& entry : job.settings) {
+        if (entry.first == "pipelining") sim.knobs.enable_pipelining = entry.second != "0";
+        else if (!RUNNER_KEYS.count(entry.first) && !sim.apply_setting(entry.first, entry.second)) {
+            result.error = "unknown setting " + entry.first;
+            return false;
+        }
+    }
+    sim.initialize_simulator();
+    if (!sim.load_memory(job_path(job, "text", "text.mc"), job_path(job, "data", "data.mc"))) {
+        result.error = "cannot load program";
+        return false;
+    }
+    apply_patches(job, sim.data_memory);
+    string input = setting(job, "input", "");
+    if (!input.empty() && !sim.syscalls.setInput(input)) {
+        result.error = "cannot open " + input;
+        return false;
+    }
+
+    sim.run_simulation();
+    sim.print_register_file();
+    result.exit_code = sim.syscalls.exited() ? sim.syscalls.exitCode() : 0;
+    result.cycles = sim.stats.total_cycles;
+    result.instructions = sim.stats.total_instructions;
+    result.stalls = sim.stats.stall_count;
+    result.data_hazards = sim.stats.data_hazards;
+    result.mispredictions = sim.stats.branch_mispredictions;
+    return true;
+}
+
+bool run_functional(const RunVariant& job, ostream& log, BatchResult& result) {
+    FunctionalSimulator sim(log, "data." + job.name + ".mc");
+    sim.syscalls.setOutput(log, log);
+    for (const auto& entry : job.settings) {
+        if (!RUNNER_KEYS.count(entry.first)) {
+            result.error = "unknown setting " + entry.first + " for the functional simulator";
+            return false;
+        }
+    }
+    sim.init_sim();
+    if (!sim.load_mc_file(job_path(job, "text", "text.mc")) || !sim.load_data_mc(job_path(job, "data", "data.mc"))) {
+        result.error = "cannot load program";
+        return false;
+    }
+    apply_patches(job, sim.memory);
+    string input = setting(job, "input", "");
+    if (!input.empty() && !sim.syscalls.setInput(input)) {
+        result.error = "cannot open " + input;
+        return false;
+    }
+
+    string mode = setting(job, "mode", "step");
+    if (mode == "step") sim.run_cycles();
+    else if (mode == "fast") sim.run_fast();
+    else if (mode == "blocks") sim.run_blocks();
+    else if (mode == "jit") sim.run_jit(2);
+    else {
+        result.error = "unknown mode " + mode;
+        return false;
+    }
+    sim.continue_in_step_mode();
+    sim.write_data_mc();
+    sim.print_final_state();
+    result.exit_code = sim.syscalls.exited() ? sim.syscalls.exitCode() : 0;
+    result.cycles = result.instructions = sim.clock_cycles;
+    return true;
+}
+
+void run_job(const RunVariant& job, BatchResult& result) {
+    auto start = chrono::steady_clock::now();
+    ofstream log(job.name + ".log");
+    if (!log.is_open()) {
+        result.error = "cannot write " + job.name + ".log";
+        return;
+    }
+    try {
+        string sim = setting(job, "sim", "pipeline");
+        if (sim == "pipeline") result.ok = run_pipeline(job, log, result);
+        else if (sim == "functional") result.ok = run_functional(job, log, result);
+        else result.error = "unknown simulator " + sim;
+    } catch (const exception& e) {
+        result.ok = false;
+        result.error = e.what();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+bool write_results(const string& filename, const vector<RunVariant>& jobs, const vector<BatchResult>& results) {
+    ofstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error: Cannot write to " << filename << endl;
+        return false;
+    }
+    file << "# run\tsim\tstatus\texit\tcycles\tinstructions\tcpi\tstalls\tdata_hazards\tmispredictions\tseconds\n";
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchResult& r = results[i];
+        double cpi = r.instructions > 0 ? static_cast<double>(r.cycles) / r.instructions : 0;
+        file << jobs[i].name << "\t" << setting(jobs[i], "sim", "pipeline") << "\t"
+             << (r.ok ? "ok" : "failed: " + r.error) << "\t" << r.exit_code << "\t" << r.cycles << "\t"
+             << r.instructions << "\t" << fixed << setprecision(3) << cpi << "\t" << r.stalls << "\t"
+             << r.data_hazards << "\t" << r.mispredictions << "\t" << r.seconds << "\n";
+    }
+    return file.good();
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc && parseNumber(argv[i + 1], knobs.threads)) i++;
+        else if (arg == "-o" && i + 1 < argc) knobs.results_file = argv[++i];
+        else if (knobs.jobs_file.empty() && arg[0] != '-') knobs.jobs_file = arg;
+        else {
+            knobs.jobs_file.clear();
+            break;
+        }
+    }
+    if (knobs.jobs_file.empty()) {
+        cerr << "Usage: " << argv[0] << " jobs.txt [--threads n] [-o batch_results.tsv]\n";
+        return 1;
+    }
+
+    vector<RunVariant> jobs;
+    if (!loadVariants(knobs.jobs_file, jobs)) {
+        cerr << "Error: No jobs in " << knobs.jobs_file << endl;
+        return 1;
+    }
+    set<string> names;
+    for (const RunVariant& job : jobs) {
+        if (!names.insert(job.name).second) {
+            cerr << "Error: Duplicate run name " << job.name << " (runs log to <name>.log)\n";
+            return 1;
+        }
+    }
+
+    WorkStealingPool pool(knobs.threads ? knobs.threads : thread::hardware_concurrency());
+    vector<BatchResult> results(jobs.size());
+    mutex progress_lock;
+    size_t finished = 0;
+    cout << "Batch: " << jobs.size() << " runs on " << pool.size() << " threads\n";
+    auto start = chrono::steady_clock::now();
+
+    pool.run(jobs.size(), [&](size_t i) {
+        run_job(jobs[i], results[i]);
+        lock_guard<mutex> guard(progress_lock);
+        cout << "[" << ++finished << "/" << jobs.size() << "] " << jobs[i].name << ": "
+             << (results[i].ok ? "ok" : "failed (" + results[i].error + ")") << ", " << fixed
+             << setprecision(2) << results[i].seconds << " s" << defaultfloat << endl;
+    });
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    int failed = 0;
+    for (const BatchResult& r : results) failed += !r.ok;
+    bool written = write_results(knobs.results_file, jobs, results);
+    cout << "Batch done in " << fixed << setprecision(2) << seconds << " s: " << jobs.size() - failed << " ok, "
+         << failed << " failed, " << pool.steals() << " steals; results in " << knobs.results_file << "\n";
+    return failed || !written ? 1 : 0;
+}
@@ -7,9 +7,17 @@
 #include <math.h>
 #include <sstream>
 #include <iomanip>
+#include <cstdio>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "Riscv_Instructions.h"
 #include "Instructions_Func.h"
 #include "Auxiliary_Functions.h"
+#include "Block_Layout.h"
+#include "Assembler_Server.h"
 
 using namespace std;
 
@@ -18,7 +26,7 @@ RISC_V_Instructions Instruction;
 
 // For storing all labels
 unordered_map<string, long long> labels;
-vector<string> textDirectiveInst, dataDirectiveInst, textOutputCode, dataOutputCode;
+vector<string> textSourceLines, textDirectiveInst, dataDirectiveInst, textOutputCode, dataOutputCode;
 
 long long pc = 0;
 
@@ -41,6 +49,107 @@ string binaryToHex(const string& binary, int bit_length) {
     ss << "0x" << hex << uppercase << setfill('0') << setw(hex_digits) << decimal;
     return ss.str();
 }
+
+// Handle .incbin "file"[, offset[, length]] by mapping the file and copying
+// its bytes straight into the data image (one word per line, bytes only at
+// unaligned edges)
+bool includeBinary(const string& args, long long& memory_address) {
+    string rest = trim(args);
+    if (rest.empty() || rest[0] != '"' || rest.find('"', 1) == string::npos) {
+        output_error.AlterError(INVALID_DATA, "Invalid .incbin file name: " + rest);
+        output_error.PrintError();
+        return false;
+    }
+    size_t close_quote = rest.find('"', 1);
+    string file_name = rest.substr(1, close_quote - 1);
+
+    // Optional offset and length after the file name
+    long long offset = 0, length = -1;
+    stringstream params(rest.substr(close_quote + 1));
+    string param;
+    int count = 0;
+    getline(params, param, ',');
+    if (!trim(param).empty()) {
+        output_error.AlterError(INVALID_DATA, "Unexpected text after .incbin file name: " + param);
+        output_error.PrintError();
+        return false;
+    }
+    while (getline(params, param, ',')) {
+        param = trim(param);
+        try {
+            long long value = stoll(param, nullptr, 0);
+            if (value < 0) throw out_of_range("");
+            if (count == 0) offset = value;
+            else if (count == 1) length = value;
+            else throw invalid_argument("");
+        } catch (const exception&) {
+            output_error.AlterError(INVALID_DATA, "Invalid .incbin parameter: " + param);
+            output_error.PrintError();
+            return false;
+        }
+        count++;
+    }
+
+    int fd = open(file_name.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        output_error.AlterError(INVALID_DATA, "Cannot open .incbin file: " + file_name);
+        output_error.PrintError();
+        return false;
+    }
+    long long file_size = st.st_size;
+    if (offset > file_size || (length >= 0 && offset + length > file_size)) {
+        close(fd);
+        output_error.AlterError(INVALID_DATA, "Range exceeds .incbin file size: " + file_name);
+        output_error.PrintError();
+        return false;
+    }
+    if (length < 0) length = file_size - offset;
+    if (length == 0) {
+        close(fd);
+        return true;
+    }
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(
+        mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (bytes == MAP_FAILED) {
+        output_error.AlterError(INVALID_DATA, "Cannot map .incbin file: " + file_name);
+        output_error.PrintError();
+        return false;
+    }
+
+    const unsigned char* src = bytes + offset;
+    long long remaining = length;
+    char line[32];
+    dataOutputCode.reserve(dataOutputCode.size() + length / 4 + 8);
+
+    // Leading bytes up to the next word boundary
+    while (remaining > 0 && (memory_address & 3) != 0) {
+        snprintf(line, sizeof(line), "0x%08llX 0x%02X", memory_address & 0xFFFFFFFFLL, *src);
+        dataOutputCode.push_back(line);
+        src++; memory_address++; remaining--;
+    }
+    // Whole words, little-endian
+    while (remaining >= 4) {
+        uint32_t word = src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(src[3]) << 24);
+        snprintf(line, sizeof(line), "0x%08llX 0x%08X", memory_address & 0xFFFFFFFFLL, word);
+        dataOutputCode.push_back(line);
+        src += 4; memory_address += 4; remaining -= 4;
+    }
+    // Trailing bytes
+    while (remaining > 0) {
+        snprintf(line, sizeof(line), "0x%08llX 0x%02X", memory_address & 0xFFFFFFFFLL, *src);
+        dataOutputCode.push_back(line);
+        src++; memory_address++; remaining--;
+    }
+
+    munmap(const_cast<unsigned char*>(bytes), file_size);
+    cout << "DATA: .incbin " << file_name << " (" << length << " bytes)" << endl;
+    return true;
+}
+
 void dataDirectives(vector<string> dataInst) {
     long long memory_address = 268435456; // 0x10000000
     string data, temp_word, output_string;
@@ -72,6 +181,14 @@ void dataDirectives(vector<string> dataInst) {
             return;
         }
 
+        // Raw binary include, copied without per-element parsing
+        if (temp_word == ".incbin") {
+            string remaining_data;
+            getline(ss, remaining_data);
+            if (!includeBinary(remaining_data, memory_address)) return;
+            continue;
+        }
+
         if (dataTypeSize.find(temp_word) == dataTypeSize.end()) {
             output_error.AlterError(INVALID_DATA, "Invalid data type: " + temp_word);
             output_error.PrintError();
@@ -180,18 +297,13 @@ void dataDirectives(vector<string> dataInst) {
         }
     }
 }
-int main()
+// Assemble one source into text and data images
+int assemble(istream& input_file, ostream& text_file, ostream& data_file, const string& profile_file)
 {
-    // Opening asm file
-    ifstream input_file("main.asm");
-    // Output machine code files
-    ofstream text_file("text.mc", ios::out);
-    ofstream data_file("data.mc", ios::out);
-
     // Reading file line by line (instruction by instruction)
     string line;
     bool isText = true, isData = true;
-    if (input_file.is_open())
+    if (input_file)
     {
         while (getline(input_file, line))
         {
@@ -223,37 +335,49 @@ int main()
             }
             else if (isText == true)
             {
-                /* Setting Program Counter for labels */
-                try
-                {
-                    // Getting colon position if label
-                    size_t colonPos = line.find(':');
-                    if (colonPos != string::npos)
-                    {
-                        
-                        
-                        size_t comment_pos = line.find('#');
-                        if (comment_pos != string::npos) {
-                        line = line.substr(0, comment_pos); // Keep only the part before '#'
-                        }
-                        line = trim(line); 
-                        line = trim(line.substr(0, line.length()-1));
-                        labels[line] = pc;
-                        pc -= 4;
-                    }
-                    else{
-                       
-                        textDirectiveInst.push_back(line);
-                        
-                    }
-                }
-                catch (exception ex)
-                {
-                   
+                textSourceLines.push_back(line);
+            }
+        }
+    }
+
+    // Profile-guided block layout
+    if (!profile_file.empty())
+    {
+        unordered_map<long long, ProfileEntry> profile;
+        if (loadBranchProfile(profile_file, profile))
+            reorderBasicBlocks(textSourceLines, profile);
+    }
+
+    for (size_t i = 0; i < textSourceLines.size(); i++)
+    {
+        line = textSourceLines[i];
+        /* Setting Program Counter for labels */
+        try
+        {
+            // Getting colon position if label
+            size_t colonPos = line.find(':');
+            if (colonPos != string::npos)
+            {
+                size_t comment_pos = line.find('#');
+                if (comment_pos != string::npos) {
+                line = line.substr(0, comment_pos); // Keep only the part before '#'
                 }
-                pc += 4;
+                line = trim(line); 
+                line = trim(line.substr(0, line.length()-1));
+                labels[line] = pc;
+                pc -= 4;
+            }
+            else{
+               
+                textDirectiveInst.push_back(line);
+                
             }
         }
+        catch (exception ex)
+        {
+           
+        }
+        pc += 4;
     }
 
      for(const auto& pair : labels){
@@ -337,25 +461,75 @@ int main()
     dataDirectives(dataDirectiveInst);
 
     // Write text segment to text.mc
-    if (text_file.is_open())
+    if (text_file)
     {
         for (size_t i = 0; i < textOutputCode.size(); i++)
         {
-            text_file << textOutputCode[i] << endl;
+            text_file << textOutputCode[i] << '\n';
         }
-        text_file.close();
     }
 
     // Write data segment to data.mc
-    if (data_file.is_open())
+    if (data_file)
     {
         for (size_t i = 0; i < dataOutputCode.size(); i++)
         {
-            data_file << dataOutputCode[i] << endl;
+            data_file << dataOutputCode[i] << '\n';
         }
-        data_file.close();
     }
+    return 0;
+}
 
+int main(int argc, char* argv[])
+{
+    // Optional branch profile from the pipeline simulator
+    string profile_file = "";
+    string socket_path = "";
+    bool stdio_server = false;
+    int workers = 4;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--profile" && i + 1 < argc)
+            profile_file = argv[++i];
+        else if (arg == "--server" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (arg == "--stdio")
+            stdio_server = true;
+        else if (arg == "--workers" && i + 1 < argc)
+            workers = max(1, atoi(argv[++i]));
+        else
+        {
+            usage = true;
+            break;
+        }
+    }
+    // The server modes assemble each request without a profile
+    if (!profile_file.empty() && (!socket_path.empty() || stdio_server))
+        usage = true;
+    if (usage)
+    {
+        cerr << "Usage: " << argv[0] << " [--profile file | --server socket_path [--workers N] | --stdio]" << endl;
+        return 1;
+    }
+
+    // Long-lived modes: tables are built once, each request runs in a forked child
+    if (!socket_path.empty())
+        return runSocketServer(socket_path, workers, assemble);
+    if (stdio_server)
+        return runStdioServer(assemble);
+
+    // Opening asm file
+    ifstream input_file("main.asm");
+    // Output machine code files
+    ofstream text_file("text.mc", ios::out);
+    ofstream data_file("data.mc", ios::out);
+
+    int status = assemble(input_file, text_file, data_file, profile_file);
+
+    text_file.close();
+    data_file.close();
     input_file.close();
-    return 0;
+    return status;
 }
@@ -0,0 +1,348 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "Riscv_Instructions.h"
+#include "Auxiliary_Functions.h"
+#include "Source_Map.h"
+#include "Predecoder.h"
+
+using namespace std;
+
+// Same knobs as pipeline.cpp that change the hazard rules
+struct AnalyzerKnobs {
+    bool enable_data_forwarding = true;
+    bool enable_structural_hazard = false;
+    string text_file = "text.mc";
+    string source_file = "main.asm";
+} knobs;
+
+// One decoded instruction of the text image
+struct StaticInstr {
+    uint32_t pc = 0;
+    uint32_t ir = 0;
+    uint32_t rd = 0, rs1 = 0, rs2 = 0;
+    bool uses_rs1 = false, uses_rs2 = false, reg_write = false;
+    bool is_load = false, is_branch = false, is_jal = false, is_jalr = false;
+    bool drains = false;     // ecall/CSR: waits for older instructions to leave EX and MEM
+    int32_t imm = 0;
+    int stalls = 0;          // Estimated data-hazard stall cycles before decode
+    uint32_t stall_reg = 0;  // Register that caused the stall
+    uint32_t stall_from = 0; // PC of the producer
+};
+
+// Basic block of the control-flow graph
+struct BasicBlock {
+    size_t first = 0, last = 0; // Instruction indices (inclusive)
+    vector<int> succs, preds;
+    int stalls = 0;
+    int loop_depth = 0;
+};
+
+// Natural loop found from a back edge
+struct Loop {
+    int header = 0;
+    set<int> blocks;
+    vector<int> latches;
+};
+
+vector<StaticInstr> program;
+vector<BasicBlock> blocks;
+vector<Loop> loops;
+unordered_map<uint32_t, size_t> index_of_pc;
+
+string to_hex(uint32_t val) {
+    stringstream ss;
+    ss << "0x" << setfill('0') << setw(8) << hex << uppercase << val;
+    return ss.str();
+}
+
+bool is_valid_hex(const string& str) {
+    if (str.empty() || str.length() < 3 || str.substr(0, 2) != "0x") return false;
+    for (size_t i = 2; i < str.length(); ++i) {
+        if (!isxdigit(str[i])) return false;
+    }
+    return true;
+}
+
+// Load text.mc (same format the simulators read)
+bool load_text(const string& filename) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error: Cannot open " << filename << endl;
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        size_t comment_pos = line.find('#');
+        if (comment_pos != string::npos) line = line.substr(0, comment_pos);
+        stringstream ss(line);
+        string addr_str, instr_str;
+        if (!(ss >> addr_str >> instr_str)) continue;
+        if (!is_valid_hex(addr_str) || !is_valid_hex(instr_str)) continue;
+        StaticInstr instr;
+        instr.pc = stoul(addr_str, nullptr, 16);
+        instr.ir = stoul(instr_str, nullptr, 16);
+        if (instr.ir == 0) continue;
+        program.push_back(instr);
+    }
+    sort(program.begin(), program.end(), [](const StaticInstr& a, const StaticInstr& b) { return a.pc < b.pc; });
+    return !program.empty();
+}
+
+// Register usage from the shared predecoder, as detect_data_hazard() sees it
+void decode_program() {
+    for (size_t i = 0; i < program.size(); i++) {
+        StaticInstr& in = program[i];
+        MicroOp uop = predecode(in.ir);
+        in.rd = uop.rd;
+        in.rs1 = uop.rs1;
+        in.rs2 = uop.rs2;
+        in.uses_rs1 = (uop.read_mask >> uop.rs1) & 1;
+        in.uses_rs2 = (uop.read_mask >> uop.rs2) & 1;
+        in.reg_write = uop.klass == CLASS_ALU || uop.klass == CLASS_LOAD || uop.klass == CLASS_JUMP || uop.klass == CLASS_SYSTEM ||
+                       uop.klass == CLASS_ATOMIC || uop.klass == CLASS_CSR;
+        in.is_load = uop.klass == CLASS_LOAD || uop.klass == CLASS_ATOMIC; // Atomics return memory data in MEM
+        in.is_branch = uop.klass == CLASS_BRANCH;
+        in.is_jal = uop.op == OP_JAL;
+        in.is_jalr = uop.op == OP_JALR;
+        in.drains = uop.klass == CLASS_SYSTEM || uop.klass == CLASS_CSR;
+        in.imm = uop.imm;
+        index_of_pc[in.pc] = i;
+    }
+}
+
+// Split into basic blocks and connect edges
+void build_cfg() {
+    set<size_t> leaders = {0};
+    for (size_t i = 0; i < program.size(); i++) {
+        const StaticInstr& in = program[i];
+        if (in.is_branch || in.is_jal) {
+            auto target = index_of_pc.find(in.pc + in.imm);
+            if (target != index_of_pc.end()) leaders.insert(target->second);
+        }
+        if ((in.is_branch || in.is_jal || in.is_jalr) && i + 1 < program.size()) leaders.insert(i + 1);
+        // A gap in the image also starts a new block
+        if (i + 1 < program.size() && program[i + 1].pc != in.pc + 4) leaders.insert(i + 1);
+    }
+
+    vector<int> block_of(program.size());
+    for (auto it = leaders.begin(); it != leaders.end(); ++it) {
+        BasicBlock block;
+        block.first = *it;
+        auto next = std::next(it);
+        block.last = (next == leaders.end() ? program.size() : *next) - 1;
+        for (size_t i = block.first; i <= block.last; i++) block_of[i] = blocks.size();
+        blocks.push_back(block);
+    }
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const StaticInstr& in = program[blocks[b].last];
+        auto add_edge = [&](int to) {
+            if (find(blocks[b].succs.begin(), blocks[b].succs.end(), to) != blocks[b].succs.end()) return;
+            blocks[b].succs.push_back(to);
+            blocks[to].preds.push_back(b);
+        };
+        if (in.is_branch || in.is_jal) {
+            auto target = index_of_pc.find(in.pc + in.imm);
+            if (target != index_of_pc.end()) add_edge(block_of[target->second]);
+        }
+        // Fall-through, including the return site of a call
+        bool falls_through = !in.is_jalr && !(in.is_jal && in.rd == 0);
+        if ((falls_through || ((in.is_jal || in.is_jalr) && in.rd != 0)) && blocks[b].last + 1 < program.size() &&
+            program[blocks[b].last + 1].pc == in.pc + 4) {
+            add_edge(block_of[blocks[b].last + 1]);
+        }
+    }
+}
+
+// Dominator sets, back edges and natural loops
+void find_loops() {
+    size_t n = blocks.size();
+    vector<vector<bool>> dom(n, vector<bool>(n, true));
+    dom[0].assign(n, false);
+    dom[0][0] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 1; b < n; b++) {
+            vector<bool> updated(n, !blocks[b].preds.empty());
+            for (int p : blocks[b].preds) {
+                for (size_t d = 0; d < n; d++) updated[d] = updated[d] && dom[p][d];
+            }
+            updated[b] = true;
+            if (updated != dom[b]) {
+                dom[b] = updated;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < n; b++) {
+        for (int h : blocks[b].succs) {
+            if (!dom[b][h]) continue;
+            // Back edge b -> h: merge loops that share a header
+            Loop* loop = nullptr;
+            for (Loop& l : loops) {
+                if (l.header == h) loop = &l;
+            }
+            if (loop == nullptr) {
+                loops.push_back(Loop());
+                loop = &loops.back();
+                loop->header = h;
+                loop->blocks.insert(h);
+            }
+            loop->latches.push_back(b);
+            vector<int> work = {static_cast<int>(b)};
+            while (!work.empty()) {
+                int x = work.back();
+                work.pop_back();
+                if (!loop->blocks.insert(x).second) continue;
+                for (int p : blocks[x].preds) work.push_back(p);
+            }
+        }
+    }
+    for (const Loop& loop : loops) {
+        for (int b : loop.blocks) blocks[b].loop_depth++;
+    }
+}
+
+// Issue-slot model of detect_data_hazard(): a consumer may leave decode once
+// the producer is `need` cycles ahead (load-use 2 with forwarding, 4 without,
+// 3 when the register file is written before it is read). An ecall or CSR
+// instruction leaves decode 3 cycles after the one before it, once that one
+// has left EX and MEM, whatever registers it reads.
+void estimate_stalls() {
+    for (BasicBlock& block : blocks) {
+        vector<long long> decode_cycle;
+        long long cycle = 0;
+        block.stalls = 0;
+        for (size_t i = block.first; i <= block.last; i++) {
+            StaticInstr& in = program[i];
+            long long earliest = cycle;
+            if (in.drains && i > block.first && decode_cycle.back() + 3 > earliest) {
+                earliest = decode_cycle.back() + 3;
+                in.stall_reg = 0;
+                in.stall_from = program[i - 1].pc;
+            }
+            for (size_t back = 1; back <= 3 && i - back + 1 > block.first; back++) {
+                const StaticInstr& producer = program[i - back];
+                if (!producer.reg_write || producer.rd == 0) continue;
+                bool depends = (in.uses_rs1 && in.rs1 == producer.rd) || (in.uses_rs2 && in.rs2 == producer.rd);
+                if (!depends) continue;
+                long long need;
+                if (knobs.enable_data_forwarding) need = producer.is_load ? 2 : 1;
+                else need = knobs.enable_structural_hazard ? 3 : 4;
+                long long ready = decode_cycle[i - back - block.first] + need;
+                if (ready > earliest) {
+                    earliest = ready;
+                    in.stall_reg = producer.rd;
+                    in.stall_from = producer.pc;
+                }
+            }
+            in.stalls = earliest - cycle;
+            block.stalls += in.stalls;
+            decode_cycle.push_back(earliest);
+            cycle = earliest + 1;
+        }
+    }
+}
+
+void print_report(const unordered_map<uint32_t, SourceLine>& source) {
+    cout << "Static pipeline cost estimate for " << knobs.text_file << "\n";
+    cout << "Data Forwarding: " << (knobs.enable_data_forwarding ? "Enabled" : "Disabled")
+         << ", Structural Hazard Handling: " << (knobs.enable_structural_hazard ? "Enabled" : "Disabled") << "\n";
+    cout << "Instructions: " << program.size() << ", Basic Blocks: " << blocks.size() << ", Loops: " << loops.size() << "\n";
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const BasicBlock& block = blocks[b];
+        size_t count = block.last - block.first + 1;
+        cout << "\nBlock B" << b << " [" << to_hex(program[block.first].pc) << " - " << to_hex(program[block.last].pc)
+             << "] " << count << " instr, " << block.stalls << " stall cycles, est. " << count + block.stalls
+             << " cycles, loop depth " << block.loop_depth << "\n";
+        cout << "  preds:";
+        for (int p : block.preds) cout << " B" << p;
+        cout << "  succs:";
+        for (int s : block.succs) cout << " B" << s;
+        cout << "\n";
+
+        for (size_t i = block.first; i <= block.last; i++) {
+            const StaticInstr& in = program[i];
+            auto line = source.find(in.pc);
+            cout << "  " << to_hex(in.pc) << "  ";
+            if (in.stalls > 0) cout << "+" << in.stalls << " ";
+            else cout << "   ";
+            if (line != source.end()) {
+                cout << setw(4) << line->second.line_number << ": " << line->second.text;
+            } else {
+                cout << to_hex(in.ir);
+            }
+            if (in.stalls > 0 && in.drains && in.stall_reg == 0) {
+                cout << "    # drain: waits for " << to_hex(in.stall_from) << " to leave EX and MEM";
+            } else if (in.stalls > 0) {
+                cout << "    # x" << in.stall_reg << " from " << to_hex(in.stall_from)
+                     << (program[index_of_pc[in.stall_from]].is_load ? " (load-use)" : "");
+            }
+            cout << "\n";
+        }
+        const StaticInstr& last = program[block.last];
+        if (last.is_branch || last.is_jal || last.is_jalr) {
+            cout << "  control: 1 bubble per misprediction (predict not-taken on BTB miss)\n";
+        }
+    }
+
+    for (size_t l = 0; l < loops.size(); l++) {
+        const Loop& loop = loops[l];
+        int instrs = 0, stalls = 0;
+        for (int b : loop.blocks) {
+            instrs += blocks[b].last - blocks[b].first + 1;
+            stalls += blocks[b].stalls;
+        }
+        cout << "\nLoop L" << l << ": header B" << loop.header << " at " << to_hex(program[blocks[loop.header].first].pc);
+        auto line = source.find(program[blocks[loop.header].first].pc);
+        if (line != source.end()) cout << " (line " << line->second.line_number << ")";
+        cout << "\n  blocks:";
+        for (int b : loop.blocks) cout << " B" << b;
+        cout << "\n  latches:";
+        for (int b : loop.latches) cout << " B" << b;
+        cout << "\n  body: " << instrs << " instr, " << stalls << " data stall cycles (all paths summed)\n";
+        cout << "  control: ~2 mispredictions per loop entry with the 1-bit BTB (first and last iteration)\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--no-forwarding") knobs.enable_data_forwarding = false;
+        else if (arg == "--structural") knobs.enable_structural_hazard = true;
+        else if (arg == "--text" && i + 1 < argc) knobs.text_file = argv[++i];
+        else if (arg == "--source" && i + 1 < argc) knobs.source_file = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--no-forwarding] [--structural] [--text text.mc] [--source main.asm]\n";
+            return 1;
+        }
+    }
+
+    if (!load_text(knobs.text_file)) {
+        cerr << "Error: No instructions loaded from " << knobs.text_file << endl;
+        return 1;
+    }
+    unordered_map<uint32_t, SourceLine> source;
+    if (!loadSourceMap(knobs.source_file, source)) {
+        cout << "Note: " << knobs.source_file << " not found, showing raw instructions\n";
+    }
+
+    decode_program();
+    build_cfg();
+    find_loops();
+    estimate_stalls();
+    print_report(source);
+    return 0;
+}
@@ -0,0 +1,58 @@
+# Zicsr and the performance counters (Csr.h): times a summing loop with rdcycle and rdinstret and
+# stores what the counters saw. code.cpp counts one cycle per instruction; pipeline.cpp reports its
+# real cycles plus stalls (hpmcounter3) and branch mispredictions (hpmcounter6) of the loop.
+# Also round-trips mscratch and sets minstret, which instret reads from then on.
+.data
+iterations: .word 100
+sum: .word 0
+cycles: .word 0              # rdcycle after - before
+instructions: .word 0        # rdinstret after - before
+stalls: .word 0              # hpmcounter3 after - before
+mispredictions: .word 0      # hpmcounter6 after - before
+scratch: .word 0             # mscratch read back
+hart: .word 0                # mhartid
+instret_after_write: .word 0 # instret after minstret was set to 1000
+
+.text
+lui x23, 0x10000             # x23 = base of .data
+lw x5, 0(x23)                # x5 = iterations
+addi x6, x0, 0               # x6 = sum
+addi x7, x0, 1               # x7 = i
+rdcycle x8
+rdinstret x9
+csrr x18, hpmcounter3
+csrr x19, hpmcounter6
+loop:
+add x6, x6, x7
+addi x7, x7, 1
+bge x5, x7, loop
+csrr x20, hpmcounter6
+csrr x21, hpmcounter3
+rdinstret x22
+rdcycle x24
+sw x6, 4(x23)
+sub x24, x24, x8
+sw x24, 8(x23)
+sub x22, x22, x9
+sw x22, 12(x23)
+sub x21, x21, x18
+sw x21, 16(x23)
+sub x20, x20, x19
+sw x20, 20(x23)
+
+# mscratch keeps what is written; csrrw returns the old value
+lui x10, 0x12345
+addi x10, x10, 0x678
+csrw mscratch, x10
+csrrsi x11, mscratch, 1
+csrr x11, mscratch
+sw x11, 24(x23)
+csrr x12, mhartid
+sw x12, 28(x23)
+
+# Writing minstret moves the count: the next read is 1000 plus the instructions in between
+addi x13, x0, 1000
+csrw minstret, x13
+addi x0, x0, 0
+rdinstret x14
+sw x14, 32(x23)
@@ -0,0 +1,132 @@
+# DMA engine (Dma_Engine.h) against a CPU copy loop: copies 256 bytes three
+# times and times the first two with the benchmark control device. The CPU
+# copy runs a load/store loop; the second copy polls the DMA status; the third
+# raises the machine external interrupt when done while the CPU sums the
+# first copy. Stores the cycle counts, the interrupt count, the checksum and
+# the number of words that differ between the three copies, then ends the run
+# through the test finisher.
+.data
+cpu_cycles: .word 0          # benchmark region: CPU copy
+dma_cycles: .word 0          # benchmark region: polled DMA copy
+interrupts: .word 0          # DMA completion interrupts
+checksum: .word 0            # sum of the CPU copy
+mismatches: .word 0          # words where the DMA copies differ from it
+
+.text
+jal x5, main                 # x5 = 4, the address of the handler
+handler:
+lui x28, 0x2040
+addi x29, x0, 2
+sw x29, 16(x28)              # Clear DONE, which drops the interrupt
+lw x29, 8(x23)
+addi x29, x29, 1
+sw x29, 8(x23)
+mret
+
+main:
+lui x23, 0x10000             # x23 = base of .data
+csrw mtvec, x5
+lui x20, 0x2020              # x20 = benchmark control
+lui x21, 0x2040              # x21 = DMA engine
+
+# src (x23 + 256) = 0, 3, 6, ... 64 words
+addi x5, x23, 256
+addi x6, x0, 0
+addi x7, x0, 64
+fill:
+add x8, x6, x6
+add x8, x8, x6
+sw x8, 0(x5)
+addi x5, x5, 4
+addi x6, x6, 1
+blt x6, x7, fill
+
+# CPU copy to x23 + 512
+addi x8, x0, 1
+sw x8, 0(x20)
+addi x5, x23, 256
+addi x9, x23, 512
+addi x10, x23, 512           # end of src
+copy:
+lw x11, 0(x5)
+sw x11, 0(x9)
+addi x5, x5, 4
+addi x9, x9, 4
+blt x5, x10, copy
+addi x8, x0, 2
+sw x8, 0(x20)
+lw x12, 4(x20)
+sw x12, 0(x23)
+
+# Polled DMA copy to x23 + 768
+addi x8, x0, 1
+sw x8, 0(x20)
+addi x13, x23, 256
+sw x13, 0(x21)
+addi x13, x23, 768
+sw x13, 4(x21)
+addi x13, x0, 256
+sw x13, 8(x21)
+addi x13, x0, 1              # GO
+sw x13, 12(x21)
+poll:
+lw x14, 16(x21)
+andi x14, x14, 2             # DONE
+beq x14, x0, poll
+addi x8, x0, 2
+sw x8, 0(x20)
+lw x12, 4(x20)
+sw x12, 4(x23)
+addi x13, x0, 2
+sw x13, 16(x21)              # Clear DONE
+
+# DMA copy to x23 + 1024 with the completion interrupt, summing the CPU copy meanwhile
+lui x13, 1
+addi x13, x13, -2048         # MEIE (bit 11)
+csrw mie, x13
+csrsi mstatus, 8
+addi x13, x23, 1024
+sw x13, 4(x21)
+addi x13, x0, 3              # GO and IE
+sw x13, 12(x21)
+addi x5, x23, 512
+addi x10, x23, 768
+addi x15, x0, 0
+sum:
+lw x11, 0(x5)
+add x15, x15, x11
+addi x5, x5, 4
+blt x5, x10, sum
+sw x15, 12(x23)
+wait:
+lw x16, 8(x23)
+beq x16, x0, wait
+csrci mstatus, 8
+
+# Compare both DMA copies with the CPU copy
+addi x5, x23, 512
+addi x10, x23, 768
+addi x17, x0, 0
+compare:
+lw x11, 0(x5)
+lw x12, 256(x5)
+lw x13, 512(x5)
+beq x11, x12, same_dma
+addi x17, x17, 1
+same_dma:
+beq x11, x13, same_irq
+addi x17, x17, 1
+same_irq:
+addi x5, x5, 4
+blt x5, x10, compare
+sw x17, 16(x23)
+
+# 0x5555 passes if nothing differs; 1 << 16 | 0x3333 fails with exit code 1
+lui x22, 0x2030
+lui x10, 0x5
+addi x10, x10, 0x555
+beq x17, x0, finish
+lui x10, 0x13
+addi x10, x10, 0x333
+finish:
+sw x10, 0(x22)
@@ -0,0 +1,65 @@
+# MMIO devices (Mmio_Bus.h): prints a line on the console, reads one byte of
+# --input from it (-1 without input), times a loop with the benchmark control
+# device and ends the run through the test finisher, exit code 0 if the sum is
+# right. The store after the finisher must never happen.
+.data
+sum: .word 0
+input_byte: .word 0
+regions: .word 0             # benchmark regions finished
+region_cycles: .word 0       # cycles of the last region
+region_instret: .word 0      # instructions of the last region
+after_finish: .word 0        # stays 0
+message: .asciiz "Hello from the console"
+
+.text
+lui x23, 0x10000             # x23 = base of .data
+lui x20, 0x2010              # x20 = console
+lui x21, 0x2020              # x21 = benchmark control
+lui x22, 0x2030              # x22 = test finisher
+
+addi x5, x23, 24
+print:
+lbu x6, 0(x5)
+beq x6, x0, printed
+sw x6, 0(x20)
+addi x5, x5, 1
+jal x0, print
+printed:
+addi x6, x0, 10
+sw x6, 0(x20)
+lw x7, 4(x20)
+sw x7, 4(x23)
+
+# Sum 1..50 inside a benchmark region
+addi x8, x0, 1
+sw x8, 0(x21)
+addi x5, x0, 50
+addi x6, x0, 0
+addi x7, x0, 1
+loop:
+add x6, x6, x7
+addi x7, x7, 1
+bge x5, x7, loop
+addi x8, x0, 2
+sw x8, 0(x21)
+sw x6, 0(x23)
+lw x9, 0(x21)
+sw x9, 8(x23)
+lw x9, 4(x21)
+sw x9, 12(x23)
+lw x9, 8(x21)
+sw x9, 16(x23)
+addi x8, x0, 3
+sw x8, 0(x21)
+
+# 0x5555 passes; 1 << 16 | 0x3333 fails with exit code 1
+lui x10, 0x5
+addi x10, x10, 0x555
+addi x11, x0, 1275
+beq x6, x11, finish
+lui x10, 0x13
+addi x10, x10, 0x333
+finish:
+sw x10, 0(x22)
+addi x12, x0, 1
+sw x12, 20(x23)
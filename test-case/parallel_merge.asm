@@ -0,0 +1,225 @@
+# Parallel merge sort for the multi-hart functional simulator (./simulator --harts N), built on merge.asm's merge loop.
+# Every hart reads its ID from mhartid and starts with the hart count in x11; a run without --harts leaves
+# x11 at its reset value, so a count of 0 or above 64 means a single hart and the sort finishes in every mode.
+# Each hart fills its share of array A with pseudo-random values and sorts it with bottom-up merge passes through B.
+# Sorted runs are then merged pairwise in a tree, halving the busy harts per level, with a barrier (amoadd.w/amoswap.w)
+# between levels. Hart 0 checks the result, stores 1 in "sorted" and exits with code 0 when A is in order.
+.data
+length: .word 65536          # Elements to sort
+barrier_count: .word 0       # Harts arrived at the current barrier
+barrier_sense: .word 0       # Flips each time the last hart arrives
+finished: .word 0            # Harts done, counted with lr.w/sc.w
+sorted: .word 0              # 1 when A ends up sorted
+
+.text
+start:
+csrr x8, mhartid             # x8 = hart ID
+addi x9, x11, 0              # x9 = hart count
+addi x5, x9, -1
+sltiu x5, x5, 64
+bne x5, x0, count_ok         # 1 <= count <= 64
+addi x9, x0, 1
+count_ok:
+lui x23, 0x10000             # x23 = base of .data
+lw x18, 0(x23)               # x18 = length
+div x19, x18, x9             # x19 = chunk = length / harts
+lui x20, 0x10100             # x20 = array A
+lui x21, 0x10200             # x21 = scratch array B
+addi x22, x0, 0              # x22 = barrier sense of this hart
+
+# Own range [x24, x25): chunk ID, the last hart also takes the remainder
+mul x24, x8, x19
+add x25, x24, x19
+addi x5, x9, -1
+bne x8, x5, own_range
+addi x25, x18, 0
+own_range:
+
+# A[i] = scrambled i * 1103515245, so the input does not depend on the hart count
+addi x5, x24, 0
+lui x7, 0x41C65
+addi x7, x7, -403            # x7 = 1103515245
+fill:
+bge x5, x25, sort
+mul x28, x5, x7
+addi x28, x28, 1013
+srli x29, x28, 16
+xor x28, x28, x29
+slli x29, x5, 2
+add x29, x29, x20
+sw x28, 0(x29)
+addi x5, x5, 1
+jal x0, fill
+
+# Bottom-up merge sort of the own range: runs of width 1, 2, 4, ... merged into B and copied back
+sort:
+addi x26, x0, 1              # x26 = run width
+sort_pass:
+sub x5, x25, x24
+bge x26, x5, sort_done
+addi x12, x24, 0             # x12 = k, start of the pair of runs
+sort_run:
+bge x12, x25, sort_copy
+add x13, x12, x26            # x13 = mid
+add x14, x13, x26            # x14 = end
+blt x13, x25, mid_ok
+addi x13, x25, 0
+mid_ok:
+blt x14, x25, end_ok
+addi x14, x25, 0
+end_ok:
+addi x10, x20, 0
+addi x11, x21, 0
+jal x1, merge
+slli x15, x26, 1
+add x12, x12, x15
+jal x0, sort_run
+sort_copy:
+addi x10, x24, 0
+addi x11, x25, 0
+jal x1, copy_back
+slli x26, x26, 1
+jal x0, sort_pass
+sort_done:
+
+# Merge tree: at step s, harts with ID % 2s == 0 merge chunks [ID, ID+s) and [ID+s, ID+2s)
+addi x26, x0, 1              # x26 = step in chunks
+tree:
+jal x1, barrier
+bge x26, x9, tree_done
+slli x15, x26, 1
+rem x16, x8, x15
+bne x16, x0, tree_next
+add x13, x8, x26             # Chunk where the right run starts
+bge x13, x9, tree_next       # No right run at this level
+add x14, x13, x26            # Chunk after the right run
+mul x12, x8, x19             # x12 = k
+mul x13, x13, x19            # x13 = mid
+blt x14, x9, tree_inner
+addi x14, x18, 0             # The last run ends at length
+jal x0, tree_merge
+tree_inner:
+mul x14, x14, x19            # x14 = end
+tree_merge:
+addi x10, x20, 0
+addi x11, x21, 0
+jal x1, merge
+addi x10, x12, 0
+addi x11, x14, 0
+jal x1, copy_back
+tree_next:
+slli x26, x26, 1
+jal x0, tree
+
+tree_done:
+addi x30, x23, 12            # finished += 1 with a load-reserved/store-conditional loop
+finish_retry:
+lr.w x31, (x30)
+addi x31, x31, 1
+sc.w x5, x31, (x30)
+bne x5, x0, finish_retry
+bne x8, x0, exit_ok          # Only hart 0 checks the result
+
+addi x5, x0, 1               # x5 = i
+addi x29, x0, 1              # x29 = sorted so far
+check:
+bge x5, x18, check_done
+slli x30, x5, 2
+add x30, x30, x20
+addi x30, x30, -4
+lw x28, 0(x30)               # A[i - 1]
+lw x31, 4(x30)               # A[i]
+bge x31, x28, check_next
+addi x29, x0, 0
+jal x0, check_done
+check_next:
+addi x5, x5, 1
+jal x0, check
+check_done:
+sw x29, 16(x23)
+addi x17, x0, 93
+xori x10, x29, 1             # Exit code 0 when sorted
+ecall
+
+exit_ok:
+addi x17, x0, 93
+addi x10, x0, 0
+ecall
+
+# merge: src x10, dst x11; merges src[x12, x13) and src[x13, x14) into dst[x12, x14)
+merge:
+addi x5, x12, 0              # x5 = i (left run)
+addi x6, x13, 0              # x6 = j (right run)
+slli x7, x12, 2
+add x7, x7, x11              # x7 = output address
+merge_loop:
+bge x5, x13, merge_rest_j
+bge x6, x14, merge_rest_i
+slli x30, x5, 2
+add x30, x30, x10
+lw x28, 0(x30)
+slli x31, x6, 2
+add x31, x31, x10
+lw x29, 0(x31)
+blt x29, x28, take_j
+sw x28, 0(x7)                # Left element first on ties, so the sort is stable
+addi x5, x5, 1
+addi x7, x7, 4
+jal x0, merge_loop
+take_j:
+sw x29, 0(x7)
+addi x6, x6, 1
+addi x7, x7, 4
+jal x0, merge_loop
+merge_rest_i:
+bge x5, x13, merge_done
+slli x30, x5, 2
+add x30, x30, x10
+lw x28, 0(x30)
+sw x28, 0(x7)
+addi x5, x5, 1
+addi x7, x7, 4
+jal x0, merge_rest_i
+merge_rest_j:
+bge x6, x14, merge_done
+slli x31, x6, 2
+add x31, x31, x10
+lw x29, 0(x31)
+sw x29, 0(x7)
+addi x6, x6, 1
+addi x7, x7, 4
+jal x0, merge_rest_j
+merge_done:
+jalr x0, x1, 0
+
+# copy_back: A[x10, x11) = B[x10, x11)
+copy_back:
+bge x10, x11, copy_done
+slli x30, x10, 2
+add x31, x30, x21
+lw x28, 0(x31)
+add x31, x30, x20
+sw x28, 0(x31)
+addi x10, x10, 1
+jal x0, copy_back
+copy_done:
+jalr x0, x1, 0
+
+# barrier: sense-reversing; the last hart to arrive resets the count and flips barrier_sense
+barrier:
+xori x22, x22, 1
+addi x30, x23, 4
+addi x31, x0, 1
+amoadd.w x31, x31, (x30)     # x31 = harts that arrived before this one
+addi x31, x31, 1
+bne x31, x9, barrier_wait
+sw x0, 0(x30)
+addi x30, x23, 8
+amoswap.w x0, x22, (x30)
+jalr x0, x1, 0
+barrier_wait:
+addi x30, x23, 8
+barrier_spin:
+lw x31, 0(x30)
+bne x31, x22, barrier_spin
+jalr x0, x1, 0
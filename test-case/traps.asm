@@ -0,0 +1,70 @@
+# Machine-mode traps and the CLINT timer (Csr.h, Clint.h): one handler at mtvec
+# resumes after an illegal instruction and an ebreak, then counts timer
+# interrupts, re-arming mtimecmp 50 ticks later each time, until three have
+# fired. Run it in code.cpp's step mode or pipeline.cpp (--lockstep checks the
+# pipeline takes each interrupt at an instruction boundary).
+.data
+interrupts: .word 0          # timer interrupts taken
+illegal: .word 0             # illegal instruction traps
+breakpoints: .word 0         # ebreak traps
+bad_instruction: .word 0     # mtval of the illegal instruction
+last_cause: .word 0          # mcause of the last interrupt
+status: .word 0              # mstatus after the handler returned
+
+.text
+jal x5, main                 # x5 = 4, the address of the handler
+handler:
+csrr x28, mcause
+blt x28, x0, timer           # Interrupts have the top bit set
+csrr x29, mepc               # Exceptions resume after the faulting instruction
+addi x29, x29, 4
+csrw mepc, x29
+addi x29, x0, 2
+bne x28, x29, breakpoint
+lw x30, 4(x23)
+addi x30, x30, 1
+sw x30, 4(x23)
+csrr x30, mtval
+sw x30, 12(x23)
+mret
+breakpoint:
+lw x30, 8(x23)
+addi x30, x30, 1
+sw x30, 8(x23)
+mret
+timer:
+sw x28, 16(x23)
+lw x30, 0(x23)
+addi x30, x30, 1
+sw x30, 0(x23)
+lui x29, 0x2004              # mtimecmp += 50
+lw x30, 0(x29)
+addi x30, x30, 50
+sw x30, 0(x29)
+mret
+
+main:
+lui x23, 0x10000             # x23 = base of .data
+csrw mtvec, x5
+csrw cycle, x6               # cycle is read-only, so this is an illegal instruction
+ebreak
+
+# Arm the timer 50 ticks from now; the high word goes last so mtimecmp never passes through a small value
+lui x10, 0x2004              # x10 = mtimecmp
+lui x11, 0x200C
+addi x11, x11, -8            # x11 = mtime
+lw x12, 0(x11)
+addi x12, x12, 50
+sw x12, 0(x10)
+sw x0, 4(x10)
+addi x13, x0, 128
+csrw mie, x13                # MTIE
+csrsi mstatus, 8             # MIE
+
+addi x15, x0, 3
+wait:
+lw x14, 0(x23)
+blt x14, x15, wait
+csrci mstatus, 8
+csrr x16, mstatus
+sw x16, 20(x23)
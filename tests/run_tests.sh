@@ -0,0 +1,209 @@
+#!/bin/bash
+# Regression tests for the tools. Builds them into a scratch directory and
+# runs each test there; prints PASS or FAIL per test and exits non-zero if
+# any failed. Usage: tests/run_tests.sh
+set -u
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=0
+
+build() {
+    g++ -std=c++17 -O2 -pthread "$root/$1.cpp" -o "$work/$1" || { echo "FAIL build $1"; exit 1; }
+}
+
+# Fresh directory for one test, with main.asm from stdin
+start() {
+    dir="$work/$1"
+    mkdir -p "$dir" && cd "$dir" && cat > main.asm
+}
+
+pass() { echo "PASS $1"; }
+fail() { echo "FAIL $1: $2"; failures=$((failures + 1)); }
+
+# .incbin: bytes up to the next word boundary and after the last whole word
+# go in as single bytes, the rest as little-endian words; offset and length
+# select a slice; a missing file is an error
+test_incbin() {
+    start incbin <<'EOF'
+.data
+.byte 85
+blob: .incbin "blob.bin"
+after: .word 287454020
+tail: .byte 9
+.incbin "blob.bin", 2, 3
+.half 258
+.text
+addi x1, x0, 1
+EOF
+    printf '\x01\x02\x03\x04\x05\x06\x07' > blob.bin
+    "$work/part1code" > asm.log 2>&1
+    cat > expected.mc <<'EOF'
+0x10000000 0x55
+0x10000001 0x01
+0x10000002 0x02
+0x10000003 0x03
+0x10000004 0x07060504
+0x10000008 0x11223344
+0x1000000C 0x09
+0x1000000D 0x03
+0x1000000E 0x04
+0x1000000F 0x05
+0x10000010 0x0102
+EOF
+    if ! diff -u expected.mc data.mc; then
+        fail incbin "data.mc differs"
+        return
+    fi
+    sed -i 's/"blob.bin", 2, 3/"missing.bin"/' main.asm
+    "$work/part1code" > asm.log 2>&1
+    if ! grep -q 'Cannot open .incbin file: missing.bin' asm.log; then
+        fail incbin "no error for a missing file"
+        return
+    fi
+    pass incbin
+}
+
+# static_analyzer's stall estimate for a straight-line program (load-use,
+# and the drain before CSR instructions and ecall) matches the stalls the
+# pipeline simulator counts
+test_static_stalls() {
+    start static_stalls <<'EOF'
+.text
+addi x5, x0, 1
+lw x6, 0(x3)
+add x7, x6, x5
+csrr x8, instret
+addi x9, x8, 1
+lw x10, 4(x3)
+csrr x11, cycle
+add x12, x11, x10
+addi x17, x0, 93
+addi x10, x0, 0
+ecall
+EOF
+    "$work/part1code" > asm.log 2>&1
+    "$work/pipeline" > pipeline.log 2>&1
+    "$work/static_analyzer" > analyzer.log 2>&1
+    local simulated estimated
+    simulated=$(sed -n 's|^Total Stalls/Bubbles: ||p' pipeline.log)
+    estimated=$(sed -n 's|^Block B0 .* instr, \([0-9]*\) stall cycles.*|\1|p' analyzer.log)
+    if [ -z "$simulated" ] || [ "$simulated" != "$estimated" ]; then
+        fail static_stalls "pipeline stalled ${simulated:-?} cycles, analyzer estimated ${estimated:-?}"
+        return
+    fi
+    pass static_stalls
+}
+
+# write returns -EFAULT for a buffer running past the memory the program
+# loaded or wrote, instead of streaming zeros; the guest exits with -a0
+test_write_efault() {
+    start write_efault <<'EOF'
+.data
+msg: .word 1684234849
+.text
+lui x11, 65536
+addi x10, x0, 1
+addi x12, x0, 4
+addi x17, x0, 64
+ecall
+lui x12, 256
+addi x10, x0, 1
+addi x17, x0, 64
+ecall
+sub x10, x0, x10
+addi x17, x0, 93
+ecall
+EOF
+    "$work/part1code" > asm.log 2>&1
+    local sim status
+    for sim in code pipeline; do
+        "$work/$sim" > $sim.log 2>&1
+        status=$?
+        if [ "$status" -ne 14 ] || ! grep -aq abcd $sim.log; then
+            fail write_efault "$sim exited with $status"
+            return
+        fi
+    done
+    pass write_efault
+}
+
+# The fast modes stop at the first store to an MMIO device and go on in step
+# mode, so the console still prints; the address is built without lui
+test_fast_mmio() {
+    start fast_mmio <<'EOF'
+.text
+addi x5, x0, 0x201
+slli x5, x5, 16
+addi x6, x0, 72
+sw x6, 0(x5)
+addi x6, x0, 10
+sw x6, 0(x5)
+addi x17, x0, 93
+addi x10, x0, 5
+ecall
+EOF
+    "$work/part1code" > asm.log 2>&1
+    local mode status
+    for mode in --fast --blocks --jit; do
+        "$work/code" $mode > code.log 2>&1
+        status=$?
+        if [ "$status" -ne 5 ] || ! grep -q '^H$' code.log; then
+            fail fast_mmio "code $mode exited with $status"
+            return
+        fi
+    done
+    pass fast_mmio
+}
+
+# The fast modes run the loop, stop once mtvec installs a handler and go on
+# in step mode through an ebreak trap and a wfi: exit code 8 + 9
+test_fast_traps() {
+    start fast_traps <<'EOF'
+.text
+jal x5, main
+handler:
+csrr x28, mepc
+addi x28, x28, 4
+csrw mepc, x28
+addi x8, x8, 1
+mret
+main:
+addi x6, x0, 100
+addi x7, x0, 0
+loop:
+addi x7, x7, 1
+blt x7, x6, loop
+csrw mtvec, x5
+addi x8, x0, 7
+ebreak
+addi x9, x0, 9
+wfi
+addi x17, x0, 93
+add x10, x8, x9
+ecall
+EOF
+    "$work/part1code" > asm.log 2>&1
+    local mode status
+    for mode in --fast --blocks --jit; do
+        "$work/code" $mode > code.log 2>&1
+        status=$?
+        if [ "$status" -ne 17 ] || ! grep -q 'mtvec installs a trap handler' code.log; then
+            fail fast_traps "code $mode exited with $status"
+            return
+        fi
+    done
+    pass fast_traps
+}
+
+build part1code
+build code
+build pipeline
+build static_analyzer
+test_incbin
+test_static_stalls
+test_write_efault
+test_fast_mmio
+test_fast_traps
+
+[ "$failures" -eq 0 ]